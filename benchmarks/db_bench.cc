@@ -5,6 +5,7 @@
 #include <sys/types.h>
 
 #include <atomic>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 
@@ -34,15 +35,26 @@
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
 //      readmissing   -- read N missing keys in random order
+//      multireadrandom -- read N times in random order, in MultiGet()
+//                       batches of 100 keys
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
 //      seekordered   -- N ordered seeks
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
+//      filterfpr     -- measured vs. theoretical false positive rate of the
+//                       --filter_type filter, built in memory over N keys
+//                       in filters of 1000 keys each and probed with
+//                       --reads absent keys
+//      filterprobe   -- --reads random probes of one --filter_type filter
+//                       built over N keys, one KeyMayMatch() call per key
+//      filterbatch   -- same probes in KeysMayMatch() batches of 100 keys
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
 //      sstables    -- Print sstable info
+//      filtermem   -- Print the memory used by filters
+//      filteralloc -- Print the filter bits per key allocated to each level
 //      heapprofile -- Dump a heap profile (if supported by this port)
 static const char* FLAGS_benchmarks =
     "fillrandom,"
@@ -55,8 +67,9 @@ static const char* FLAGS_benchmarks =
     "readmissing,";
 
 // Bloom filter bits per key.
-// Negative means use default settings.
-static int FLAGS_filter_bits = 8;
+// Negative means use default settings.  The ribbon filter takes fractional
+// values, the other filters round them down.
+static double FLAGS_filter_bits = 8;
 
 // Number of key/values to place in database
 static int FLAGS_num = 1024*1024*8;
@@ -122,47 +135,103 @@ static const char* FLAGS_db = nullptr;
 
 static bool FLAGS_disable_compaction = false;
 
+// If true, build one filter per table instead of one per 2KB of data.
+static bool FLAGS_full_filter = false;
+
+// If positive, partition table filters into filters of this many keys.
+static int FLAGS_filter_partition_keys = 0;
+
+// If positive, build filter partitions on this many threads per table.
+static int FLAGS_filter_build_threads = 0;
+
+// If true, keep filter blocks in the block cache as high priority entries.
+static bool FLAGS_cache_filter_blocks = false;
+
+// If positive, split this many Bloom filter bits per key between the levels
+// (Options::filter_bits_per_key) instead of using --filter_bits everywhere.
+static double FLAGS_filter_bits_per_key = 0;
+
+// Comma-separated filter type[:bits] per level, overriding --filter_type
+// for the tables written to that level, e.g. "bloom_blocked:40,,binary_fuse:8"
+// (an empty entry keeps --filter_type).
+static const char* FLAGS_level_filter_types = nullptr;
+
+// If positive, also add the first this many bytes of every key to the
+// filters (NewKeyPrefixFilterPolicy), and bound each seekrandom iterator to
+// the keys that share the sought key's prefix so whole tables can be skipped.
+static int FLAGS_filter_prefix_length = 0;
+
 static int filter_type = 3;
 
-const leveldb::FilterPolicy* get_filter_type() {
-    switch (filter_type) {
+const leveldb::FilterPolicy* get_filter_type(int type, double bits) {
+    const int whole_bits = static_cast<int>(bits);
+    switch (type) {
       case 1:
-        std::cout << "Bloom_used with " << FLAGS_filter_bits << "bits" << std::endl;
-        if (FLAGS_filter_bits == -1) {
+        std::cout << "Bloom_used with " << bits << "bits" << std::endl;
+        if (bits == -1) {
           std::cout << "filter_bits must be set when using Bloom filter" << std::endl;
-          std::cout << "use --filter_bits" << std::endl;
+          std::cout << "use --filter_bits (or type:bits in --level_filter_types)" << std::endl;
           exit(1);
         }
-        return leveldb::NewBloomFilterPolicy(FLAGS_filter_bits == -1 ? 8 : FLAGS_filter_bits);
+        return leveldb::NewBloomFilterPolicy(bits == -1 ? 8 : whole_bits);
       case 2:
-        std::cout << "Bloom_Blocked_used" << FLAGS_filter_bits << "bits" << std::endl;
-        return leveldb::NewBlockedBloomFilterPolicyFixed(FLAGS_filter_bits);
+        std::cout << "Bloom_Blocked_used" << bits << "bits" << std::endl;
+        return leveldb::NewBlockedBloomFilterPolicyFixed(whole_bits);
       case 3:
-        std::cout << "Xor_used" << FLAGS_filter_bits << "bits" << std::endl;
-        return leveldb::NewXorFilterPolicy(FLAGS_filter_bits);
+        std::cout << "Xor_used" << bits << "bits" << std::endl;
+        return leveldb::NewXorFilterPolicy(whole_bits);
       case 4:
-        std::cout << "Xor+_used" << FLAGS_filter_bits << "bits" << std::endl;
-        return leveldb::NewXorPlusFilterPolicy(FLAGS_filter_bits);
+        std::cout << "Xor+_used" << bits << "bits" << std::endl;
+        return leveldb::NewXorPlusFilterPolicy(whole_bits);
       case 5:
-        std::cout << "BinaryFuse_used" << FLAGS_filter_bits << "bits" << std::endl;
-        return leveldb::NewBinaryFuseFilterPolicy(FLAGS_filter_bits);
+        std::cout << "BinaryFuse_used" << bits << "bits" << std::endl;
+        return leveldb::NewBinaryFuseFilterPolicy(whole_bits);
       case 6:
-        std::cout << "Ribbon_used" << FLAGS_filter_bits << "bits" << std::endl;
-        return leveldb::NewRibbonFilterPolicy();
+        std::cout << "Ribbon_used" << bits << "bits" << std::endl;
+        return leveldb::NewRibbonFilterPolicy(bits == -1 ? 10 : bits);
       case 7:
-        std::cout << "Cuckoo_used" << FLAGS_filter_bits << "bits" << std::endl;
-        return leveldb::NewCuckooFilterPolicy(FLAGS_filter_bits);
+        std::cout << "Cuckoo_used" << bits << "bits" << std::endl;
+        return leveldb::NewCuckooFilterPolicy(whole_bits);
       case 8:
-        std::cout << "Vacuum_used" << FLAGS_filter_bits << "bits" << std::endl;
-        return leveldb::NewVacuumFilterPolicy(FLAGS_filter_bits, false);
+        std::cout << "Vacuum_used" << bits << "bits" << std::endl;
+        return leveldb::NewVacuumFilterPolicy(whole_bits, false);
       case 9:
-        std::cout << "Vacuum_packed_used" << FLAGS_filter_bits << "bits" << std::endl;
-        return leveldb::NewVacuumFilterPolicy(FLAGS_filter_bits, true);
+        std::cout << "Vacuum_packed_used" << bits << "bits" << std::endl;
+        return leveldb::NewVacuumFilterPolicy(whole_bits, true);
+      case 10:
+        std::cout << "Morton_used" << bits << "bits" << std::endl;
+        return leveldb::NewMortonFilterPolicy(whole_bits);
+      case 11:
+        std::cout << "Prefix_used" << bits << "bits" << std::endl;
+        return leveldb::NewPrefixFilterPolicy();
+      case 12:
+        std::cout << "TCShortcut_used" << bits << "bits" << std::endl;
+        return leveldb::NewTCShortcutFilterPolicy(whole_bits);
+      case 13:
+        std::cout << "BinaryFuse4Wise_used" << bits << "bits" << std::endl;
+        return leveldb::NewBinaryFuse4WiseFilterPolicy(whole_bits);
+      case 14:
+        std::cout << "Bloom_Blocked512_used" << bits << "bits" << std::endl;
+        return leveldb::NewBlockedBloomFilterPolicy512(whole_bits);
       default:
         return nullptr;
     }
 }
 
+// Returns the filter_type of a --filter_type name, 0 if unknown.
+static int get_filter_type_from_name(const char* filter_name) {
+  static const char* const kNames[] = {
+      "bloom", "bloom_blocked", "xor", "xor+", "binary_fuse", "ribbon",
+      "cuckoo", "vacuum", "vacuum_packed", "morton", "prefix", "tc_shortcut",
+      "binary_fuse4", "bloom_blocked512"};
+  for (int i = 0; i < static_cast<int>(sizeof(kNames) / sizeof(kNames[0]));
+       i++) {
+    if (strcmp(filter_name, kNames[i]) == 0) return i + 1;
+  }
+  if (strcmp(filter_name, "none") == 0) return -1;
+  return 0;
+}
+
 namespace leveldb {
 
 namespace {
@@ -412,6 +481,7 @@ class Benchmark {
  private:
   Cache* cache_;
   const FilterPolicy* filter_policy_;
+  std::vector<const FilterPolicy*> level_filter_policies_;
   DB* db_;
   int num_;
   int value_size_;
@@ -503,7 +573,8 @@ class Benchmark {
  public:
   Benchmark()
       : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : nullptr),
-        filter_policy_(get_filter_type()),
+        filter_policy_(
+            WithKeyPrefix(get_filter_type(filter_type, FLAGS_filter_bits))),
         db_(nullptr),
         num_(FLAGS_num),
         value_size_(FLAGS_value_size),
@@ -522,12 +593,61 @@ class Benchmark {
     if (!FLAGS_use_existing_db) {
       DestroyDB(FLAGS_db, Options());
     }
+    if (FLAGS_level_filter_types != nullptr) {
+      Slice types = FLAGS_level_filter_types;
+      while (!types.empty()) {
+        const char* sep = static_cast<const char*>(
+            memchr(types.data(), ',', types.size()));
+        std::string level_type(types.data(),
+                               sep != nullptr ? sep - types.data() : types.size());
+        types.remove_prefix(sep != nullptr ? level_type.size() + 1 : types.size());
+        level_filter_policies_.push_back(
+            WithKeyPrefix(NewLevelFilterPolicy(level_type)));
+      }
+    }
   }
 
   ~Benchmark() {
     delete db_;
     delete cache_;
     delete filter_policy_;
+    for (const FilterPolicy* policy : level_filter_policies_) {
+      delete policy;
+    }
+  }
+
+  // Wraps policy to add key prefixes if --filter_prefix_length is set.
+  static const FilterPolicy* WithKeyPrefix(const FilterPolicy* policy) {
+    if (policy == nullptr || FLAGS_filter_prefix_length <= 0) {
+      return policy;
+    }
+    return NewKeyPrefixFilterPolicy(policy, FLAGS_filter_prefix_length);
+  }
+
+  // The options.new_filter_policy of --filter_bits_per_key: wrapped like
+  // filter_policy_, so that the DB can read the filters it creates.
+  static const FilterPolicy* NewBudgetFilterPolicy(int bits_per_key) {
+    return WithKeyPrefix(NewBloomFilterPolicy(bits_per_key));
+  }
+
+  // Returns the policy of a --level_filter_types entry, nullptr if empty.
+  static const FilterPolicy* NewLevelFilterPolicy(const std::string& entry) {
+    if (entry.empty()) {
+      return nullptr;
+    }
+    std::string name = entry;
+    double bits = FLAGS_filter_bits;
+    size_t colon = entry.find(':');
+    if (colon != std::string::npos) {
+      name = entry.substr(0, colon);
+      bits = std::atof(entry.c_str() + colon + 1);
+    }
+    const int type = get_filter_type_from_name(name.c_str());
+    if (type == 0) {
+      std::fprintf(stderr, "Unknown filter type %s\n", name.c_str());
+      std::exit(1);
+    }
+    return get_filter_type(type, bits);
   }
 
   void Run() {
@@ -595,6 +715,9 @@ class Benchmark {
         method = &Benchmark::ReadRandom;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
+      } else if (name == Slice("multireadrandom")) {
+        entries_per_batch_ = 100;
+        method = &Benchmark::MultiReadRandom;
       } else if (name == Slice("seekrandom")) {
         method = &Benchmark::SeekRandom;
       } else if (name == Slice("seekordered")) {
@@ -615,6 +738,14 @@ class Benchmark {
         method = &Benchmark::Compact;
       } else if (name == Slice("crc32c")) {
         method = &Benchmark::Crc32c;
+      } else if (name == Slice("filterfpr")) {
+        entries_per_batch_ = 1000;
+        method = &Benchmark::FilterFpr;
+      } else if (name == Slice("filterprobe")) {
+        method = &Benchmark::FilterProbe;
+      } else if (name == Slice("filterbatch")) {
+        entries_per_batch_ = 100;
+        method = &Benchmark::FilterBatchProbe;
       } else if (name == Slice("snappycomp")) {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
@@ -625,6 +756,10 @@ class Benchmark {
         PrintStats("leveldb.stats");
       } else if (name == Slice("sstables")) {
         PrintStats("leveldb.sstables");
+      } else if (name == Slice("filtermem")) {
+        PrintStats("leveldb.filter-memory-usage");
+      } else if (name == Slice("filteralloc")) {
+        PrintStats("leveldb.filter-allocation");
       } else {
         if (!name.empty()) {  // No error message for empty name
           std::fprintf(stderr, "unknown benchmark '%s'\n",
@@ -752,6 +887,183 @@ class Benchmark {
     thread->stats.AddMessage(label);
   }
 
+  // Expected false positive rate of the filter built by get_filter_type().
+  // bits_per_key is the measured space per key, which sets the load of the
+  // Bloom and cuckoo style filters; the xor style filters' rate only depends
+  // on their fingerprint width.
+  static double TheoreticalFpr(double bits_per_key) {
+    const int fingerprint_bits = FLAGS_filter_bits >= 16   ? 16
+                                 : FLAGS_filter_bits >= 12 ? 12
+                                                           : 8;
+    switch (filter_type) {
+      case 1: {
+        // Same probe count as the built-in Bloom filter.
+        int k = static_cast<int>(FLAGS_filter_bits * 0.69);
+        if (k < 1) k = 1;
+        if (k > 30) k = 30;
+        return std::pow(1.0 - std::exp(-k / bits_per_key), k);
+      }
+      case 2: {
+        // Keys per 512-bit bucket are Poisson distributed; every key sets
+        // one bit in each of the bucket's eight 64-bit words.
+        const double lambda = 512 / bits_per_key;
+        double fpr = 0;
+        double p = std::exp(-lambda);
+        for (int j = 0; j < lambda * 4 + 64; j++) {
+          fpr += p * std::pow(1.0 - std::pow(1.0 - 1.0 / 64, j), 8);
+          p *= lambda / (j + 1);
+        }
+        return fpr;
+      }
+      case 14: {
+        // Same, with every key setting one bit in each of sixteen 32-bit
+        // lanes.
+        const double lambda = 512 / bits_per_key;
+        double fpr = 0;
+        double p = std::exp(-lambda);
+        for (int j = 0; j < lambda * 4 + 64; j++) {
+          fpr += p * std::pow(1.0 - std::pow(1.0 - 1.0 / 32, j), 16);
+          p *= lambda / (j + 1);
+        }
+        return fpr;
+      }
+      case 3:
+      case 4:
+      case 5:
+      case 13:
+        return std::ldexp(1.0, -(FLAGS_filter_bits == 16 ? 16 : 8));
+      case 6:
+        // Standard128 Ribbon solves about 4% more slots than keys, and every
+        // result column halves the rate.  Small filters are Bloom filters,
+        // which this ignores.
+        return std::pow(2.0, -bits_per_key / 1.04);
+      case 7:
+      case 8:
+      case 9: {
+        // Two buckets of four tags at load factor alpha.  Packed tables keep
+        // one more tag bit than they store, thanks to semi-sorting.
+        const double alpha = std::min(1.0, fingerprint_bits / bits_per_key);
+        const int tag_bits = fingerprint_bits + (filter_type == 9 ? 1 : 0);
+        return 8 * alpha * std::ldexp(1.0, -tag_bits);
+      }
+      case 10:
+        // Buckets hold about one tag each, and a negative lookup reads the
+        // alternate bucket only when the block's overflow bit is set.
+        return std::ldexp(1.0, -fingerprint_bits);
+      case 11:
+        // A PD holds about 25 * 0.95 of the 25 * 256 fingerprints; the few
+        // lookups that reach the spare add its rate on top.
+        return 25 * 0.95 / (25 * 256);
+      case 12:
+        // A lookup reads two PDs, each about 93.5% full, and an entry
+        // matches only on both its quotient and its remainder.
+        if (FLAGS_filter_bits < 12) return 2 * 48 * 0.935 / (80 * 256);
+        return 2 * 28 * 0.935 / (36 * 65536.0);
+      default:
+        return 0;
+    }
+  }
+
+  void FilterFpr(ThreadState* thread) {
+    if (filter_policy_ == nullptr) {
+      thread->stats.AddMessage("(no filter policy)");
+      return;
+    }
+
+    // Filters cover entries_per_batch_ keys each, like the per-block filters
+    // of a table.  Probe keys come from [num_, 2 * num_) so they are never
+    // members of any filter.
+    std::vector<std::string> filters;
+    std::vector<std::string> keys(entries_per_batch_);
+    std::vector<Slice> key_slices(entries_per_batch_);
+    KeyBuffer key;
+    size_t filter_bytes = 0;
+    for (int i = 0; i < num_; i += entries_per_batch_) {
+      const int n = std::min(entries_per_batch_, num_ - i);
+      for (int j = 0; j < n; j++) {
+        key.Set(i + j);
+        keys[j] = key.slice().ToString();
+        key_slices[j] = keys[j];
+      }
+      filters.emplace_back();
+      filter_policy_->CreateFilter(key_slices.data(), n, &filters.back());
+      filter_bytes += filters.back().size();
+    }
+
+    int64_t false_positives = 0;
+    for (int i = 0; i < reads_; i++) {
+      key.Set(num_ + thread->rand.Uniform(num_));
+      const std::string& filter = filters[thread->rand.Uniform(filters.size())];
+      if (filter_policy_->KeyMayMatch(key.slice(), filter)) false_positives++;
+      thread->stats.FinishedSingleOp();
+    }
+
+    const double bits_per_key = 8.0 * filter_bytes / num_;
+    char msg[100];
+    std::snprintf(msg, sizeof(msg),
+                  "(fpr %.4f%%, theoretical %.4f%%, %.2f bits/key)",
+                  100.0 * false_positives / (reads_ > 0 ? reads_ : 1),
+                  100.0 * TheoreticalFpr(bits_per_key), bits_per_key);
+    thread->stats.AddMessage(msg);
+  }
+
+  void FilterProbe(ThreadState* thread) { DoFilterProbe(thread, false); }
+
+  void FilterBatchProbe(ThreadState* thread) { DoFilterProbe(thread, true); }
+
+  // Probes a single filter over num_ keys, as large as a full filter of a
+  // big table, with keys drawn from [0, 2 * num_) so about half of them are
+  // members.  Both variants see the same keys and report the same count.
+  void DoFilterProbe(ThreadState* thread, bool batched) {
+    if (filter_policy_ == nullptr) {
+      thread->stats.AddMessage("(no filter policy)");
+      return;
+    }
+
+    std::string filter;
+    {
+      std::vector<std::string> keys(num_);
+      std::vector<Slice> key_slices(num_);
+      KeyBuffer key;
+      for (int i = 0; i < num_; i++) {
+        key.Set(i);
+        keys[i] = key.slice().ToString();
+        key_slices[i] = keys[i];
+      }
+      filter_policy_->CreateFilter(key_slices.data(), num_, &filter);
+    }
+
+    const int batch_size = batched ? entries_per_batch_ : 1;
+    std::vector<KeyBuffer> keys(batch_size);
+    std::vector<Slice> key_slices(batch_size);
+    std::unique_ptr<bool[]> results(new bool[batch_size]);
+    Random rand(1000);  // Same sequence of keys for both variants
+    int64_t found = 0;
+    thread->stats.Start();
+    for (int i = 0; i < reads_; i += batch_size) {
+      const int n = std::min(batch_size, reads_ - i);
+      for (int j = 0; j < n; j++) {
+        keys[j].Set(rand.Uniform(2 * num_));
+        key_slices[j] = keys[j].slice();
+      }
+      if (batched) {
+        filter_policy_->KeysMayMatch(key_slices.data(), n, filter,
+                                     results.get());
+      } else {
+        results[0] = filter_policy_->KeyMayMatch(key_slices[0], filter);
+      }
+      for (int j = 0; j < n; j++) {
+        if (results[j]) found++;
+        thread->stats.FinishedSingleOp();
+      }
+    }
+
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%lld of %d keys may match)",
+                  static_cast<long long>(found), reads_);
+    thread->stats.AddMessage(msg);
+  }
+
   void SnappyCompress(ThreadState* thread) {
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
@@ -814,6 +1126,19 @@ class Benchmark {
     }
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
+    options.level_filter_policies = level_filter_policies_;
+    options.full_filter = FLAGS_full_filter;
+    options.filter_partition_keys = FLAGS_filter_partition_keys;
+    options.filter_build_threads = FLAGS_filter_build_threads;
+    options.cache_filter_blocks = FLAGS_cache_filter_blocks;
+    if (FLAGS_filter_bits_per_key > 0) {
+      if (filter_type != 1) {
+        std::fprintf(stderr, "--filter_bits_per_key needs --filter_type=bloom\n");
+        std::exit(1);
+      }
+      options.filter_bits_per_key = FLAGS_filter_bits_per_key;
+      options.new_filter_policy = &NewBudgetFilterPolicy;
+    }
     options.reuse_logs = FLAGS_reuse_logs;
     options.compression =
         FLAGS_compression ? kSnappyCompression : kNoCompression;
@@ -835,8 +1160,8 @@ class Benchmark {
   void PrintAvgSize(ThreadState* thread) {
     char msg[100];
     std::snprintf(msg, sizeof(msg),
-                  "average filter size: %f bytes",
-                  db_->AverageFilterSize());
+                  "average filter size: %f bytes (%.2f bits/key)",
+                  db_->AverageFilterSize(), db_->AverageFilterBitsPerKey());
     thread->stats.AddMessage(msg);
     thread->stats.FinishedSingleOp();
   }
@@ -921,6 +1246,36 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void MultiReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    std::vector<std::string> keys(entries_per_batch_);
+    std::vector<Slice> key_slices(entries_per_batch_);
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    int found = 0;
+    KeyBuffer key;
+    for (int i = 0; i < reads_; i += entries_per_batch_) {
+      const int n = std::min(entries_per_batch_, reads_ - i);
+      keys.resize(n);
+      key_slices.resize(n);
+      for (int j = 0; j < n; j++) {
+        key.Set(thread->rand.Uniform(FLAGS_num));
+        keys[j] = key.slice().ToString();
+        key_slices[j] = keys[j];
+      }
+      db_->MultiGet(options, key_slices, &values, &statuses);
+      for (int j = 0; j < n; j++) {
+        if (statuses[j].ok()) {
+          found++;
+        }
+        thread->stats.FinishedSingleOp();
+      }
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -951,10 +1306,21 @@ class Benchmark {
     ReadOptions options;
     int found = 0;
     KeyBuffer key;
+    std::string bound;
+    Slice bound_slice;
     for (int i = 0; i < reads_; i++) {
-      Iterator* iter = db_->NewIterator(options);
       const int k = thread->rand.Uniform(FLAGS_num);
       key.Set(k);
+      if (FLAGS_filter_prefix_length > 0 &&
+          key.slice().size() >= static_cast<size_t>(FLAGS_filter_prefix_length)) {
+        // Keys are printable, so incrementing the last byte of the prefix
+        // gives the first key past it.
+        bound.assign(key.slice().data(), FLAGS_filter_prefix_length);
+        bound.back()++;
+        bound_slice = bound;
+        options.iterate_upper_bound = &bound_slice;
+      }
+      Iterator* iter = db_->NewIterator(options);
       iter->Seek(key.slice());
       if (iter->Valid() && iter->key() == key.slice()) found++;
       delete iter;
@@ -1091,32 +1457,15 @@ int main(int argc, char** argv) {
       FLAGS_benchmarks = argv[i] + strlen("--benchmarks=");
     } else if (leveldb::Slice(argv[i]).starts_with("--filter_type=")) {
       auto filter_name = argv[i] + strlen("--filter_type=");
-
-      if (strcmp(filter_name, "bloom") == 0)
-        filter_type = 1;
-      else if (strcmp(filter_name, "bloom_blocked") == 0)
-        filter_type = 2;
-      else if (strcmp(filter_name, "xor") == 0)
-        filter_type = 3;
-      else if (strcmp(filter_name, "xor+") == 0)
-        filter_type = 4;
-      else if (strcmp(filter_name, "binary_fuse") == 0)
-        filter_type = 5;
-      else if (strcmp(filter_name, "ribbon") == 0)
-        filter_type = 6;
-      else if (strcmp(filter_name, "cuckoo") == 0)
-        filter_type = 7;
-      else if (strcmp(filter_name, "vacuum") == 0)
-        filter_type = 8;
-      else if (strcmp(filter_name, "vacuum_packed") == 0)
-        filter_type = 9;
-      else if (strcmp(filter_name, "none") == 0)
-        filter_type = -1;
-      else {
+      filter_type = get_filter_type_from_name(filter_name);
+      if (filter_type == 0) {
         std::cout <<  "Unknown filter type" << filter_name << std::endl;
         std::exit(1);
       }
-
+    } else if (leveldb::Slice(argv[i]).starts_with("--level_filter_types=")) {
+      FLAGS_level_filter_types = argv[i] + strlen("--level_filter_types=");
+    } else if (sscanf(argv[i], "--filter_bits_per_key=%lf%c", &d, &junk) == 1) {
+      FLAGS_filter_bits_per_key = d;
     } else if (sscanf(argv[i], "--compression_ratio=%lf%c", &d, &junk) == 1) {
       FLAGS_compression_ratio = d;
     } else if (sscanf(argv[i], "--histogram=%d%c", &n, &junk) == 1 &&
@@ -1152,8 +1501,8 @@ int main(int argc, char** argv) {
       FLAGS_key_prefix = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
-    } else if (sscanf(argv[i], "--filter_bits=%d%c", &n, &junk) == 1) {
-      FLAGS_filter_bits = n;
+    } else if (sscanf(argv[i], "--filter_bits=%lf%c", &d, &junk) == 1) {
+      FLAGS_filter_bits = d;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
@@ -1161,6 +1510,18 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--disable_compaction=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_disable_compaction = n;
+    } else if (sscanf(argv[i], "--full_filter=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_full_filter = n;
+    } else if (sscanf(argv[i], "--filter_partition_keys=%d%c", &n, &junk) == 1) {
+      FLAGS_filter_partition_keys = n;
+    } else if (sscanf(argv[i], "--filter_build_threads=%d%c", &n, &junk) == 1) {
+      FLAGS_filter_build_threads = n;
+    } else if (sscanf(argv[i], "--filter_prefix_length=%d%c", &n, &junk) == 1) {
+      FLAGS_filter_prefix_length = n;
+    } else if (sscanf(argv[i], "--cache_filter_blocks=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_cache_filter_blocks = n;
     } else {
         std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
         std::exit(1);
@@ -48,7 +48,8 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
 //      std::cout << "perc. size of filter " << (builder->FilterSize() / (double) builder->FileSize()) * 100 << std::endl;
 //      options.filter_policy->counter_->add((builder->FilterSize() / (double) builder->FileSize()) * 100);
       if (options.filter_policy != nullptr)
-        options.filter_policy->counter_->add(builder->FilterSize());
+        options.filter_policy->counter_->add(builder->FilterSize(),
+                                             builder->NumEntries());
       assert(meta->file_size > 0);
     }
     delete builder;
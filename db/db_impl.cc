@@ -6,8 +6,12 @@
 
 #include <algorithm>
 #include <atomic>
+#include <cmath>
 #include <cstdint>
+#include <deque>
 #include <cstdio>
+#include <cstring>
+#include <numeric>
 #include <set>
 #include <string>
 #include <vector>
@@ -16,6 +20,7 @@
 #include "db/db_iter.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/filter_allocation.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
@@ -98,10 +103,17 @@ Options SanitizeOptions(const std::string& dbname,
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
+  for (const FilterPolicy*& policy : result.level_filter_policies) {
+    if (policy != nullptr) {
+      policy = new InternalFilterPolicy(policy);
+    }
+  }
   ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.filter_build_threads, 0, 64);
+  ClipToRange(&result.filter_bits_per_key, 0.0, 64.0);
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -118,6 +130,19 @@ Options SanitizeOptions(const std::string& dbname,
   return result;
 }
 
+static bool HasLevelFilterPolicy(const Options& options, int level) {
+  return level < static_cast<int>(options.level_filter_policies.size()) &&
+         options.level_filter_policies[level] != nullptr;
+}
+
+Options TableOptionsForLevel(const Options& options, int level) {
+  Options result = options;
+  if (HasLevelFilterPolicy(options, level)) {
+    result.filter_policy = options.level_filter_policies[level];
+  }
+  return result;
+}
+
 static int TableCacheSize(const Options& sanitized_options) {
   // Reserve ten files or so for other uses and give the rest to TableCache.
   return sanitized_options.max_open_files - kNumNonTableCacheFiles;
@@ -147,7 +172,8 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       background_compaction_scheduled_(false),
       manual_compaction_(nullptr),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {}
+                               &internal_comparator_)),
+      filter_bits_mismatch_(false) {}
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish.
@@ -169,6 +195,13 @@ DBImpl::~DBImpl() {
   delete log_;
   delete logfile_;
   delete table_cache_;
+  for (const FilterPolicy* policy : options_.level_filter_policies) {
+    delete policy;
+  }
+  for (const auto& entry : bits_filter_policies_) {
+    delete entry.second.second;
+    delete entry.second.first;
+  }
 
   if (owns_info_log_) {
     delete options_.info_log;
@@ -178,6 +211,39 @@ DBImpl::~DBImpl() {
   }
 }
 
+double DBImpl::AverageFilterSize() {
+  double tables, bytes, keys;
+  FlushFilterTotals(&tables, &bytes, &keys);
+  return tables > 0 ? bytes / tables : 0;
+}
+
+double DBImpl::AverageFilterBitsPerKey() {
+  double tables, bytes, keys;
+  FlushFilterTotals(&tables, &bytes, &keys);
+  return keys > 0 ? 8 * bytes / keys : 0;
+}
+
+void DBImpl::FlushFilterTotals(double* tables, double* bytes, double* keys) {
+  MutexLock l(&mutex_);
+  // BuildTable() records each flush on the policy it was given:
+  // options_.filter_bits_per_key moves level 0 tables to the policies of
+  // bits_filter_policies_.
+  std::vector<const FilterPolicy*> policies;
+  policies.push_back(TableOptionsForLevel(options_, 0).filter_policy);
+  for (const auto& entry : bits_filter_policies_) {
+    policies.push_back(entry.second.second);
+  }
+
+  *tables = *bytes = *keys = 0;
+  for (const FilterPolicy* policy : policies) {
+    if (policy == nullptr) continue;
+    const FilterPolicy::AverageFilterSizeCounter& counter = *policy->counter_;
+    *tables += counter.sizes_.size();
+    *bytes += std::accumulate(counter.sizes_.begin(), counter.sizes_.end(), 0.0);
+    *keys += std::accumulate(counter.keys_.begin(), counter.keys_.end(), 0.0);
+  }
+}
+
 Status DBImpl::NewDB() {
   VersionEdit new_db;
   new_db.SetComparatorName(user_comparator()->Name());
@@ -502,6 +568,80 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   return status;
 }
 
+Options DBImpl::TableOptions(int level) {
+  mutex_.AssertHeld();
+  Options result = TableOptionsForLevel(options_, level);
+  if (AllocatesFilterBits() && !HasLevelFilterPolicy(options_, level)) {
+    double level_bits[config::kNumLevels];
+    AllocateLevelFilterBits(level_bits);
+    const int bits_per_key = static_cast<int>(std::lround(level_bits[level]));
+    result.filter_policy =
+        bits_per_key > 0 ? BitsFilterPolicy(bits_per_key) : nullptr;
+  }
+  return result;
+}
+
+bool DBImpl::AllocatesFilterBits() {
+  mutex_.AssertHeld();
+  return options_.filter_bits_per_key > 0 &&
+         options_.new_filter_policy != nullptr && !filter_bits_mismatch_;
+}
+
+void DBImpl::AllocateLevelFilterBits(double level_bits[config::kNumLevels]) {
+  mutex_.AssertHeld();
+  // Every level 0 table is a sorted run of its own, and every deeper level
+  // is one run.  Runs are measured in bytes.  The next table of level 0 is
+  // a new run, about a memtable in size; the next table of a deeper level
+  // joins the run of the level, counted as at least a memtable.
+  const double min_run = options_.write_buffer_size;
+  const int level0_files = versions_->NumLevelFiles(0);
+  std::vector<double> runs(level0_files,
+                           versions_->NumLevelBytes(0) /
+                               std::max(1.0, static_cast<double>(level0_files)));
+  for (int level = 1; level < config::kNumLevels; level++) {
+    runs.push_back(versions_->NumLevelBytes(level));
+  }
+
+  std::vector<double> bits;
+  runs.push_back(min_run);
+  AllocateFilterBits(runs, options_.filter_bits_per_key, &bits);
+  level_bits[0] = bits.back();
+  runs.pop_back();
+  for (int level = 1; level < config::kNumLevels; level++) {
+    double& run = runs[level0_files + level - 1];
+    const double level_bytes = run;
+    run = std::max(run, min_run);
+    AllocateFilterBits(runs, options_.filter_bits_per_key, &bits);
+    level_bits[level] = bits[level0_files + level - 1];
+    run = level_bytes;
+  }
+}
+
+const FilterPolicy* DBImpl::BitsFilterPolicy(int bits_per_key) {
+  mutex_.AssertHeld();
+  auto& policies = bits_filter_policies_[bits_per_key];
+  if (policies.second == nullptr) {
+    const FilterPolicy* policy = (*options_.new_filter_policy)(bits_per_key);
+    if (options_.filter_policy == nullptr ||
+        std::strcmp(policy->Name(), options_.filter_policy->Name()) != 0) {
+      // filter_policy could not read the filters of policy.
+      Log(options_.info_log,
+          "Ignoring filter_bits_per_key: new_filter_policy creates %s, "
+          "filter_policy is %s",
+          policy->Name(),
+          options_.filter_policy != nullptr ? options_.filter_policy->Name()
+                                            : "(none)");
+      delete policy;
+      bits_filter_policies_.erase(bits_per_key);
+      filter_bits_mismatch_ = true;
+      return options_.filter_policy;
+    }
+    policies.first = policy;
+    policies.second = new InternalFilterPolicy(policy);
+  }
+  return policies.second;
+}
+
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
                                 Version* base) {
   mutex_.AssertHeld();
@@ -515,8 +655,9 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 
   Status s;
   {
+    const Options table_options = TableOptions(0);
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, table_options, table_cache_, iter, &meta);
     mutex_.Lock();
   }
 
@@ -809,6 +950,7 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   assert(compact != nullptr);
   assert(compact->builder == nullptr);
   uint64_t file_number;
+  Options table_options;
   {
     mutex_.Lock();
     file_number = versions_->NewFileNumber();
@@ -818,6 +960,7 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.smallest.Clear();
     out.largest.Clear();
     compact->outputs.push_back(out);
+    table_options = TableOptions(compact->compaction->level() + 1);
     mutex_.Unlock();
   }
 
@@ -825,7 +968,7 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   std::string fname = TableFileName(dbname_, file_number);
   Status s = env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    compact->builder = new TableBuilder(table_options, compact->outfile);
   }
   return s;
 }
@@ -1167,6 +1310,82 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
   return s;
 }
 
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const std::vector<Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<Status>* statuses) {
+  const int n = static_cast<int>(keys.size());
+  values->resize(n);
+  statuses->resize(n);
+
+  MutexLock l(&mutex_);
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  MemTable* mem = mem_;
+  MemTable* imm = imm_;
+  Version* current = versions_->current();
+  mem->Ref();
+  if (imm != nullptr) imm->Ref();
+  current->Ref();
+
+  // Keys that are not found in the memtables, for the table lookup
+  std::deque<LookupKey> lkeys;
+  std::vector<const LookupKey*> pending_keys;
+  std::vector<std::string*> pending_values;
+  std::vector<Status*> pending_statuses;
+  std::vector<Version::GetStats> stats;
+
+  // Unlock while reading from files and memtables
+  {
+    mutex_.Unlock();
+    for (int i = 0; i < n; i++) {
+      lkeys.emplace_back(keys[i], snapshot);
+      const LookupKey& lkey = lkeys.back();
+      std::string* value = &(*values)[i];
+      Status* s = &(*statuses)[i];
+      if (mem->Get(lkey, value, s)) {
+        // Done
+      } else if (imm != nullptr && imm->Get(lkey, value, s)) {
+        // Done
+      } else {
+        pending_keys.push_back(&lkey);
+        pending_values.push_back(value);
+        pending_statuses.push_back(s);
+      }
+    }
+    if (!pending_keys.empty()) {
+      stats.resize(pending_keys.size());
+      std::vector<Status> results(pending_keys.size());
+      current->MultiGet(options, static_cast<int>(pending_keys.size()),
+                        pending_keys.data(), pending_values.data(),
+                        results.data(), stats.data());
+      for (size_t i = 0; i < results.size(); i++) {
+        *pending_statuses[i] = results[i];
+      }
+    }
+    mutex_.Lock();
+  }
+
+  bool schedule_compaction = false;
+  for (size_t i = 0; i < stats.size(); i++) {
+    if (current->UpdateStats(stats[i])) {
+      schedule_compaction = true;
+    }
+  }
+  if (schedule_compaction) {
+    MaybeScheduleCompaction();
+  }
+  mem->Unref();
+  if (imm != nullptr) imm->Unref();
+  current->Unref();
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
@@ -1176,7 +1395,7 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed, options.iterate_upper_bound);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1463,6 +1682,37 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
                   static_cast<unsigned long long>(total_usage));
     value->append(buf);
     return true;
+  } else if (in == "filter-allocation") {
+    if (!AllocatesFilterBits()) {
+      return false;
+    }
+    double level_bits[config::kNumLevels];
+    AllocateLevelFilterBits(level_bits);
+    char buf[200];
+    std::snprintf(buf, sizeof(buf),
+                  "Level  Files Size(MB) Bits/key\n"
+                  "-------------------------------\n");
+    value->append(buf);
+    for (int level = 0; level < config::kNumLevels; level++) {
+      std::snprintf(buf, sizeof(buf), "%3d %8d %8.0f %8.0f%s\n", level,
+                    versions_->NumLevelFiles(level),
+                    versions_->NumLevelBytes(level) / 1048576.0,
+                    std::round(level_bits[level]),
+                    HasLevelFilterPolicy(options_, level) ? " (level policy)"
+                                                          : "");
+      value->append(buf);
+    }
+    return true;
+  } else if (in == "filter-memory-usage") {
+    size_t filter_usage = table_cache_->FilterMemoryUsage();
+    if (options_.cache_filter_blocks) {
+      filter_usage += options_.block_cache->HighPriorityCharge();
+    }
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(filter_usage));
+    value->append(buf);
+    return true;
   }
 
   return false;
@@ -1500,6 +1750,16 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+void DB::MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                  std::vector<std::string>* values,
+                  std::vector<Status>* statuses) {
+  values->resize(keys.size());
+  statuses->resize(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    (*statuses)[i] = Get(options, keys[i], &(*values)[i]);
+  }
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -7,6 +7,7 @@
 
 #include <atomic>
 #include <deque>
+#include <map>
 #include <set>
 #include <string>
 
@@ -28,11 +29,10 @@ class VersionSet;
 
 class DBImpl : public DB {
  public:
-  double AverageFilterSize() override {
-    return options_.filter_policy == nullptr
-               ? 0
-               : options_.filter_policy->counter_->average();
-  }
+  // Statistics of the filters of the memtable flushes, which are built by
+  // the level 0 filter policy.
+  double AverageFilterSize() override;
+  double AverageFilterBitsPerKey() override;
 
   DBImpl(const Options& options, const std::string& dbname);
 
@@ -48,6 +48,9 @@ class DBImpl : public DB {
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  void MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                std::vector<std::string>* values,
+                std::vector<Status>* statuses) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
@@ -152,6 +155,34 @@ class DBImpl : public DB {
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Options for building a table of the given level: the filter policy of
+  // the level, with the bits per key allocated to it under
+  // options_.filter_bits_per_key.
+  Options TableOptions(int level) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Sets level_bits[level] to the bits per key that options_.filter_bits_per_key
+  // allocates to the next table written to each level, given the current
+  // sizes of the sorted runs.
+  void AllocateLevelFilterBits(double level_bits[config::kNumLevels])
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Sets *tables, *bytes and *keys to the number of memtable flushes that
+  // built filters, their total filter size and their total number of keys.
+  void FlushFilterTotals(double* tables, double* bytes, double* keys)
+      LOCKS_EXCLUDED(mutex_);
+
+  // True if options_.filter_bits_per_key picks the filter policies of new
+  // tables.
+  bool AllocatesFilterBits() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Returns the internal filter policy of options_.new_filter_policy for
+  // bits_per_key, creating it on first use.  If its name is not the one of
+  // options_.filter_policy, which has to read its filters, logs the
+  // mismatch and returns options_.filter_policy, and
+  // options_.filter_bits_per_key is ignored from then on.
+  const FilterPolicy* BitsFilterPolicy(int bits_per_key)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
   Status InstallCompactionResults(CompactionState* compact)
@@ -209,15 +240,29 @@ class DBImpl : public DB {
   Status bg_error_ GUARDED_BY(mutex_);
 
   CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
+
+  // Filter policies created by options_.new_filter_policy, by bits per key:
+  // the user policy and its InternalFilterPolicy.
+  std::map<int, std::pair<const FilterPolicy*, const FilterPolicy*>>
+      bits_filter_policies_ GUARDED_BY(mutex_);
+
+  // Has options_.new_filter_policy created a policy that options_.filter_policy
+  // cannot read?
+  bool filter_bits_mismatch_ GUARDED_BY(mutex_);
 };
 
 // Sanitize db options.  The caller should delete result.info_log if
-// it is not equal to src.info_log.
+// it is not equal to src.info_log, and the non-null entries of
+// result.level_filter_policies.
 Options SanitizeOptions(const std::string& db,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
                         const Options& src);
 
+// Returns sanitized options for building a table of the given level, with
+// the filter_policy configured for it (see Options::level_filter_policies).
+Options TableOptionsForLevel(const Options& options, int level);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_DB_IMPL_H_
@@ -46,15 +46,23 @@ class DBIter : public Iterator {
   enum Direction { kForward, kReverse };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, const Slice* upper_bound)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
+        has_upper_bound_(upper_bound != nullptr),
         direction_(kForward),
         valid_(false),
         rnd_(seed),
-        bytes_until_read_sampling_(RandomCompactionPeriod()) {}
+        bytes_until_read_sampling_(RandomCompactionPeriod()) {
+    if (has_upper_bound_) {
+      upper_bound_.assign(upper_bound->data(), upper_bound->size());
+      AppendInternalKey(&upper_limit_,
+                        ParsedInternalKey(upper_bound_, kMaxSequenceNumber,
+                                          kValueTypeForSeek));
+    }
+  }
 
   DBIter(const DBIter&) = delete;
   DBIter& operator=(const DBIter&) = delete;
@@ -88,6 +96,13 @@ class DBIter : public Iterator {
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
 
+  // Is the user key of the current entry of iter_ at or past the bound?
+  bool PastUpperBound() const {
+    return has_upper_bound_ &&
+           user_comparator_->Compare(ExtractUserKey(iter_->key()),
+                                     upper_bound_) >= 0;
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -110,6 +125,9 @@ class DBIter : public Iterator {
   const Comparator* const user_comparator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  const bool has_upper_bound_;
+  std::string upper_bound_;  // User key the iteration stops before
+  std::string upper_limit_;  // First internal key of upper_bound_
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
@@ -179,6 +197,9 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   assert(iter_->Valid());
   assert(direction_ == kForward);
   do {
+    if (PastUpperBound()) {
+      break;
+    }
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
       switch (ikey.type) {
@@ -281,7 +302,13 @@ void DBIter::Seek(const Slice& target) {
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
                     ParsedInternalKey(target, sequence_, kValueTypeForSeek));
-  iter_->Seek(saved_key_);
+  if (has_upper_bound_) {
+    // Only entries before the bound matter, which lets the tables skip
+    // the files and blocks their filters rule out.
+    iter_->SeekWithin(saved_key_, upper_limit_);
+  } else {
+    iter_->Seek(saved_key_);
+  }
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
   } else {
@@ -303,7 +330,16 @@ void DBIter::SeekToFirst() {
 void DBIter::SeekToLast() {
   direction_ = kReverse;
   ClearSavedValue();
-  iter_->SeekToLast();
+  if (has_upper_bound_) {
+    iter_->Seek(upper_limit_);
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else {
+      iter_->SeekToLast();
+    }
+  } else {
+    iter_->SeekToLast();
+  }
   FindPrevUserEntry();
 }
 
@@ -311,8 +347,9 @@ void DBIter::SeekToLast() {
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        uint32_t seed, const Slice* upper_bound) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    upper_bound);
 }
 
 }  // namespace leveldb
@@ -4,8 +4,10 @@
 
 #include "leveldb/db.h"
 
+#include <algorithm>
 #include <atomic>
 #include <cinttypes>
+#include <cmath>
 #include <string>
 
 #include "gtest/gtest.h"
@@ -803,6 +805,47 @@ TEST_F(DBTest, GetEncountersEmptyLevel) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, MultiGet) {
+  do {
+    // Spread the keys over a deeper level, level 0 and the memtable
+    ASSERT_LEVELDB_OK(Put("a", "va1"));
+    ASSERT_LEVELDB_OK(Put("c", "vc1"));
+    ASSERT_LEVELDB_OK(Put("x", "vx1"));
+    Compact("a", "x");
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+    ASSERT_LEVELDB_OK(Delete("x"));
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(Put("a", "va2"));
+    ASSERT_LEVELDB_OK(Put("m", "vm"));
+
+    std::vector<Slice> keys = {"x", "m", "a", "missing", "c", "a"};
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+    ASSERT_EQ(keys.size(), values.size());
+    ASSERT_EQ(keys.size(), statuses.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      std::string expected = Get(keys[i].ToString());
+      ASSERT_EQ(expected, statuses[i].ok() ? values[i]
+                                           : statuses[i].IsNotFound()
+                                                 ? "NOT_FOUND"
+                                                 : statuses[i].ToString());
+    }
+
+    ReadOptions options;
+    options.snapshot = snapshot;
+    db_->MultiGet(options, keys, &values, &statuses);
+    ASSERT_TRUE(statuses[0].IsNotFound());
+    ASSERT_TRUE(statuses[1].IsNotFound());
+    ASSERT_EQ("va1", values[2]);
+    ASSERT_TRUE(statuses[3].IsNotFound());
+    ASSERT_EQ("vc2", values[4]);
+    ASSERT_EQ("va1", values[5]);
+    db_->ReleaseSnapshot(snapshot);
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, IterEmpty) {
   Iterator* iter = db_->NewIterator(ReadOptions());
 
@@ -1381,6 +1424,10 @@ TEST_F(DBTest, HiddenValuesAreRemoved) {
   do {
     Random rnd(301);
     FillLevels("a", "z");
+    // FillLevels leaves more level-0 files than the compaction trigger. Merge
+    // them now, so that a background compaction cannot pick up the table
+    // flushed below while the snapshot still pins the hidden value.
+    dbfull()->TEST_CompactRange(0, nullptr, nullptr);
 
     std::string big = RandomString(&rnd, 50000);
     Put("foo", big);
@@ -1971,6 +2018,410 @@ TEST_F(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+TEST_F(DBTest, Level0TablesOpenedOnRecovery) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.full_filter = true;
+  Reopen(&options);
+
+  // Files spanning all keys in levels 2 and 1, so that three overlapping
+  // files, one short of a compaction, stay in level 0.
+  for (int level = 2; level >= 1; level--) {
+    ASSERT_LEVELDB_OK(Put("a", "begin"));
+    ASSERT_LEVELDB_OK(Put("z", "end"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ(1, NumTableFilesAtLevel(level));
+  }
+  const int N = 1000;
+  for (int file = 0; file < 3; file++) {
+    for (int i = file; i < N; i += 3) {
+      ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_EQ(3, NumTableFilesAtLevel(0));
+
+  // The level-0 files are the newest three tables.
+  std::vector<std::string> filenames;
+  ASSERT_LEVELDB_OK(env_->GetChildren(dbname_, &filenames));
+  std::vector<uint64_t> tables;
+  for (const std::string& filename : filenames) {
+    uint64_t number;
+    FileType type;
+    if (ParseFileName(filename, &number, &type) && type == kTableFile) {
+      tables.push_back(number);
+    }
+  }
+  ASSERT_EQ(5, tables.size());
+  std::sort(tables.begin(), tables.end());
+
+  // The level-0 tables are opened while the DB is, so a lookup in the
+  // newest one reads its data block only, not its footer, index and filter.
+  Reopen(&options);
+  ASSERT_EQ(3, NumTableFilesAtLevel(0));
+  env_->random_read_counter_.Reset();
+  ASSERT_EQ(Key(2), Get(Key(2)));
+  ASSERT_EQ(1, env_->random_read_counter_.Read());
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+
+  // Compacted away, the files are released and deleted.  The lookups above
+  // may have started the compaction and kept its inputs live, in which case
+  // they are only deleted by the next flush.  They may also have queued a
+  // seek compaction of the other levels, so only level 0 is checked.
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (size_t i = tables.size() - 3; i < tables.size(); i++) {
+    ASSERT_TRUE(!env_->FileExists(TableFileName(dbname_, tables[i])))
+        << tables[i];
+  }
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, PrefixFilterBoundedSeek) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy =
+      NewKeyPrefixFilterPolicy(NewBloomFilterPolicy(10), 5);
+  Reopen(&options);
+
+  // Ten keys under each even 5-byte prefix, in a compacted level and a
+  // level 0 file.
+  const int kPrefixes = 1000;
+  char buf[100];
+  for (int p = 0; p < kPrefixes; p += 2) {
+    for (int j = 0; j < 10; j++) {
+      std::snprintf(buf, sizeof(buf), "%05d.%04d", p, j);
+      ASSERT_LEVELDB_OK(Put(buf, buf));
+    }
+  }
+  Compact("0", "9");
+  for (int p = 0; p < kPrefixes; p += 100) {
+    std::snprintf(buf, sizeof(buf), "%05d.%04d", p, 10);
+    ASSERT_LEVELDB_OK(Put(buf, buf));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // The bound is the end of the prefix, "0000:" for "00009".
+  std::string prefix, bound;
+  ReadOptions read_options;
+  read_options.iterate_upper_bound = new Slice();
+
+  env_->random_read_counter_.Reset();
+  int found = 0;
+  for (int p = 0; p < kPrefixes; p += 2) {
+    std::snprintf(buf, sizeof(buf), "%05d", p);
+    prefix = buf;
+    bound = prefix;
+    bound.back()++;
+    *const_cast<Slice*>(read_options.iterate_upper_bound) = bound;
+    Iterator* iter = db_->NewIterator(read_options);
+    for (iter->Seek(prefix); iter->Valid(); iter->Next()) {
+      ASSERT_TRUE(iter->key().starts_with(prefix)) << iter->key().ToString();
+      found++;
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    iter->SeekToLast();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_TRUE(iter->key().starts_with(prefix)) << iter->key().ToString();
+    delete iter;
+  }
+  ASSERT_EQ(kPrefixes / 2 * 10 + kPrefixes / 100, found);
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d present prefixes => %d reads\n", kPrefixes / 2,
+               reads);
+  ASSERT_GE(reads, kPrefixes / 2);
+
+  // Absent prefixes.  Should rarely read from either sstable.
+  env_->random_read_counter_.Reset();
+  for (int p = 1; p < kPrefixes; p += 2) {
+    std::snprintf(buf, sizeof(buf), "%05d", p);
+    prefix = buf;
+    bound = prefix;
+    bound.back()++;
+    *const_cast<Slice*>(read_options.iterate_upper_bound) = bound;
+    Iterator* iter = db_->NewIterator(read_options);
+    iter->Seek(prefix);
+    ASSERT_TRUE(!iter->Valid());
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+  }
+  reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing prefixes => %d reads\n", kPrefixes / 2,
+               reads);
+  ASSERT_LE(reads, 3 * kPrefixes / 100);
+
+  // Reverse iteration from the bound is not filtered.
+  for (int p = 1; p < kPrefixes; p += 50) {
+    std::snprintf(buf, sizeof(buf), "%05d", p);
+    prefix = buf;
+    bound = prefix;
+    bound.back()++;
+    *const_cast<Slice*>(read_options.iterate_upper_bound) = bound;
+    Iterator* iter = db_->NewIterator(read_options);
+    iter->SeekToLast();
+    ASSERT_TRUE(iter->Valid());
+    std::snprintf(buf, sizeof(buf), "%05d.%04d", p - 1, p % 100 == 1 ? 10 : 9);
+    ASSERT_EQ(buf, iter->key().ToString());
+    iter->Next();
+    ASSERT_TRUE(!iter->Valid());
+    delete iter;
+  }
+
+  delete read_options.iterate_upper_bound;
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, LevelFilterPolicies) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.level_filter_policies = {NewBloomFilterPolicy(10), nullptr,
+                                   NewXorFilterPolicy(8)};
+  Reopen(&options);
+
+  // Compacted into level 2 with the xor filter, then a memtable flush with
+  // the level 0 Bloom filter.  Placed in level 1, which has no filter policy
+  // of its own, it keeps the Bloom filter.
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // Each table is read with the policy that wrote its filter.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, N);
+  ASSERT_LE(reads, N + 2 * N / 100);
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3 * N / 100);
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  for (const FilterPolicy* policy : options.level_filter_policies) {
+    delete policy;
+  }
+}
+
+// Policies of one family but different fingerprint widths write different
+// filters, so each must find only its own in a table.
+TEST_F(DBTest, LevelFilterPoliciesOfOneFamily) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewXorFilterPolicy(8);
+  options.level_filter_policies = {nullptr, nullptr, NewXorFilterPolicy(16)};
+  Reopen(&options);
+  ASSERT_NE(std::string(options.filter_policy->Name()),
+            options.level_filter_policies[2]->Name());
+
+  // Level 2 gets the 16-bit filter, the later memtable flush into level 1
+  // the 8-bit filter of filter_policy.
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, N);
+  ASSERT_LE(reads, N + 2 * N / 100);
+
+  // Were either filter read with the other width, it would not open and
+  // every missing key would cost a read of that table.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3 * N / 100);
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+  delete options.level_filter_policies[2];
+}
+
+TEST_F(DBTest, FilterAllocation) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  Reopen(&options);
+  std::string allocation;
+  ASSERT_TRUE(!db_->GetProperty("leveldb.filter-allocation", &allocation));
+
+  options.filter_bits_per_key = 10;
+  options.new_filter_policy = &NewBloomFilterPolicy;
+  options.write_buffer_size = 64 << 10;  // Small level 0 tables
+  Reopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_TRUE(db_->GetProperty("leveldb.filter-allocation", &allocation));
+  std::fprintf(stderr, "%s", allocation.c_str());
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, N);
+  ASSERT_LE(reads, N + 2 * N / 100);
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3 * N / 100);
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, FilterAllocationAverageFilterSize) {
+  Options options = CurrentOptions();
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.filter_bits_per_key = 10;
+  options.new_filter_policy = &NewBloomFilterPolicy;
+  options.write_buffer_size = 64 << 10;  // Small level 0 tables
+  Reopen(&options);
+  ASSERT_EQ(0, db_->AverageFilterSize());
+  ASSERT_EQ(0, db_->AverageFilterBitsPerKey());
+
+  for (int i = 0; i < 10000; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  // The flushes went to the policies of filter_bits_per_key.
+  const double size = db_->AverageFilterSize();
+  const double bits_per_key = db_->AverageFilterBitsPerKey();
+  std::fprintf(stderr, "%.0f bytes, %.1f bits/key\n", size, bits_per_key);
+  ASSERT_TRUE(std::isfinite(size));
+  ASSERT_TRUE(std::isfinite(bits_per_key));
+  ASSERT_GT(size, 0);
+  ASSERT_GT(bits_per_key, 0);
+
+  Close();
+  delete options.filter_policy;
+}
+
+static const FilterPolicy* NewXorBitsFilterPolicy(int bits_per_key) {
+  return NewXorFilterPolicy(bits_per_key);
+}
+
+TEST_F(DBTest, FilterAllocationNameMismatch) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.filter_bits_per_key = 10;
+  options.new_filter_policy = &NewXorBitsFilterPolicy;
+  Reopen(&options);
+  std::string allocation;
+  ASSERT_TRUE(db_->GetProperty("leveldb.filter-allocation", &allocation));
+
+  // filter_policy could not read xor filters: tables get its filters.
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  ASSERT_TRUE(!db_->GetProperty("leveldb.filter-allocation", &allocation));
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  const int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3 * N / 100);
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
 TEST_F(DBTest, LogCloseError) {
   // Regression test for bug where we could ignore log file
   // Close() error when switching to a new log file.
@@ -2162,6 +2613,8 @@ class ModelDB : public DB {
     }
   }
   void CompactRange(const Slice* start, const Slice* end) override {}
+  double AverageFilterSize() override { return 0; }
+  double AverageFilterBitsPerKey() override { return 0; }
 
  private:
   class ModelIter : public Iterator {
@@ -6,6 +6,7 @@
 
 #include <cstdio>
 #include <sstream>
+#include <vector>
 
 #include "port/port.h"
 #include "util/coding.h"
@@ -114,6 +115,43 @@ bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
   return user_policy_->KeyMayMatch(ExtractUserKey(key), f);
 }
 
+void InternalFilterPolicy::KeysMayMatch(const Slice* keys, int n,
+                                        const Slice& f, bool* results) const {
+  std::vector<Slice> user_keys(n);
+  for (int i = 0; i < n; i++) {
+    user_keys[i] = ExtractUserKey(keys[i]);
+  }
+  user_policy_->KeysMayMatch(user_keys.data(), n, f, results);
+}
+
+bool InternalFilterPolicy::HashesKeys() const {
+  return user_policy_->HashesKeys();
+}
+
+uint64_t InternalFilterPolicy::KeyHash(const Slice& key) const {
+  return user_policy_->KeyHash(ExtractUserKey(key));
+}
+
+void InternalFilterPolicy::CreateFilterFromHashes(const uint64_t* hashes,
+                                                  int n,
+                                                  std::string* dst) const {
+  user_policy_->CreateFilterFromHashes(hashes, n, dst);
+}
+
+bool InternalFilterPolicy::RangeMayMatch(const Slice& start, const Slice& limit,
+                                         const Slice& f) const {
+  // Internal keys in [start,limit) have user keys in [user(start),
+  // user(limit)), provided that limit is the first internal key of its user
+  // key, as iterators pass it.  Otherwise user(limit) is in range as well.
+  if (limit.size() < 8 ||
+      DecodeFixed64(limit.data() + limit.size() - 8) !=
+          PackSequenceAndType(kMaxSequenceNumber, kValueTypeForSeek)) {
+    return true;
+  }
+  return user_policy_->RangeMayMatch(ExtractUserKey(start),
+                                     ExtractUserKey(limit), f);
+}
+
 LookupKey::LookupKey(const Slice& user_key, SequenceNumber s) {
   size_t usize = user_key.size();
   size_t needed = usize + 13;  // A conservative estimate
@@ -126,6 +126,14 @@ class InternalFilterPolicy : public FilterPolicy {
   const char* Name() const override;
   void CreateFilter(const Slice* keys, int n, std::string* dst) const override;
   bool KeyMayMatch(const Slice& key, const Slice& filter) const override;
+  void KeysMayMatch(const Slice* keys, int n, const Slice& filter,
+                    bool* results) const override;
+  bool HashesKeys() const override;
+  uint64_t KeyHash(const Slice& key) const override;
+  void CreateFilterFromHashes(const uint64_t* hashes, int n,
+                              std::string* dst) const override;
+  bool RangeMayMatch(const Slice& start, const Slice& limit,
+                     const Slice& filter) const override;
 };
 
 // Modules in this directory should keep internal keys wrapped inside
@@ -0,0 +1,58 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/filter_allocation.h"
+
+#include <cmath>
+
+namespace leveldb {
+
+void AllocateFilterBits(const std::vector<double>& run_keys,
+                        double bits_per_key, std::vector<double>* bits) {
+  const size_t n = run_keys.size();
+  bits->assign(n, 0);
+
+  double total_keys = 0;
+  std::vector<bool> filtered(n);
+  for (size_t i = 0; i < n; i++) {
+    total_keys += run_keys[i];
+    filtered[i] = run_keys[i] > 0;
+  }
+  const double total_bits = bits_per_key * total_keys;
+  const double ln2_squared = std::log(2.0) * std::log(2.0);
+
+  // With rates c * keys_i, run i gets -ln(c * keys_i) / ln(2)^2 bits per
+  // key, and c follows from spending total_bits.  Runs left with a negative
+  // share are dropped and the budget is split again between the others.
+  bool dropped = true;
+  while (dropped) {
+    double filtered_keys = 0;
+    double key_log_sum = 0;
+    for (size_t i = 0; i < n; i++) {
+      if (filtered[i]) {
+        filtered_keys += run_keys[i];
+        key_log_sum += run_keys[i] * std::log(run_keys[i]);
+      }
+    }
+    if (filtered_keys == 0) {
+      return;
+    }
+    const double mean_log = key_log_sum / filtered_keys;
+
+    dropped = false;
+    for (size_t i = 0; i < n; i++) {
+      if (filtered[i]) {
+        (*bits)[i] = total_bits / filtered_keys +
+                     (mean_log - std::log(run_keys[i])) / ln2_squared;
+        if ((*bits)[i] < 0) {
+          (*bits)[i] = 0;
+          filtered[i] = false;
+          dropped = true;
+        }
+      }
+    }
+  }
+}
+
+}  // namespace leveldb
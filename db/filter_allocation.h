@@ -0,0 +1,27 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_FILTER_ALLOCATION_H_
+#define STORAGE_LEVELDB_DB_FILTER_ALLOCATION_H_
+
+#include <vector>
+
+namespace leveldb {
+
+// Splits a filter memory budget of bits_per_key bits per key between sorted
+// runs holding run_keys[i] keys each (or any measure proportional to it,
+// e.g. bytes).  Sets (*bits)[i] to the bits per key of run i.
+//
+// A lookup of an absent key probes the filter of every run, and each false
+// positive costs the same read wherever the run is.  The sum of the false
+// positive rates of Bloom filters, e^(-bits * ln(2)^2) each, is smallest
+// when every rate is proportional to the size of its run (Monkey, Dayan et
+// al. 2017): small runs get more bits per key than the average, large runs
+// fewer.  Runs whose share would be negative get no filter at all.
+void AllocateFilterBits(const std::vector<double>& run_keys,
+                        double bits_per_key, std::vector<double>* bits);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_FILTER_ALLOCATION_H_
@@ -0,0 +1,73 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/filter_allocation.h"
+
+#include <cmath>
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+static double TotalBits(const std::vector<double>& runs,
+                        const std::vector<double>& bits) {
+  double total = 0;
+  for (size_t i = 0; i < runs.size(); i++) {
+    total += runs[i] * bits[i];
+  }
+  return total;
+}
+
+TEST(FilterAllocationTest, EqualRuns) {
+  std::vector<double> bits;
+  AllocateFilterBits({100, 100, 100}, 10, &bits);
+  ASSERT_EQ(3, bits.size());
+  for (double b : bits) {
+    ASSERT_NEAR(10, b, 1e-9);
+  }
+}
+
+TEST(FilterAllocationTest, LevelsOfGrowingSize) {
+  const std::vector<double> runs = {4, 4, 10, 100, 1000, 10000};
+  std::vector<double> bits;
+  AllocateFilterBits(runs, 10, &bits);
+
+  ASSERT_NEAR(10 * (4 + 4 + 10 + 100 + 1000 + 10000), TotalBits(runs, bits),
+              1e-6);
+  // False positive rates proportional to the run sizes: a run ten times
+  // larger gets ln(10) / ln(2)^2 fewer bits per key.
+  const double ln2_squared = std::log(2.0) * std::log(2.0);
+  for (size_t i = 2; i + 1 < runs.size(); i++) {
+    ASSERT_NEAR(std::log(10.0) / ln2_squared, bits[i] - bits[i + 1], 1e-9);
+  }
+  ASSERT_NEAR(bits[0], bits[1], 1e-9);
+  ASSERT_LT(bits.back(), 10);
+  ASSERT_GT(bits.back(), 0);
+}
+
+TEST(FilterAllocationTest, SmallBudget) {
+  // The largest run would get a negative share; it goes without a filter
+  // and its budget goes to the others.
+  const std::vector<double> runs = {1000, 1000, 1000, 1000, 10000};
+  std::vector<double> bits;
+  AllocateFilterBits(runs, 1, &bits);
+  ASSERT_EQ(0, bits[4]);
+  for (size_t i = 0; i < 4; i++) {
+    ASSERT_NEAR(3.5, bits[i], 1e-9);
+  }
+  ASSERT_NEAR(1 * 14000, TotalBits(runs, bits), 1e-6);
+}
+
+TEST(FilterAllocationTest, EmptyRuns) {
+  std::vector<double> bits;
+  AllocateFilterBits({0, 100, 0}, 8, &bits);
+  ASSERT_EQ(0, bits[0]);
+  ASSERT_NEAR(8, bits[1], 1e-9);
+  ASSERT_EQ(0, bits[2]);
+
+  AllocateFilterBits({}, 8, &bits);
+  ASSERT_TRUE(bits.empty());
+}
+
+}  // namespace leveldb
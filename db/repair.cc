@@ -59,6 +59,9 @@ class Repairer {
 
   ~Repairer() {
     delete table_cache_;
+    for (const FilterPolicy* policy : options_.level_filter_policies) {
+      delete policy;
+    }
     if (owns_info_log_) {
       delete options_.info_log;
     }
@@ -203,7 +206,8 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    status = BuildTable(dbname_, env_, TableOptionsForLevel(options_, 0),
+                        table_cache_, iter, &meta);
     delete iter;
     mem->Unref();
     mem = nullptr;
@@ -302,7 +306,9 @@ class Repairer {
     if (!s.ok()) {
       return;
     }
-    TableBuilder* builder = new TableBuilder(options_, file);
+    // Recovered tables all go to level 0.
+    TableBuilder* builder =
+        new TableBuilder(TableOptionsForLevel(options_, 0), file);
 
     // Copy data.
     Iterator* iter = NewTableIterator(t.meta);
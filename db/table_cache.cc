@@ -14,10 +14,14 @@ namespace leveldb {
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+  size_t filter_bytes;  // Filter data held by the table
+  std::atomic<size_t>* filter_memory_usage;
 };
 
 static void DeleteEntry(const Slice& key, void* value) {
   TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+  tf->filter_memory_usage->fetch_sub(tf->filter_bytes,
+                                     std::memory_order_relaxed);
   delete tf->table;
   delete tf->file;
   delete tf;
@@ -34,12 +38,13 @@ TableCache::TableCache(const std::string& dbname, const Options& options,
     : env_(options.env),
       dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {}
+      cache_(NewLRUCache(entries)),
+      filter_memory_usage_(0) {}
 
 TableCache::~TableCache() { delete cache_; }
 
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
-                             Cache::Handle** handle) {
+                             int level, Cache::Handle** handle) {
   Status s;
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
@@ -69,9 +74,16 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
+      tf->filter_bytes = table->FilterMemoryUsage();
+      tf->filter_memory_usage = &filter_memory_usage_;
+      filter_memory_usage_.fetch_add(tf->filter_bytes,
+                                     std::memory_order_relaxed);
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
   }
+  if (s.ok() && level >= 0 && level < options_.pinned_filter_levels) {
+    reinterpret_cast<TableAndFile*>(cache_->Value(*handle))->table->PinFilter();
+  }
   return s;
 }
 
@@ -83,7 +95,7 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   }
 
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, -1, &handle);
   if (!s.ok()) {
     return NewErrorIterator(s);
   }
@@ -100,17 +112,70 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
                        uint64_t file_size, const Slice& k, void* arg,
                        void (*handle_result)(void*, const Slice&,
-                                             const Slice&)) {
-  Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+                                             const Slice&),
+                       int level, Cache::Handle* table) {
+  Cache::Handle* handle = table;
+  Status s;
+  if (handle == nullptr) {
+    s = FindTable(file_number, file_size, level, &handle);
+  }
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
     s = t->InternalGet(options, k, arg, handle_result);
-    cache_->Release(handle);
+    if (handle != table) {
+      cache_->Release(handle);
+    }
   }
   return s;
 }
 
+void TableCache::MultiGet(const ReadOptions& options, uint64_t file_number,
+                          uint64_t file_size, int n, const Slice* keys,
+                          void* const* args,
+                          void (*handle_result)(void*, const Slice&,
+                                                const Slice&),
+                          Status* statuses, int level,
+                          Cache::Handle* table) {
+  Cache::Handle* handle = table;
+  Status s;
+  if (handle == nullptr) {
+    s = FindTable(file_number, file_size, level, &handle);
+  }
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    t->InternalMultiGet(options, n, keys, args, handle_result, statuses);
+    if (handle != table) {
+      cache_->Release(handle);
+    }
+  } else {
+    for (int i = 0; i < n; i++) {
+      statuses[i] = s;
+    }
+  }
+}
+
+Cache::Handle* TableCache::PinTable(uint64_t file_number, uint64_t file_size,
+                                   int level) {
+  Cache::Handle* handle = nullptr;
+  if (!FindTable(file_number, file_size, level, &handle).ok()) {
+    return nullptr;
+  }
+  return handle;
+}
+
+bool TableCache::RangeMayMatch(const ReadOptions& options,
+                               uint64_t file_number, uint64_t file_size,
+                               const Slice& start, const Slice& limit) {
+  Cache::Handle* handle = nullptr;
+  if (!FindTable(file_number, file_size, -1, &handle).ok()) {
+    return true;
+  }
+  Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  const bool may_match = t->RangeMayMatch(options, start, limit);
+  cache_->Release(handle);
+  return may_match;
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
@@ -7,6 +7,7 @@
 #ifndef STORAGE_LEVELDB_DB_TABLE_CACHE_H_
 #define STORAGE_LEVELDB_DB_TABLE_CACHE_H_
 
+#include <atomic>
 #include <cstdint>
 #include <string>
 
@@ -39,21 +40,57 @@ class TableCache {
                         uint64_t file_size, Table** tableptr = nullptr);
 
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value).  "level" is the
+  // level of the file, used to pin the filters of the upper levels (see
+  // Options::pinned_filter_levels), or -1 if unknown.  If "table" is
+  // non-null, it is the handle PinTable() returned for the file, and the
+  // lookup goes straight to its filter and index.
   Status Get(const ReadOptions& options, uint64_t file_number,
              uint64_t file_size, const Slice& k, void* arg,
-             void (*handle_result)(void*, const Slice&, const Slice&));
+             void (*handle_result)(void*, const Slice&, const Slice&),
+             int level = -1, Cache::Handle* table = nullptr);
+
+  // Like Get() for each of keys[0,n-1], which must be sorted: calls
+  // (*handle_result)(args[i], found_key, found_value) if a seek to keys[i]
+  // finds an entry, and sets statuses[i].
+  void MultiGet(const ReadOptions& options, uint64_t file_number,
+                uint64_t file_size, int n, const Slice* keys,
+                void* const* args,
+                void (*handle_result)(void*, const Slice&, const Slice&),
+                Status* statuses, int level = -1,
+                Cache::Handle* table = nullptr);
+
+  // Opens the table of the specified file and keeps it open until
+  // UnpinTable(), even past the capacity of the cache.  Returns nullptr if
+  // the table cannot be opened; Get() then reports the error.
+  Cache::Handle* PinTable(uint64_t file_number, uint64_t file_size, int level);
+  void UnpinTable(Cache::Handle* table) { cache_->Release(table); }
+
+  // Returns false if the filters of the specified file show that it has no
+  // key in [start,limit), see FilterPolicy::RangeMayMatch().  Errors are
+  // treated as potential matches and left to the reads that follow.
+  bool RangeMayMatch(const ReadOptions& options, uint64_t file_number,
+                     uint64_t file_size, const Slice& start,
+                     const Slice& limit);
 
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
+  // Bytes of filter data held by the open tables, not counting filters
+  // kept in the block cache.
+  size_t FilterMemoryUsage() const {
+    return filter_memory_usage_.load(std::memory_order_relaxed);
+  }
+
  private:
-  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  Status FindTable(uint64_t file_number, uint64_t file_size, int level,
+                   Cache::Handle**);
 
   Env* const env_;
   const std::string dbname_;
   const Options& options_;
   Cache* cache_;
+  std::atomic<size_t> filter_memory_usage_;
 };
 
 }  // namespace leveldb
@@ -10,13 +10,15 @@
 #include <vector>
 
 #include "db/dbformat.h"
+#include "leveldb/cache.h"
 
 namespace leveldb {
 
 class VersionSet;
 
 struct FileMetaData {
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+  FileMetaData()
+      : refs(0), allowed_seeks(1 << 30), file_size(0), table(nullptr) {}
 
   int refs;
   int allowed_seeks;  // Seeks allowed until compaction
@@ -24,6 +26,12 @@ struct FileMetaData {
   uint64_t file_size;    // File size in bytes
   InternalKey smallest;  // Smallest internal key served by table
   InternalKey largest;   // Largest internal key served by table
+
+  // For level-0 files of a Version, the table kept open by
+  // TableCache::PinTable() (or nullptr), so that reads reach its filter
+  // without a table cache lookup.  Set before the Version is installed and
+  // released when the last Version holding the file is deleted.
+  Cache::Handle* table;
 };
 
 class VersionEdit {
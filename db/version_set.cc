@@ -78,6 +78,9 @@ Version::~Version() {
       assert(f->refs > 0);
       f->refs--;
       if (f->refs <= 0) {
+        if (f->table != nullptr) {
+          vset_->table_cache_->UnpinTable(f->table);
+        }
         delete f;
       }
     }
@@ -219,11 +222,25 @@ static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
   }
 }
 
+// Lets SeekWithin() on a concatenating iterator skip the files whose
+// filters rule out the range.
+static bool FileRangeMayMatch(void* arg, const ReadOptions& options,
+                              const Slice& file_value, const Slice& start,
+                              const Slice& limit) {
+  TableCache* cache = reinterpret_cast<TableCache*>(arg);
+  if (file_value.size() != 16) {
+    return true;  // GetFileIterator() reports the corruption
+  }
+  return cache->RangeMayMatch(options, DecodeFixed64(file_value.data()),
+                              DecodeFixed64(file_value.data() + 8), start,
+                              limit);
+}
+
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
   return NewTwoLevelIterator(
       new LevelFileNumIterator(vset_->icmp_, &files_[level]), &GetFileIterator,
-      vset_->table_cache_, options);
+      vset_->table_cache_, options, &FileRangeMayMatch, &vset_->icmp_);
 }
 
 void Version::AddIterators(const ReadOptions& options,
@@ -351,9 +368,9 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       state->last_file_read = f;
       state->last_file_read_level = level;
 
-      state->s = state->vset->table_cache_->Get(*state->options, f->number,
-                                                f->file_size, state->ikey,
-                                                &state->saver, SaveValue);
+      state->s = state->vset->table_cache_->Get(
+          *state->options, f->number, f->file_size, state->ikey,
+          &state->saver, SaveValue, level, f->table);
       if (!state->s.ok()) {
         state->found = true;
         return false;
@@ -399,6 +416,139 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   return state.found ? state.s : Status::NotFound(Slice());
 }
 
+void Version::MultiGet(const ReadOptions& options, int n,
+                       const LookupKey* const* keys, std::string* const* vals,
+                       Status* statuses, GetStats* stats) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+
+  // Search state of a key, as in Get()
+  struct KeyState {
+    Saver saver;
+    Slice ikey;
+    FileMetaData* last_file_read;
+    int last_file_read_level;
+    bool done;
+  };
+  std::vector<KeyState> state(n);
+  for (int i = 0; i < n; i++) {
+    state[i].saver.state = kNotFound;
+    state[i].saver.ucmp = ucmp;
+    state[i].saver.user_key = keys[i]->user_key();
+    state[i].saver.value = vals[i];
+    state[i].ikey = keys[i]->internal_key();
+    state[i].last_file_read = nullptr;
+    state[i].last_file_read_level = -1;
+    state[i].done = false;
+    statuses[i] = Status::NotFound(Slice());
+    stats[i].seek_file = nullptr;
+    stats[i].seek_file_level = -1;
+  }
+
+  // Search the keys in sorted order, so that the keys a file may hold are
+  // contiguous and each table sees them in the order of its blocks.
+  std::vector<int> order(n);
+  for (int i = 0; i < n; i++) order[i] = i;
+  const InternalKeyComparator& icmp = vset_->icmp_;
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    return icmp.Compare(state[a].ikey, state[b].ikey) < 0;
+  });
+
+  std::vector<int> batch;
+  std::vector<Slice> batch_keys;
+  std::vector<void*> batch_args;
+  std::vector<Status> batch_statuses;
+  // Searches file "f" for the keys in batch, like State::Match in Get()
+  auto search = [&](int level, FileMetaData* f) {
+    batch_keys.clear();
+    batch_args.clear();
+    for (int i : batch) {
+      KeyState* k = &state[i];
+      if (stats[i].seek_file == nullptr && k->last_file_read != nullptr) {
+        // We have had more than one seek for this read.  Charge the 1st file.
+        stats[i].seek_file = k->last_file_read;
+        stats[i].seek_file_level = k->last_file_read_level;
+      }
+      k->last_file_read = f;
+      k->last_file_read_level = level;
+      batch_keys.push_back(k->ikey);
+      batch_args.push_back(&k->saver);
+    }
+    batch_statuses.resize(batch.size());
+    vset_->table_cache_->MultiGet(
+        options, f->number, f->file_size, static_cast<int>(batch.size()),
+        batch_keys.data(), batch_args.data(), SaveValue,
+        batch_statuses.data(), level, f->table);
+    for (size_t j = 0; j < batch.size(); j++) {
+      const int i = batch[j];
+      KeyState* k = &state[i];
+      if (!batch_statuses[j].ok()) {
+        statuses[i] = batch_statuses[j];
+        k->done = true;
+        continue;
+      }
+      switch (k->saver.state) {
+        case kNotFound:
+          break;  // Keep searching in other files
+        case kFound:
+          statuses[i] = Status::OK();
+          k->done = true;
+          break;
+        case kDeleted:
+          k->done = true;
+          break;
+        case kCorrupt:
+          statuses[i] =
+              Status::Corruption("corrupted key for ", k->saver.user_key);
+          k->done = true;
+          break;
+      }
+    }
+    batch.clear();
+  };
+
+  // Search level-0 in order from newest to oldest.
+  std::vector<FileMetaData*> tmp(files_[0]);
+  std::sort(tmp.begin(), tmp.end(), NewestFirst);
+  for (FileMetaData* f : tmp) {
+    for (int i : order) {
+      if (!state[i].done &&
+          ucmp->Compare(state[i].saver.user_key, f->smallest.user_key()) >= 0 &&
+          ucmp->Compare(state[i].saver.user_key, f->largest.user_key()) <= 0) {
+        batch.push_back(i);
+      }
+    }
+    if (!batch.empty()) {
+      search(0, f);
+    }
+  }
+
+  // Search other levels.
+  for (int level = 1; level < config::kNumLevels; level++) {
+    size_t num_files = files_[level].size();
+    if (num_files == 0) continue;
+
+    // Keys are sorted, so the keys of a file are adjacent in "order"
+    uint32_t batch_index = 0;
+    for (int i : order) {
+      if (state[i].done) continue;
+      uint32_t index = FindFile(vset_->icmp_, files_[level], state[i].ikey);
+      if (index >= num_files ||
+          ucmp->Compare(state[i].saver.user_key,
+                        files_[level][index]->smallest.user_key()) < 0) {
+        continue;  // No file of this level may hold the key
+      }
+      if (!batch.empty() && index != batch_index) {
+        search(level, files_[level][batch_index]);
+      }
+      batch_index = index;
+      batch.push_back(i);
+    }
+    if (!batch.empty()) {
+      search(level, files_[level][batch_index]);
+    }
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != nullptr) {
@@ -774,6 +924,21 @@ void VersionSet::AppendVersion(Version* v) {
   v->next_->prev_ = v;
 }
 
+void VersionSet::PinLevel0Tables(Version* v, const VersionEdit* edit) {
+  for (FileMetaData* f : v->files_[0]) {
+    if (edit != nullptr) {
+      // Files of the current version may be in use, only pin new ones
+      bool added = false;
+      for (const auto& new_file : edit->new_files_) {
+        added = added || (new_file.first == 0 &&
+                          new_file.second.number == f->number);
+      }
+      if (!added) continue;
+    }
+    f->table = table_cache_->PinTable(f->number, f->file_size, 0);
+  }
+}
+
 Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   if (edit->has_log_number_) {
     assert(edit->log_number_ >= log_number_);
@@ -836,6 +1001,12 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
       s = SetCurrentFile(env_, dbname_, manifest_file_number_);
     }
 
+    // Flushed tables are normally still in the table cache, but pinning
+    // them may have to open them.  No other thread sees v yet.
+    if (s.ok()) {
+      PinLevel0Tables(v, edit);
+    }
+
     mu->Lock();
   }
 
@@ -969,6 +1140,7 @@ Status VersionSet::Recover(bool* save_manifest) {
     builder.SaveTo(v);
     // Install recovered version
     Finalize(v);
+    PinLevel0Tables(v, nullptr);
     AppendVersion(v);
     manifest_file_number_ = next_file;
     next_file_number_ = next_file + 1;
@@ -75,6 +75,13 @@ class Version {
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
              GetStats* stats);
 
+  // Lookup the values for keys[0,n-1] like Get(): sets statuses[i] and, if
+  // found, *vals[i].  Each file is searched once for all of the keys it may
+  // hold.  Fills stats[i] for each key.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, int n, const LookupKey* const* keys,
+                std::string* const* vals, Status* statuses, GetStats* stats);
+
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
   // REQUIRES: lock is held
@@ -293,6 +300,11 @@ class VersionSet {
 
   void AppendVersion(Version* v);
 
+  // Keeps the tables of the level-0 files of v open through
+  // FileMetaData::table: the files "edit" adds, or all of them if edit is
+  // null.  v must not be visible to readers yet.
+  void PinLevel0Tables(Version* v, const VersionEdit* edit);
+
   Env* const env_;
   const std::string dbname_;
   const Options* const options_;
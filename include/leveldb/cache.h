@@ -31,6 +31,12 @@ class LEVELDB_EXPORT Cache;
 // of Cache uses a least-recently-used eviction policy.
 LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
 
+// Like NewLRUCache(capacity), but high priority entries (see
+// Cache::InsertHighPriority()) may use up to high_pri_pool_ratio of the
+// capacity before they are evicted ahead of normal entries.
+// NewLRUCache(capacity) reserves half of the capacity.
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio);
+
 class LEVELDB_EXPORT Cache {
  public:
   Cache() = default;
@@ -57,6 +63,17 @@ class LEVELDB_EXPORT Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  // Like Insert(), but the entry goes to the high priority pool, which is
+  // meant for entries that are small but expensive to miss, like filter
+  // blocks.  Normal entries are evicted first while the pool has room.
+  // Default implementation of InsertHighPriority() calls Insert().
+  virtual Handle* InsertHighPriority(const Slice& key, void* value,
+                                     size_t charge,
+                                     void (*deleter)(const Slice& key,
+                                                     void* value)) {
+    return Insert(key, value, charge, deleter);
+  }
+
   // If the cache has no mapping for "key", returns nullptr.
   //
   // Else return a handle that corresponds to the mapping.  The caller
@@ -96,6 +113,10 @@ class LEVELDB_EXPORT Cache {
   // Return an estimate of the combined charges of all elements stored in the
   // cache.
   virtual size_t TotalCharge() const = 0;
+
+  // Return an estimate of the combined charges of the high priority entries
+  // stored in the cache.  Default implementation returns 0.
+  virtual size_t HighPriorityCharge() const { return 0; }
 };
 
 }  // namespace leveldb
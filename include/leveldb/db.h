@@ -7,6 +7,8 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
@@ -87,6 +89,21 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Like Get() for each of "keys", as of a single snapshot: sets
+  // (*statuses)[i] to the status Get() would return for keys[i] and, if
+  // found, (*values)[i] to its value.  Both vectors are resized to the
+  // number of keys.
+  //
+  // Looking up a batch of keys is cheaper than calling Get() for each of
+  // them: each table is searched once for all of the keys it may hold, and
+  // keys that fall into the same data block share a single read of it.
+  //
+  // Default implementation calls Get() for each key.
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -121,6 +138,12 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.filter-memory-usage" - returns the number of bytes of filter
+  //     data held in memory: by open tables, plus the filter blocks kept in
+  //     the block cache with Options::cache_filter_blocks.
+  //  "leveldb.filter-allocation" - returns a multi-line string with the
+  //     bits per key that Options::filter_bits_per_key allocates to the
+  //     next table of each level.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -147,6 +170,8 @@ class LEVELDB_EXPORT DB {
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
 
   virtual double AverageFilterSize() = 0;
+
+  virtual double AverageFilterBitsPerKey() = 0;
 };
 
 // Destroy the contents of the specified database.
@@ -16,6 +16,7 @@
 #ifndef STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
 #define STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <numeric>
@@ -26,6 +27,13 @@ namespace leveldb {
 
 class Slice;
 
+// Readers keep the start of every filter block aligned to this many bytes in
+// memory.  CreateFilter() is called with dst->size() equal to the offset of
+// the new filter inside its filter block, so a policy that probes its filter
+// with SIMD loads can pad its payload to an aligned offset and then read it
+// in place.
+static const size_t kFilterBlockAlignment = 64;
+
 class LEVELDB_EXPORT FilterPolicy {
  public:
   virtual ~FilterPolicy();
@@ -52,19 +60,61 @@ class LEVELDB_EXPORT FilterPolicy {
   // list, but it should aim to return false with a high probability.
   virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const = 0;
 
+  // Sets results[i] to KeyMayMatch(keys[i], filter) for each i in [0,n-1].
+  // Policies can override this to decode the filter once for the batch and
+  // overlap the cache misses of its keys.  Default implementation calls
+  // KeyMayMatch() for each key.
+  virtual void KeysMayMatch(const Slice* keys, int n, const Slice& filter,
+                            bool* results) const;
+
+  // Policies whose filters only depend on a 64-bit hash of every key can
+  // return true here and implement KeyHash() and CreateFilterFromHashes().
+  // Table builders then hash each key once, as it is added, instead of
+  // buffering copies of the keys until the filter is generated.
+  virtual bool HashesKeys() const;
+
+  // Return the hash of key that CreateFilterFromHashes() expects.
+  // REQUIRES: HashesKeys()
+  virtual uint64_t KeyHash(const Slice& key) const;
+
+  // hashes[0,n-1] contains KeyHash() of a list of keys (potentially with
+  // duplicates).  Append the same filter that CreateFilter() would have
+  // appended for those keys to *dst.
+  // REQUIRES: HashesKeys()
+  virtual void CreateFilterFromHashes(const uint64_t* hashes, int n,
+                                      std::string* dst) const;
+
+  // Range filters (prefix filters, SuRF, Rosetta, ...) can tell that a
+  // filter holds no key in [start,limit), which lets iterators skip whole
+  // tables and blocks when they seek (see ReadOptions::iterate_upper_bound).
+  // Must return true if any key in [start,limit) was passed to
+  // CreateFilter().  Default implementation returns true.
+  virtual bool RangeMayMatch(const Slice& start, const Slice& limit,
+                             const Slice& filter) const;
+
   struct AverageFilterSizeCounter{
     std::vector<double> sizes_ = std::vector<double>();
+    std::vector<double> keys_ = std::vector<double>();
 
-    void add(double size) {
-      if (sizes_.size() == 0)
+    void add(double size, double keys) {
+      if (sizes_.size() == 0) {
         sizes_.reserve(1000);
-      if (sizes_.size() <= 1000)
+        keys_.reserve(1000);
+      }
+      if (sizes_.size() <= 1000) {
         sizes_.push_back(size);
+        keys_.push_back(keys);
+      }
     }
 
     double average() const {
       return std::accumulate(sizes_.begin(), sizes_.end(), 0.0) / sizes_.size();
     }
+
+    double bits_per_key() const {
+      return 8 * std::accumulate(sizes_.begin(), sizes_.end(), 0.0) /
+             std::accumulate(keys_.begin(), keys_.end(), 0.0);
+    }
   };
 
   AverageFilterSizeCounter* const counter_ = new AverageFilterSizeCounter();
@@ -89,15 +139,34 @@ LEVELDB_EXPORT const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 LEVELDB_EXPORT const FilterPolicy* NewXorFilterPolicy(size_t bits_per_key);
 LEVELDB_EXPORT const FilterPolicy* NewXorPlusFilterPolicy(size_t bits_per_key);
 LEVELDB_EXPORT const FilterPolicy* NewBinaryFuseFilterPolicy(size_t bits_per_key);
+LEVELDB_EXPORT const FilterPolicy* NewBinaryFuse4WiseFilterPolicy(size_t bits_per_key);
 
 //LEVELDB_EXPORT const FilterPolicy* NewCompressedXorFilterPolicy(size_t bits_per_key);
-LEVELDB_EXPORT const FilterPolicy* NewRibbonFilterPolicy();
+// bits_per_key may be fractional, e.g. 6.5 or 9.3.
+LEVELDB_EXPORT const FilterPolicy* NewRibbonFilterPolicy(double bits_per_key);
 LEVELDB_EXPORT const FilterPolicy* NewBlockedBloomFilterPolicy(size_t bits_per_key);
 LEVELDB_EXPORT const FilterPolicy* NewBlockedBloomFilterPolicyFixed(size_t bits_per_key);
+LEVELDB_EXPORT const FilterPolicy* NewBlockedBloomFilterPolicy512(size_t bits_per_key);
 
 LEVELDB_EXPORT const FilterPolicy* NewVacuumFilterPolicy(size_t bits_per_key, bool packed = false);
 LEVELDB_EXPORT const FilterPolicy* NewCuckooFilterPolicy(size_t bits_per_key);
-//LEVELDB_EXPORT const FilterPolicy* NewMortonFilterPolicy(size_t bits_per_key);
+LEVELDB_EXPORT const FilterPolicy* NewMortonFilterPolicy(size_t bits_per_key);
+LEVELDB_EXPORT const FilterPolicy* NewPrefixFilterPolicy();
+LEVELDB_EXPORT const FilterPolicy* NewTCShortcutFilterPolicy(size_t bits_per_key);
+
+// Return a new filter policy that adds the first prefix_length bytes of
+// every key to the filters of "policy", next to the keys themselves, and
+// answers RangeMayMatch() for ranges whose keys share such a prefix, e.g.
+// Seek(prefix + suffix) with an iterate_upper_bound of the next prefix.
+// Keys shorter than prefix_length are only added whole.  Ranges are
+// compared bytewise, so the DB must use BytewiseComparator() or a
+// comparator that orders keys with a common prefix the same way.
+//
+// The name of the result includes prefix_length: tables whose filters were
+// written with another prefix length (or none) are read without filters.
+// Takes ownership of "policy".
+LEVELDB_EXPORT const FilterPolicy* NewKeyPrefixFilterPolicy(
+    const FilterPolicy* policy, size_t prefix_length);
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
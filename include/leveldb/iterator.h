@@ -47,6 +47,14 @@ class LEVELDB_EXPORT Iterator {
   // an entry that comes at or past target.
   virtual void Seek(const Slice& target) = 0;
 
+  // Like Seek(target), for callers that only want the keys before limit.
+  // If the source contains no key in [target,limit), the iterator may end
+  // up !Valid() or at some key at or past limit that need not be the first
+  // one, which lets iterators skip the tables and blocks whose filters rule
+  // the range out without reading them.  Default implementation calls
+  // Seek(target).
+  virtual void SeekWithin(const Slice& target, const Slice& limit);
+
   // Moves to the next entry in the source.  After this call, Valid() is
   // true iff the iterator was not positioned at the last entry in the source.
   // REQUIRES: Valid()
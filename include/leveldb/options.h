@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <cstddef>
+#include <vector>
 
 #include "leveldb/export.h"
 
@@ -16,6 +17,7 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class Slice;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -85,7 +87,8 @@ struct LEVELDB_EXPORT Options {
 
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
-  // one open file per 2MB of working set).
+  // one open file per 2MB of working set).  The level-0 tables, which every
+  // read may have to probe, are kept open on top of this.
   int max_open_files = 1000;
 
   // Control over blocks (user data is stored in a set of blocks, and
@@ -142,6 +145,66 @@ struct LEVELDB_EXPORT Options {
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // If level_filter_policies[i] is non-null, tables written to level i use
+  // it instead of filter_policy, e.g. a blocked Bloom filter for the small,
+  // often probed upper levels and a compact xor, binary fuse or ribbon
+  // filter for the last levels that hold most of the keys.  Memtable
+  // flushes use the level 0 policy wherever the table is placed, and tables
+  // moved to another level without being rewritten keep their filter.
+  // Tables are read with whichever of these policies wrote them, so every
+  // policy in use has to stay configured.
+  std::vector<const FilterPolicy*> level_filter_policies;
+
+  // If positive (with new_filter_policy), the filter memory budget in bits
+  // per key, averaged over the whole DB.  Rather than spending it evenly,
+  // each new table gets the bits per key that minimize the sum of the false
+  // positive rates of all sorted runs (every level 0 table and every deeper
+  // level) at their current sizes: a false positive costs a read at any
+  // level, and the deep levels hold most of the keys.  Levels with an entry
+  // in level_filter_policies keep that policy.  The chosen allocation is
+  // reported by the "leveldb.filter-allocation" property.
+  double filter_bits_per_key = 0;
+
+  // Creates the filter policies of filter_bits_per_key, e.g.
+  // NewBloomFilterPolicy.  They must all have the Name() of filter_policy,
+  // which reads their filters: otherwise the DB logs the mismatch and
+  // ignores filter_bits_per_key.  The DB deletes the policies it creates.
+  const FilterPolicy* (*new_filter_policy)(int bits_per_key) = nullptr;
+
+  // If true, tables get a single filter over all of their keys instead of
+  // one filter per 2KB of data blocks.  Gets probe it before reading the
+  // index block, and filters whose size overhead is per filter (xor, binary
+  // fuse, ribbon) are built over enough keys to reach their design rate.
+  // Tables written either way can be read regardless of this setting.
+  bool full_filter = false;
+
+  // If positive (and full_filter is false), tables get partitioned filters
+  // instead: one full filter per run of data blocks holding at least this
+  // many keys, found through a small index that is loaded when the table is
+  // opened.  Partitions are read on demand and kept in block_cache, which
+  // bounds the filter memory of an open table.
+  int filter_partition_keys = 0;
+
+  // If positive (with filter_partition_keys), table builders build their
+  // filter partitions on up to this many threads of their own, while data
+  // blocks are still being compressed and written, instead of on the thread
+  // writing the table.  The partitions then follow the data blocks in the
+  // file.  Shortens memtable flushes and compactions when filters are
+  // expensive to build (xor, binary fuse, ribbon).
+  int filter_build_threads = 0;
+
+  // If true (and block_cache is set), the filter block of a table (or the
+  // partition index, with partitioned filters) is kept in block_cache
+  // instead of in the table, charged to the cache and inserted with
+  // Cache::InsertHighPriority() so data blocks are evicted first.  Filter
+  // partitions go to the high priority pool as well.
+  bool cache_filter_blocks = false;
+
+  // With cache_filter_blocks, tables at levels below this one hold on to
+  // their filter block for as long as they are open, so the most often
+  // probed filters never have to be read again.
+  int pinned_filter_levels = 2;
 };
 
 // Options that control read operations
@@ -159,6 +222,13 @@ struct LEVELDB_EXPORT ReadOptions {
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // If "iterate_upper_bound" is non-null, iterators created with these
+  // options stop before the first user key >= *iterate_upper_bound, and a
+  // Seek() may skip the tables whose filters show that they have no key
+  // between the target and the bound (see FilterPolicy::RangeMayMatch()).
+  // The bound is copied when the iterator is created.
+  const Slice* iterate_upper_bound = nullptr;
 };
 
 // Options that control write operations
@@ -6,7 +6,9 @@
 #define STORAGE_LEVELDB_INCLUDE_TABLE_H_
 
 #include <cstdint>
+#include <vector>
 
+#include "leveldb/cache.h"
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 
@@ -14,6 +16,7 @@ namespace leveldb {
 
 class Block;
 class BlockHandle;
+class FilterPolicy;
 class Footer;
 struct Options;
 class RandomAccessFile;
@@ -60,10 +63,17 @@ class LEVELDB_EXPORT Table {
 
  private:
   friend class TableCache;
+  struct Filter;
   struct Rep;
 
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
 
+  // Range function of the table's two-level iterator: probes the filter of
+  // the data block that index_value points to for keys in [start,limit).
+  static bool BlockRangeFilter(void*, const ReadOptions&,
+                               const Slice& index_value, const Slice& start,
+                               const Slice& limit);
+
   explicit Table(Rep* rep) : rep_(rep) {}
 
   // Calls (*handle_result)(arg, ...) with the entry found after a call
@@ -73,8 +83,75 @@ class LEVELDB_EXPORT Table {
                      void (*handle_result)(void* arg, const Slice& k,
                                            const Slice& v));
 
+  // InternalGet() for each of keys[0,n-1], which must be sorted, with
+  // args[i] and the status in statuses[i].  Keys that land in the same
+  // data block share a single read of it.
+  void InternalMultiGet(const ReadOptions&, int n, const Slice* keys,
+                        void* const* args,
+                        void (*handle_result)(void* arg, const Slice& k,
+                                              const Slice& v),
+                        Status* statuses);
+
+  // Layouts of the filters of a table, see doc/table_format.md
+  enum FilterFormat { kBlockFilters, kFullFilter, kPartitionedFilter };
+
+  // Returns the one of "policies" that wrote the filters named by the
+  // metaindex key meta_key and sets *format to their layout, or returns
+  // nullptr if meta_key names no filters of these policies.
+  static const FilterPolicy* FindFilterPolicy(
+      const Slice& meta_key, const std::vector<const FilterPolicy*>& policies,
+      FilterFormat* format);
   void ReadMeta(const Footer& footer);
-  void ReadFilter(const Slice& filter_handle_value);
+
+  // Reads the filter block at "handle".  Returns nullptr on errors.
+  Filter* ReadFilter(const ReadOptions&, const BlockHandle& handle,
+                     FilterFormat format, bool* cachable) const;
+
+  // Inserts the filter block read from "handle" into the block cache, as a
+  // high priority entry with options.cache_filter_blocks.
+  Cache::Handle* InsertFilter(const BlockHandle& handle, Filter* filter) const;
+
+  // Returns a block cache handle to the filter block at "handle", reading
+  // and inserting it on a miss.  If the block could be read but not cached,
+  // returns nullptr and sets *uncached to the block, which the caller must
+  // delete.  Both are nullptr on errors.
+  Cache::Handle* LookupFilter(const ReadOptions&, const BlockHandle& handle,
+                              FilterFormat format, Filter** uncached) const;
+
+  // Probes the filter partition stored at "partition" for key or, if limit
+  // is non-null, for keys in [key,*limit), reading it through the block
+  // cache.
+  bool FilterPartitionMayMatch(const ReadOptions&, const BlockHandle& partition,
+                               const Slice& key, const Slice* limit = nullptr);
+
+  // Returns the filter block of the table, or nullptr if it has none or it
+  // cannot be read.  Pass *handle and *uncached to ReleaseFilter() once done
+  // with it.
+  const Filter* AcquireFilter(const ReadOptions&, Cache::Handle** handle,
+                              Filter** uncached);
+  void ReleaseFilter(Cache::Handle* handle, Filter* uncached);
+
+  // Returns false if the filters show that the data block at block_offset,
+  // or the whole table, has no key in [start,limit).
+  bool BlockRangeMayMatch(const ReadOptions&, const Filter* filter,
+                          uint64_t block_offset, const Slice& start,
+                          const Slice& limit);
+
+  // Returns false if the filters show that the table has no key in
+  // [start,limit), see FilterPolicy::RangeMayMatch().  Probes the filters
+  // of the data blocks the range overlaps, unless the table has a full
+  // filter.
+  bool RangeMayMatch(const ReadOptions&, const Slice& start,
+                     const Slice& limit);
+
+  // With options.cache_filter_blocks, holds a handle to the filter block
+  // until the table is deleted.  Called by TableCache for the tables of
+  // levels below options.pinned_filter_levels.
+  void PinFilter();
+
+  // Bytes of filter data held by the table itself, i.e. not in the block
+  // cache.
+  size_t FilterMemoryUsage() const;
 
   Rep* const rep_;
 };
@@ -85,6 +85,8 @@ class LEVELDB_EXPORT TableBuilder {
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+  void EndFilterPartition();
+  void WriteFilterPartition(const Slice& filter);
 
   struct Rep;
   Rep* rep_;
@@ -4,7 +4,10 @@
 
 #include "table/filter_block.h"
 
+#include <algorithm>
+
 #include "leveldb/filter_policy.h"
+#include "table/filter_build_pool.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -15,10 +18,20 @@ namespace leveldb {
 static const size_t kFilterBaseLg = 11;
 static const size_t kFilterBase = 1 << kFilterBaseLg;
 
-FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy)
-    : policy_(policy) {}
+// Partitioned filter index entry: first data block offset, partition offset
+// and partition size, all fixed64.
+static const size_t kPartitionEntrySize = 3 * sizeof(uint64_t);
+
+FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy,
+                                       bool full_filter)
+    : policy_(policy),
+      full_filter_(full_filter),
+      hashes_keys_(policy->HashesKeys()) {}
 
 void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
+  if (full_filter_) {
+    return;  // All keys go into the one filter generated by Finish()
+  }
   uint64_t filter_index = (block_offset / kFilterBase);
   assert(filter_index >= filter_offsets_.size());
   while (filter_index > filter_offsets_.size()) {
@@ -27,15 +40,27 @@ void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
 }
 
 void FilterBlockBuilder::AddKey(const Slice& key) {
+  if (hashes_keys_) {
+    // Versions of the same user key arrive next to each other and hash
+    // alike, so only the first one needs to reach the filter.
+    const uint64_t h = policy_->KeyHash(key);
+    if (hashes_.empty() || hashes_.back() != h) {
+      hashes_.push_back(h);
+    }
+    return;
+  }
   Slice k = key;
   start_.push_back(keys_.size());
   keys_.append(k.data(), k.size());
 }
 
 Slice FilterBlockBuilder::Finish() {
-  if (!start_.empty()) {
+  if (!start_.empty() || !hashes_.empty()) {
     GenerateFilter();
   }
+  if (full_filter_) {
+    return Slice(result_);
+  }
 
   // Append array of per-filter offsets
   const uint32_t array_offset = result_.size();
@@ -49,13 +74,21 @@ Slice FilterBlockBuilder::Finish() {
 }
 
 void FilterBlockBuilder::GenerateFilter() {
-  const size_t num_keys = start_.size();
+  const size_t num_keys = hashes_keys_ ? hashes_.size() : start_.size();
   if (num_keys == 0) {
     // Fast path if there are no keys for this filter
     filter_offsets_.push_back(result_.size());
     return;
   }
 
+  if (hashes_keys_) {
+    filter_offsets_.push_back(result_.size());
+    policy_->CreateFilterFromHashes(hashes_.data(), static_cast<int>(num_keys),
+                                    &result_);
+    hashes_.clear();  // Keeps its capacity for the next filter
+    return;
+  }
+
   // Make list of keys from flattened key structure
   start_.push_back(keys_.size());  // Simplify length computation
   tmp_keys_.resize(num_keys);
@@ -87,20 +120,185 @@ FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
   num_ = (n - 5 - last_word) / 4;
 }
 
-bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
+bool FilterBlockReader::GetFilter(uint64_t block_offset, Slice* filter) const {
   uint64_t index = block_offset >> base_lg_;
   if (index < num_) {
     uint32_t start = DecodeFixed32(offset_ + index * 4);
     uint32_t limit = DecodeFixed32(offset_ + index * 4 + 4);
     if (start <= limit && limit <= static_cast<size_t>(offset_ - data_)) {
-      Slice filter = Slice(data_ + start, limit - start);
-      return policy_->KeyMayMatch(key, filter);
+      *filter = Slice(data_ + start, limit - start);
+      return true;
     } else if (start == limit) {
-      // Empty filters do not match any keys
-      return false;
+      *filter = Slice();
+      return true;
     }
   }
-  return true;  // Errors are treated as potential matches
+  return false;
+}
+
+bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
+  Slice filter;
+  if (!GetFilter(block_offset, &filter)) {
+    return true;  // Errors are treated as potential matches
+  }
+  if (filter.empty()) {
+    // Empty filters do not match any keys
+    return false;
+  }
+  return policy_->KeyMayMatch(key, filter);
+}
+
+bool FilterBlockReader::RangeMayMatch(uint64_t block_offset, const Slice& start,
+                                      const Slice& limit) {
+  Slice filter;
+  if (!GetFilter(block_offset, &filter)) {
+    return true;  // Errors are treated as potential matches
+  }
+  return !filter.empty() && policy_->RangeMayMatch(start, limit, filter);
+}
+
+// A partition and, once it is finished, its filter.
+struct PartitionedFilterBlockBuilder::Partition : public FilterBuildPool::Task {
+  explicit Partition(const FilterPolicy* policy)
+      : builder(policy, true), start(0) {}
+
+  void Run() override { filter = builder.Finish(); }
+
+  FilterBlockBuilder builder;
+  uint64_t start;  // Offset of its first data block
+  Slice filter;    // builder.Finish(), once run
+};
+
+PartitionedFilterBlockBuilder::PartitionedFilterBlockBuilder(
+    const FilterPolicy* policy, int keys_per_partition, FilterBuildPool* pool)
+    : policy_(policy),
+      keys_per_partition_(keys_per_partition),
+      pool_(pool),
+      partition_(new Partition(policy)),
+      num_keys_(0),
+      finished_(nullptr) {}
+
+PartitionedFilterBlockBuilder::~PartitionedFilterBlockBuilder() {
+  for (Partition* partition : scheduled_) {
+    pool_->Wait(partition);
+    delete partition;
+  }
+  delete finished_;
+  delete partition_;
+}
+
+void PartitionedFilterBlockBuilder::StartBlock(uint64_t block_offset) {
+  if (num_keys_ == 0) {
+    partition_->start = block_offset;
+  }
+}
+
+void PartitionedFilterBlockBuilder::AddKey(const Slice& key) {
+  partition_->builder.AddKey(key);
+  num_keys_++;
+}
+
+Slice PartitionedFilterBlockBuilder::FinishPartition() {
+  assert(num_keys_ > 0);
+  assert(finished_ == nullptr);
+  finished_ = partition_;
+  finished_->Run();
+  partition_ = new Partition(policy_);
+  num_keys_ = 0;
+  return finished_->filter;
+}
+
+void PartitionedFilterBlockBuilder::AddPartition(const BlockHandle& handle) {
+  assert(finished_ != nullptr);
+  PutFixed64(&index_, finished_->start);
+  PutFixed64(&index_, handle.offset());
+  PutFixed64(&index_, handle.size());
+  delete finished_;
+  finished_ = nullptr;
+}
+
+void PartitionedFilterBlockBuilder::SchedulePartition() {
+  assert(pool_ != nullptr);
+  assert(num_keys_ > 0);
+  scheduled_.push_back(partition_);
+  pool_->Schedule(partition_);
+  partition_ = new Partition(policy_);
+  num_keys_ = 0;
+}
+
+Slice PartitionedFilterBlockBuilder::FinishScheduledPartition() {
+  assert(!scheduled_.empty());
+  assert(finished_ == nullptr);
+  finished_ = scheduled_.front();
+  scheduled_.pop_front();
+  pool_->Wait(finished_);
+  return finished_->filter;
+}
+
+Slice PartitionedFilterBlockBuilder::Finish() {
+  assert(num_keys_ == 0);
+  assert(scheduled_.empty());
+  PutFixed32(&index_, index_.size() / kPartitionEntrySize);
+  return Slice(index_);
+}
+
+FullFilterBlockReader::FullFilterBlockReader(const FilterPolicy* policy,
+                                             const Slice& contents)
+    : policy_(policy), filter_(contents) {}
+
+bool FullFilterBlockReader::KeyMayMatch(const Slice& key) {
+  if (filter_.empty()) {
+    // Empty filters do not match any keys
+    return false;
+  }
+  return policy_->KeyMayMatch(key, filter_);
+}
+
+void FullFilterBlockReader::KeysMayMatch(const Slice* keys, int n,
+                                         bool* results) {
+  if (filter_.empty()) {
+    std::fill(results, results + n, false);
+    return;
+  }
+  policy_->KeysMayMatch(keys, n, filter_, results);
+}
+
+bool FullFilterBlockReader::RangeMayMatch(const Slice& start,
+                                          const Slice& limit) {
+  return !filter_.empty() && policy_->RangeMayMatch(start, limit, filter_);
+}
+
+PartitionedFilterBlockReader::PartitionedFilterBlockReader(
+    const Slice& contents)
+    : data_(nullptr), num_(0) {
+  size_t n = contents.size();
+  if (n < 4) return;
+  uint32_t num = DecodeFixed32(contents.data() + n - 4);
+  if (num > (n - 4) / kPartitionEntrySize) return;
+  data_ = contents.data();
+  num_ = num;
+}
+
+bool PartitionedFilterBlockReader::FindPartition(uint64_t block_offset,
+                                                 BlockHandle* handle) const {
+  // Find the last partition that starts at or before block_offset
+  size_t left = 0;
+  size_t right = num_;
+  while (left < right) {
+    size_t mid = left + (right - left) / 2;
+    if (DecodeFixed64(data_ + mid * kPartitionEntrySize) <= block_offset) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  if (left == 0) {
+    return false;
+  }
+  const char* entry = data_ + (left - 1) * kPartitionEntrySize;
+  handle->set_offset(DecodeFixed64(entry + 8));
+  handle->set_size(DecodeFixed64(entry + 16));
+  return true;
 }
 
 }  // namespace leveldb
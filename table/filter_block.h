@@ -11,14 +11,17 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <string>
 #include <vector>
 
 #include "leveldb/slice.h"
+#include "table/format.h"
 #include "util/hash.h"
 
 namespace leveldb {
 
+class FilterBuildPool;
 class FilterPolicy;
 
 // A FilterBlockBuilder is used to construct all of the filters for a
@@ -27,9 +30,12 @@ class FilterPolicy;
 //
 // The sequence of calls to FilterBlockBuilder must match the regexp:
 //      (StartBlock AddKey*)* Finish
+//
+// A full filter builder ignores StartBlock() and its block holds nothing but
+// one filter over every key added (see FullFilterBlockReader).
 class FilterBlockBuilder {
  public:
-  explicit FilterBlockBuilder(const FilterPolicy*);
+  explicit FilterBlockBuilder(const FilterPolicy*, bool full_filter = false);
 
   FilterBlockBuilder(const FilterBlockBuilder&) = delete;
   FilterBlockBuilder& operator=(const FilterBlockBuilder&) = delete;
@@ -42,10 +48,13 @@ class FilterBlockBuilder {
   void GenerateFilter();
 
   const FilterPolicy* policy_;
-  std::string keys_;             // Flattened key contents
-  std::vector<size_t> start_;    // Starting index in keys_ of each key
-  std::string result_;           // Filter data computed so far
-  std::vector<Slice> tmp_keys_;  // policy_->CreateFilter() argument
+  const bool full_filter_;
+  const bool hashes_keys_;        // policy_->HashesKeys()
+  std::vector<uint64_t> hashes_;  // Key hashes, if hashes_keys_
+  std::string keys_;              // Flattened key contents, otherwise
+  std::vector<size_t> start_;     // Starting index in keys_ of each key
+  std::string result_;            // Filter data computed so far
+  std::vector<Slice> tmp_keys_;   // policy_->CreateFilter() argument
   std::vector<uint32_t> filter_offsets_;
 };
 
@@ -55,14 +64,112 @@ class FilterBlockReader {
   FilterBlockReader(const FilterPolicy* policy, const Slice& contents);
   bool KeyMayMatch(uint64_t block_offset, const Slice& key);
 
+  // Probes the filter of the data block at block_offset for keys in
+  // [start,limit), see FilterPolicy::RangeMayMatch().
+  bool RangeMayMatch(uint64_t block_offset, const Slice& start,
+                     const Slice& limit);
+
  private:
+  // Stores the filter of the data block at block_offset in *filter.
+  // Returns false if the filter block has no valid one.
+  bool GetFilter(uint64_t block_offset, Slice* filter) const;
+
   const FilterPolicy* policy_;
-  const char* data_;    // Pointer to filter data (at block-start)
-  const char* offset_;  // Pointer to beginning of offset array (at block-end)
+  const char* data_;              // Pointer to filter data (at block-start)
+  const char* offset_;            // Pointer to beginning of offset array (at block-end)
   size_t num_;          // Number of entries in offset array
   size_t base_lg_;      // Encoding parameter (see kFilterBaseLg in .cc file)
 };
 
+// A PartitionedFilterBlockBuilder splits the filters of a Table into
+// partitions.  Each partition is a full filter over the keys of a run of
+// consecutive data blocks and is written as a block of its own; Finish()
+// returns the top-level index that maps data block offsets to partitions.
+//
+// The sequence of calls to PartitionedFilterBlockBuilder must match the
+// regexp:
+//      (StartBlock AddKey* (FinishPartition AddPartition | SchedulePartition)?)*
+//      (FinishScheduledPartition AddPartition)* Finish
+// where a partition may only be finished or scheduled when it is not empty.
+class PartitionedFilterBlockBuilder {
+ public:
+  // REQUIRES: *pool, if not null, outlives *this.
+  PartitionedFilterBlockBuilder(const FilterPolicy*, int keys_per_partition,
+                                FilterBuildPool* pool = nullptr);
+  ~PartitionedFilterBlockBuilder();
+
+  PartitionedFilterBlockBuilder(const PartitionedFilterBlockBuilder&) = delete;
+  PartitionedFilterBlockBuilder& operator=(
+      const PartitionedFilterBlockBuilder&) = delete;
+
+  void StartBlock(uint64_t block_offset);
+  void AddKey(const Slice& key);
+
+  // True once the current partition holds no keys / keys_per_partition keys.
+  bool PartitionEmpty() const { return num_keys_ == 0; }
+  bool PartitionFull() const { return num_keys_ >= keys_per_partition_; }
+
+  // Returns the filter of the current partition, which stays valid until
+  // AddPartition() records where it was written.
+  Slice FinishPartition();
+  void AddPartition(const BlockHandle& handle);
+
+  // REQUIRES: a pool was given.
+  // Hands the current partition to the pool, to be built while data blocks
+  // are still being written.  Scheduled partitions are written after them,
+  // oldest first: FinishScheduledPartition() waits for the oldest one and
+  // returns its filter, then AddPartition() records where it was written.
+  void SchedulePartition();
+  bool HasScheduledPartition() const { return !scheduled_.empty(); }
+  Slice FinishScheduledPartition();
+
+  Slice Finish();
+
+ private:
+  struct Partition;
+
+  const FilterPolicy* policy_;
+  const int keys_per_partition_;
+  FilterBuildPool* const pool_;
+  Partition* partition_;               // The current partition
+  int num_keys_;                       // Keys added to it
+  std::deque<Partition*> scheduled_;   // Being built on pool_
+  Partition* finished_;                // Returned by Finish*Partition()
+  std::string index_;                  // Top-level index computed so far
+};
+
+class FullFilterBlockReader {
+ public:
+  // REQUIRES: "contents" and *policy must stay live while *this is live.
+  FullFilterBlockReader(const FilterPolicy* policy, const Slice& contents);
+  bool KeyMayMatch(const Slice& key);
+
+  // Sets results[i] to KeyMayMatch(keys[i]) for i in [0,n-1].
+  void KeysMayMatch(const Slice* keys, int n, bool* results);
+
+  bool RangeMayMatch(const Slice& start, const Slice& limit);
+
+ private:
+  const FilterPolicy* policy_;
+  Slice filter_;
+};
+
+// Reads the top-level index of a partitioned filter.  Probing a partition is
+// left to the caller, which reads and caches partitions like data blocks.
+class PartitionedFilterBlockReader {
+ public:
+  // REQUIRES: "contents" must stay live while *this is live.
+  explicit PartitionedFilterBlockReader(const Slice& contents);
+
+  // Stores the handle of the partition that covers the data block starting
+  // at block_offset in *handle.  Returns false if the index has none.
+  bool FindPartition(uint64_t block_offset, BlockHandle* handle) const;
+
+ private:
+  const char* data_;  // Pointer to the index entries
+  size_t num_;        // Number of partitions
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
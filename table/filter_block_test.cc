@@ -5,7 +5,9 @@
 #include "table/filter_block.h"
 
 #include "gtest/gtest.h"
+#include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "table/filter_build_pool.h"
 #include "util/coding.h"
 #include "util/hash.h"
 #include "util/logging.h"
@@ -36,6 +38,23 @@ class TestHashFilter : public FilterPolicy {
   }
 };
 
+// For testing: the same filter, built from hashes handed in by the builder
+class TestHashingFilter : public TestHashFilter {
+ public:
+  bool HashesKeys() const override { return true; }
+
+  uint64_t KeyHash(const Slice& key) const override {
+    return Hash(key.data(), key.size(), 1);
+  }
+
+  void CreateFilterFromHashes(const uint64_t* hashes, int n,
+                              std::string* dst) const override {
+    for (int i = 0; i < n; i++) {
+      PutFixed32(dst, static_cast<uint32_t>(hashes[i]));
+    }
+  }
+};
+
 class FilterBlockTest : public testing::Test {
  public:
   TestHashFilter policy_;
@@ -119,4 +138,177 @@ TEST_F(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(!reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST_F(FilterBlockTest, HashedKeys) {
+  TestHashingFilter policy;
+  FilterBlockBuilder builder(&policy);
+
+  // First filter, adjacent duplicates are only hashed into it once
+  builder.StartBlock(0);
+  builder.AddKey("foo");
+  builder.AddKey("foo");
+  builder.AddKey("bar");
+
+  // Second filter is empty
+
+  // Last filter
+  builder.StartBlock(4100);
+  builder.AddKey("box");
+  builder.AddKey("foo");
+
+  Slice block = builder.Finish();
+  FilterBlockBuilder key_builder(&policy_);
+  key_builder.StartBlock(0);
+  key_builder.AddKey("foo");
+  key_builder.AddKey("bar");
+  key_builder.StartBlock(4100);
+  key_builder.AddKey("box");
+  key_builder.AddKey("foo");
+  ASSERT_EQ(key_builder.Finish().ToString(), block.ToString());
+
+  FilterBlockReader reader(&policy, block);
+  ASSERT_TRUE(reader.KeyMayMatch(0, "foo"));
+  ASSERT_TRUE(reader.KeyMayMatch(0, "bar"));
+  ASSERT_TRUE(!reader.KeyMayMatch(0, "box"));
+  ASSERT_TRUE(!reader.KeyMayMatch(2048, "foo"));
+  ASSERT_TRUE(reader.KeyMayMatch(4100, "box"));
+  ASSERT_TRUE(reader.KeyMayMatch(4100, "foo"));
+  ASSERT_TRUE(!reader.KeyMayMatch(4100, "bar"));
+}
+
+TEST_F(FilterBlockTest, FullFilter) {
+  FilterBlockBuilder builder(&policy_, true);
+  builder.StartBlock(0);
+  builder.AddKey("foo");
+  builder.StartBlock(3100);
+  builder.AddKey("bar");
+  builder.StartBlock(9000);
+  builder.AddKey("box");
+
+  // Just the filter, no offset array
+  Slice block = builder.Finish();
+  ASSERT_EQ(3 * 4, block.size());
+
+  FullFilterBlockReader reader(&policy_, block);
+  ASSERT_TRUE(reader.KeyMayMatch("foo"));
+  ASSERT_TRUE(reader.KeyMayMatch("bar"));
+  ASSERT_TRUE(reader.KeyMayMatch("box"));
+  ASSERT_TRUE(!reader.KeyMayMatch("hello"));
+}
+
+TEST_F(FilterBlockTest, EmptyFullFilter) {
+  FilterBlockBuilder builder(&policy_, true);
+  Slice block = builder.Finish();
+  ASSERT_EQ("", EscapeString(block));
+  FullFilterBlockReader reader(&policy_, block);
+  ASSERT_TRUE(!reader.KeyMayMatch("foo"));
+}
+
+TEST_F(FilterBlockTest, PartitionedFilter) {
+  PartitionedFilterBlockBuilder builder(&policy_, 2);
+  BlockHandle handle;
+
+  // First partition, cut after the block that brings it to two keys
+  builder.StartBlock(0);
+  builder.AddKey("foo");
+  builder.StartBlock(100);
+  ASSERT_TRUE(!builder.PartitionFull());
+  builder.AddKey("bar");
+  ASSERT_TRUE(builder.PartitionFull());
+  Slice partition = builder.FinishPartition();
+  ASSERT_EQ(2 * 4, partition.size());
+  handle.set_offset(1000);
+  handle.set_size(partition.size());
+  builder.AddPartition(handle);
+
+  // Last partition
+  builder.StartBlock(200);
+  ASSERT_TRUE(builder.PartitionEmpty());
+  builder.AddKey("box");
+  builder.StartBlock(300);
+  builder.AddKey("hello");
+  builder.FinishPartition();
+  handle.set_offset(2000);
+  handle.set_size(8);
+  builder.AddPartition(handle);
+
+  Slice block = builder.Finish();
+  PartitionedFilterBlockReader reader(block);
+  ASSERT_TRUE(reader.FindPartition(0, &handle));
+  ASSERT_EQ(1000, handle.offset());
+  ASSERT_TRUE(reader.FindPartition(100, &handle));
+  ASSERT_EQ(1000, handle.offset());
+  ASSERT_TRUE(reader.FindPartition(200, &handle));
+  ASSERT_EQ(2000, handle.offset());
+  ASSERT_TRUE(reader.FindPartition(300, &handle));
+  ASSERT_EQ(2000, handle.offset());
+  ASSERT_EQ(8, handle.size());
+}
+
+TEST_F(FilterBlockTest, ScheduledPartitions) {
+  FilterBuildPool pool(Env::Default(), 2);
+  PartitionedFilterBlockBuilder builder(&policy_, 2, &pool);
+  BlockHandle handle;
+
+  // Partitions are scheduled as they fill up and written after the last
+  // data block, in order.
+  builder.StartBlock(0);
+  builder.AddKey("foo");
+  builder.StartBlock(100);
+  builder.AddKey("bar");
+  ASSERT_TRUE(builder.PartitionFull());
+  builder.SchedulePartition();
+  builder.StartBlock(200);
+  ASSERT_TRUE(builder.PartitionEmpty());
+  builder.AddKey("box");
+  builder.SchedulePartition();
+  builder.StartBlock(300);
+  builder.AddKey("hello");
+  builder.AddKey("world");
+  builder.SchedulePartition();
+
+  const char* expected[][2] = {{"foo", "bar"}, {"box", nullptr},
+                               {"hello", "world"}};
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(builder.HasScheduledPartition());
+    Slice partition = builder.FinishScheduledPartition();
+    ASSERT_TRUE(policy_.KeyMayMatch(expected[i][0], partition));
+    ASSERT_TRUE(!policy_.KeyMayMatch("missing", partition));
+    ASSERT_EQ(expected[i][1] != nullptr ? 8 : 4, partition.size());
+    handle.set_offset(1000 * (i + 1));
+    handle.set_size(partition.size());
+    builder.AddPartition(handle);
+  }
+  ASSERT_TRUE(!builder.HasScheduledPartition());
+
+  Slice block = builder.Finish();
+  PartitionedFilterBlockReader reader(block);
+  ASSERT_TRUE(reader.FindPartition(100, &handle));
+  ASSERT_EQ(1000, handle.offset());
+  ASSERT_TRUE(reader.FindPartition(200, &handle));
+  ASSERT_EQ(2000, handle.offset());
+  ASSERT_TRUE(reader.FindPartition(300, &handle));
+  ASSERT_EQ(3000, handle.offset());
+}
+
+// Partitions still being built when the builder is abandoned are waited for.
+TEST_F(FilterBlockTest, AbandonedScheduledPartitions) {
+  FilterBuildPool pool(Env::Default(), 1);
+  PartitionedFilterBlockBuilder builder(&policy_, 1, &pool);
+  builder.StartBlock(0);
+  for (int i = 0; i < 100; i++) {
+    builder.AddKey("key");
+    builder.SchedulePartition();
+  }
+}
+
+TEST_F(FilterBlockTest, EmptyPartitionedFilter) {
+  PartitionedFilterBlockBuilder builder(&policy_, 2);
+  builder.StartBlock(0);
+  Slice block = builder.Finish();
+  ASSERT_EQ("\\x00\\x00\\x00\\x00", EscapeString(block));
+  PartitionedFilterBlockReader reader(block);
+  BlockHandle handle;
+  ASSERT_TRUE(!reader.FindPartition(0, &handle));
+}
+
 }  // namespace leveldb
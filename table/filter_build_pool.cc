@@ -0,0 +1,93 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/filter_build_pool.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "leveldb/env.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+FilterBuildPool::FilterBuildPool(Env* env, int max_threads)
+    : env_(env),
+      max_threads_(max_threads),
+      work_cv_(&mu_),
+      done_cv_(&mu_),
+      threads_(0),
+      idle_threads_(0),
+      shutting_down_(false) {
+  assert(max_threads > 0);
+}
+
+FilterBuildPool::~FilterBuildPool() {
+  MutexLock l(&mu_);
+  shutting_down_ = true;
+  work_cv_.SignalAll();
+  while (threads_ > 0) {
+    done_cv_.Wait();
+  }
+  assert(queue_.empty());
+}
+
+void FilterBuildPool::Schedule(Task* task) {
+  MutexLock l(&mu_);
+  assert(!shutting_down_);
+  queue_.push_back(task);
+  if (queue_.size() > static_cast<size_t>(idle_threads_) &&
+      threads_ < max_threads_) {
+    threads_++;
+    env_->StartThread(&FilterBuildPool::WorkerEntryPoint, this);
+  } else {
+    work_cv_.Signal();
+  }
+}
+
+void FilterBuildPool::Wait(Task* task) {
+  MutexLock l(&mu_);
+  if (task->state_ == Task::kQueued) {
+    queue_.erase(std::find(queue_.begin(), queue_.end(), task));
+    task->state_ = Task::kRunning;
+    mu_.Unlock();
+    task->Run();
+    mu_.Lock();
+    task->state_ = Task::kDone;
+    return;
+  }
+  while (task->state_ != Task::kDone) {
+    done_cv_.Wait();
+  }
+}
+
+void FilterBuildPool::WorkerEntryPoint(void* pool) {
+  reinterpret_cast<FilterBuildPool*>(pool)->WorkerMain();
+}
+
+void FilterBuildPool::WorkerMain() {
+  MutexLock l(&mu_);
+  while (true) {
+    while (queue_.empty() && !shutting_down_) {
+      idle_threads_++;
+      work_cv_.Wait();
+      idle_threads_--;
+    }
+    if (queue_.empty()) {
+      break;  // Shutting down, and every task has run
+    }
+    Task* task = queue_.front();
+    queue_.pop_front();
+    task->state_ = Task::kRunning;
+    mu_.Unlock();
+    task->Run();
+    mu_.Lock();
+    task->state_ = Task::kDone;
+    done_cv_.SignalAll();
+  }
+  threads_--;
+  done_cv_.SignalAll();
+}
+
+}  // namespace leveldb
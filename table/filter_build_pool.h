@@ -0,0 +1,74 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A FilterBuildPool builds the filters of a table on background threads
+// while the table builder keeps writing data blocks.
+
+#ifndef STORAGE_LEVELDB_TABLE_FILTER_BUILD_POOL_H_
+#define STORAGE_LEVELDB_TABLE_FILTER_BUILD_POOL_H_
+
+#include <deque>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
+namespace leveldb {
+
+class Env;
+
+class FilterBuildPool {
+ public:
+  // A unit of work.  The caller owns it, and must Wait() for it before
+  // deleting it.
+  class Task {
+   public:
+    Task() : state_(kQueued) {}
+    virtual ~Task() = default;
+
+    // Called once, on a pool thread or on a thread in Wait().
+    virtual void Run() = 0;
+
+   private:
+    friend class FilterBuildPool;
+
+    enum State { kQueued, kRunning, kDone };
+    State state_;  // Guarded by the pool's mutex
+  };
+
+  // Runs tasks on at most max_threads threads, started with
+  // env->StartThread() as tasks arrive.
+  // REQUIRES: max_threads > 0
+  FilterBuildPool(Env* env, int max_threads);
+
+  FilterBuildPool(const FilterBuildPool&) = delete;
+  FilterBuildPool& operator=(const FilterBuildPool&) = delete;
+
+  // Runs the tasks still queued and waits for the pool threads to exit.
+  ~FilterBuildPool();
+
+  void Schedule(Task* task);
+
+  // Returns once task has run.  A task no pool thread has picked up yet is
+  // run on the calling thread instead of waited for.
+  void Wait(Task* task);
+
+ private:
+  static void WorkerEntryPoint(void* pool);
+  void WorkerMain();
+
+  Env* const env_;
+  const int max_threads_;
+
+  port::Mutex mu_;
+  port::CondVar work_cv_ GUARDED_BY(mu_);  // A task was queued, or shutdown
+  port::CondVar done_cv_ GUARDED_BY(mu_);  // A task ran, or a thread exited
+  std::deque<Task*> queue_ GUARDED_BY(mu_);
+  int threads_ GUARDED_BY(mu_);       // Live pool threads
+  int idle_threads_ GUARDED_BY(mu_);  // Of which waiting for work
+  bool shutting_down_ GUARDED_BY(mu_);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_FILTER_BUILD_POOL_H_
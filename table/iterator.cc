@@ -38,6 +38,10 @@ void Iterator::RegisterCleanup(CleanupFunction func, void* arg1, void* arg2) {
   node->arg2 = arg2;
 }
 
+void Iterator::SeekWithin(const Slice& target, const Slice& limit) {
+  Seek(target);
+}
+
 namespace {
 
 class EmptyIterator : public Iterator {
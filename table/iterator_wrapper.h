@@ -63,6 +63,11 @@ class IteratorWrapper {
     iter_->Seek(k);
     Update();
   }
+  void SeekWithin(const Slice& k, const Slice& limit) {
+    assert(iter_);
+    iter_->SeekWithin(k, limit);
+    Update();
+  }
   void SeekToFirst() {
     assert(iter_);
     iter_->SeekToFirst();
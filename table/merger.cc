@@ -52,6 +52,17 @@ class MergingIterator : public Iterator {
     direction_ = kForward;
   }
 
+  // Children that skipped the range may be positioned past limit, but
+  // Next() still yields the keys before limit in order, and switching to
+  // Prev() repositions every child with Seek().
+  void SeekWithin(const Slice& target, const Slice& limit) override {
+    for (int i = 0; i < n_; i++) {
+      children_[i].SeekWithin(target, limit);
+    }
+    FindSmallest();
+    direction_ = kForward;
+  }
+
   void Next() override {
     assert(Valid());
 
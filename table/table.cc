@@ -15,15 +15,39 @@
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <thread>
 
 namespace leveldb {
 
+// The filter block of a table, with the reader for its layout.  Filter
+// partitions are stored the same way, as full filters.
+struct Table::Filter {
+  ~Filter() {
+    delete blocks;
+    delete full;
+    delete partitions;
+    delete[] data;
+  }
+
+  const char* data;  // Buffer to delete[], if any
+  size_t size;
+  FilterBlockReader* blocks;
+  FullFilterBlockReader* full;
+  PartitionedFilterBlockReader* partitions;
+};
+
 struct Table::Rep {
   ~Rep() {
+    Cache::Handle* pinned = pinned_filter.load(std::memory_order_relaxed);
+    if (pinned != nullptr) {
+      options.block_cache->Release(pinned);
+    }
     delete filter;
-    delete[] filter_data;
     delete index_block;
   }
 
@@ -31,8 +55,15 @@ struct Table::Rep {
   Status status;
   RandomAccessFile* file;
   uint64_t cache_id;
-  FilterBlockReader* filter;
-  const char* filter_data;
+  const FilterPolicy* filter_policy;  // The policy that wrote the filters
+  Filter* filter;  // Held by the table unless cache_filter is set
+
+  // Filter block kept in options.block_cache (options.cache_filter_blocks)
+  bool cache_filter;
+  BlockHandle filter_handle;
+  FilterFormat filter_format;
+  std::atomic<bool> pin_requested;
+  std::atomic<Cache::Handle*> pinned_filter;
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
@@ -73,8 +104,12 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
-    rep->filter_data = nullptr;
+    rep->filter_policy = nullptr;
     rep->filter = nullptr;
+    rep->cache_filter = false;
+    rep->filter_format = kBlockFilters;
+    rep->pin_requested.store(false, std::memory_order_relaxed);
+    rep->pinned_filter.store(nullptr, std::memory_order_relaxed);
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
   }
@@ -82,8 +117,48 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
   return s;
 }
 
+const FilterPolicy* Table::FindFilterPolicy(
+    const Slice& meta_key, const std::vector<const FilterPolicy*>& policies,
+    FilterFormat* format) {
+  // A table holds filters in one of the layouts, whichever the options
+  // asked for when it was written.
+  static const struct {
+    const char* prefix;
+    FilterFormat format;
+  } kFilterKeys[] = {
+      {"fullfilter.", kFullFilter},
+      {"partitionedfilter.", kPartitionedFilter},
+      {"filter.", kBlockFilters},
+  };
+  for (const auto& filter_key : kFilterKeys) {
+    Slice name = meta_key;
+    if (name.starts_with(filter_key.prefix)) {
+      name.remove_prefix(std::strlen(filter_key.prefix));
+      for (const FilterPolicy* policy : policies) {
+        if (name == Slice(policy->Name())) {
+          *format = filter_key.format;
+          return policy;
+        }
+      }
+      return nullptr;
+    }
+  }
+  return nullptr;
+}
+
 void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
+  // The filters were written by filter_policy or, in a DB, by the policy of
+  // the level the table was written to.  Its metaindex entry says which.
+  std::vector<const FilterPolicy*> policies;
+  if (rep_->options.filter_policy != nullptr) {
+    policies.push_back(rep_->options.filter_policy);
+  }
+  for (const FilterPolicy* policy : rep_->options.level_filter_policies) {
+    if (policy != nullptr) {
+      policies.push_back(policy);
+    }
+  }
+  if (policies.empty()) {
     return;  // Do not need any metadata
   }
 
@@ -101,37 +176,271 @@ void Table::ReadMeta(const Footer& footer) {
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    FilterFormat format;
+    const FilterPolicy* policy = FindFilterPolicy(iter->key(), policies, &format);
+    if (policy != nullptr) {
+      Slice v = iter->value();
+      BlockHandle filter_handle;
+      if (!filter_handle.DecodeFrom(&v).ok()) {
+        break;
+      }
+      rep_->filter_policy = policy;
+      bool cachable;
+      Filter* filter = ReadFilter(opt, filter_handle, format, &cachable);
+      if (filter != nullptr && cachable && rep_->options.cache_filter_blocks &&
+          rep_->options.block_cache != nullptr) {
+        // Read again through the block cache once evicted.  Blocks that
+        // cannot be cached (e.g. of mmap-ed files) stay with the table.
+        rep_->cache_filter = true;
+        rep_->filter_handle = filter_handle;
+        rep_->filter_format = format;
+        rep_->options.block_cache->Release(InsertFilter(filter_handle, filter));
+      } else {
+        rep_->filter = filter;
+      }
+      break;
+    }
   }
   delete iter;
   delete meta;
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
-  Slice v = filter_handle_value;
-  BlockHandle filter_handle;
-  if (!filter_handle.DecodeFrom(&v).ok()) {
-    return;
+// Filter policies probe their filters in place; give them the aligned block
+// they were laid out for (see kFilterBlockAlignment).  Sets *owned to the
+// buffer the caller has to delete[], if any.
+static Slice AlignFilterBlock(const BlockContents& block, const char** owned) {
+  Slice contents = block.data;
+  *owned = nullptr;
+  if (reinterpret_cast<uintptr_t>(contents.data()) % kFilterBlockAlignment != 0) {
+    char* buf = new char[contents.size() + kFilterBlockAlignment];
+    char* aligned = buf + (kFilterBlockAlignment -
+                           reinterpret_cast<uintptr_t>(buf) % kFilterBlockAlignment);
+    std::memcpy(aligned, contents.data(), contents.size());
+    if (block.heap_allocated) {
+      delete[] block.data.data();
+    }
+    *owned = buf;
+    contents = Slice(aligned, contents.size());
+  } else if (block.heap_allocated) {
+    *owned = block.data.data();
   }
+  return contents;
+}
 
-  // We might want to unify with ReadBlock() if we start
-  // requiring checksum verification in Table::Open.
-  ReadOptions opt;
-  if (rep_->options.paranoid_checks) {
-    opt.verify_checksums = true;
-  }
+Table::Filter* Table::ReadFilter(const ReadOptions& options,
+                                const BlockHandle& handle,
+                                FilterFormat format, bool* cachable) const {
   BlockContents block;
-  if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
+  if (!ReadBlock(rep_->file, options, handle, &block).ok()) {
+    return nullptr;
+  }
+  *cachable = block.cachable;
+  Filter* filter = new Filter;
+  Slice contents = AlignFilterBlock(block, &filter->data);
+  filter->size = contents.size();
+  filter->blocks = nullptr;
+  filter->full = nullptr;
+  filter->partitions = nullptr;
+  switch (format) {
+    case kBlockFilters:
+      filter->blocks =
+          new FilterBlockReader(rep_->filter_policy, contents);
+      break;
+    case kFullFilter:
+      filter->full =
+          new FullFilterBlockReader(rep_->filter_policy, contents);
+      break;
+    case kPartitionedFilter:
+      filter->partitions = new PartitionedFilterBlockReader(contents);
+      break;
+  }
+  return filter;
+}
+
+Cache::Handle* Table::InsertFilter(const BlockHandle& handle,
+                                   Filter* filter) const {
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  EncodeFixed64(cache_key_buffer + 8, handle.offset());
+  Slice cache_key(cache_key_buffer, sizeof(cache_key_buffer));
+  void (*deleter)(const Slice&, void*) = [](const Slice& key, void* value) {
+    delete reinterpret_cast<Filter*>(value);
+  };
+  Cache* block_cache = rep_->options.block_cache;
+  if (rep_->options.cache_filter_blocks) {
+    return block_cache->InsertHighPriority(cache_key, filter, filter->size,
+                                           deleter);
+  }
+  return block_cache->Insert(cache_key, filter, filter->size, deleter);
+}
+
+Cache::Handle* Table::LookupFilter(const ReadOptions& options,
+                                   const BlockHandle& handle,
+                                   FilterFormat format,
+                                   Filter** uncached) const {
+  *uncached = nullptr;
+  Cache* block_cache = rep_->options.block_cache;
+  if (block_cache != nullptr) {
+    char cache_key_buffer[16];
+    EncodeFixed64(cache_key_buffer, rep_->cache_id);
+    EncodeFixed64(cache_key_buffer + 8, handle.offset());
+    Slice cache_key(cache_key_buffer, sizeof(cache_key_buffer));
+    Cache::Handle* cache_handle = block_cache->Lookup(cache_key);
+    if (cache_handle != nullptr) {
+      return cache_handle;
+    }
+  }
+
+  bool cachable;
+  Filter* filter = ReadFilter(options, handle, format, &cachable);
+  if (filter == nullptr) {
+    return nullptr;
+  }
+  if (block_cache == nullptr || !cachable || !options.fill_cache) {
+    *uncached = filter;
+    return nullptr;
+  }
+  return InsertFilter(handle, filter);
+}
+
+bool Table::FilterPartitionMayMatch(const ReadOptions& options,
+                                    const BlockHandle& partition,
+                                    const Slice& key, const Slice* limit) {
+  Cache* block_cache = rep_->options.block_cache;
+  Filter* uncached;
+  Cache::Handle* cache_handle =
+      LookupFilter(options, partition, kFullFilter, &uncached);
+  Filter* filter =
+      cache_handle != nullptr
+          ? reinterpret_cast<Filter*>(block_cache->Value(cache_handle))
+          : uncached;
+  if (filter == nullptr) {
+    return true;  // Errors are treated as potential matches
+  }
+  bool may_match = limit != nullptr ? filter->full->RangeMayMatch(key, *limit)
+                                    : filter->full->KeyMayMatch(key);
+  if (cache_handle != nullptr) {
+    block_cache->Release(cache_handle);
+  }
+  delete uncached;
+  return may_match;
+}
+
+const Table::Filter* Table::AcquireFilter(const ReadOptions& options,
+                                          Cache::Handle** handle,
+                                          Filter** uncached) {
+  *handle = nullptr;
+  *uncached = nullptr;
+  if (!rep_->cache_filter) {
+    return rep_->filter;
+  }
+  Cache* block_cache = rep_->options.block_cache;
+  Cache::Handle* pinned = rep_->pinned_filter.load(std::memory_order_acquire);
+  if (pinned != nullptr) {
+    return reinterpret_cast<Filter*>(block_cache->Value(pinned));
+  }
+  *handle = LookupFilter(options, rep_->filter_handle, rep_->filter_format,
+                         uncached);
+  return *handle != nullptr
+             ? reinterpret_cast<Filter*>(block_cache->Value(*handle))
+             : *uncached;
+}
+
+void Table::ReleaseFilter(Cache::Handle* handle, Filter* uncached) {
+  if (handle != nullptr) {
+    rep_->options.block_cache->Release(handle);
+  }
+  delete uncached;
+}
+
+bool Table::BlockRangeMayMatch(const ReadOptions& options, const Filter* filter,
+                               uint64_t block_offset, const Slice& start,
+                               const Slice& limit) {
+  BlockHandle partition;
+  if (filter->full != nullptr) {
+    return filter->full->RangeMayMatch(start, limit);
+  } else if (filter->blocks != nullptr) {
+    return filter->blocks->RangeMayMatch(block_offset, start, limit);
+  } else if (filter->partitions != nullptr &&
+             filter->partitions->FindPartition(block_offset, &partition)) {
+    return FilterPartitionMayMatch(options, partition, start, &limit);
+  }
+  return true;
+}
+
+bool Table::RangeMayMatch(const ReadOptions& options, const Slice& start,
+                          const Slice& limit) {
+  Cache::Handle* filter_handle;
+  Filter* uncached_filter;
+  const Filter* filter = AcquireFilter(options, &filter_handle, &uncached_filter);
+  bool may_match = true;
+  if (filter != nullptr && filter->full != nullptr) {
+    may_match = filter->full->RangeMayMatch(start, limit);
+  } else if (filter != nullptr) {
+    // Probe the data blocks that may hold keys in [start,limit).  The index
+    // block is in memory, only the blocks themselves are worth skipping.
+    Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+    may_match = false;
+    for (iiter->Seek(start); iiter->Valid() && !may_match; iiter->Next()) {
+      Slice handle_value = iiter->value();
+      BlockHandle handle;
+      may_match = !handle.DecodeFrom(&handle_value).ok() ||
+                  BlockRangeMayMatch(options, filter, handle.offset(), start,
+                                     limit);
+      if (rep_->options.comparator->Compare(iiter->key(), limit) >= 0) {
+        break;  // Later blocks hold keys past limit only
+      }
+    }
+    if (!iiter->status().ok()) {
+      may_match = true;
+    }
+    delete iiter;
+  }
+  ReleaseFilter(filter_handle, uncached_filter);
+  return may_match;
+}
+
+bool Table::BlockRangeFilter(void* arg, const ReadOptions& options,
+                             const Slice& index_value, const Slice& start,
+                             const Slice& limit) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  Slice input = index_value;
+  BlockHandle handle;
+  if (!handle.DecodeFrom(&input).ok()) {
+    return true;  // Leave the error to the block read
+  }
+  Cache::Handle* filter_handle;
+  Filter* uncached_filter;
+  const Filter* filter =
+      table->AcquireFilter(options, &filter_handle, &uncached_filter);
+  const bool may_match =
+      filter == nullptr || table->BlockRangeMayMatch(options, filter,
+                                                     handle.offset(), start,
+                                                     limit);
+  table->ReleaseFilter(filter_handle, uncached_filter);
+  return may_match;
+}
+
+void Table::PinFilter() {
+  if (!rep_->cache_filter ||
+      rep_->pin_requested.load(std::memory_order_relaxed) ||
+      rep_->pin_requested.exchange(true)) {
     return;
   }
-  if (block.heap_allocated) {
-    rep_->filter_data = block.data.data();  // Will need to delete later
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
+  Filter* uncached;
+  Cache::Handle* cache_handle =
+      LookupFilter(opt, rep_->filter_handle, rep_->filter_format, &uncached);
+  delete uncached;  // Only cached blocks can be pinned
+  rep_->pinned_filter.store(cache_handle, std::memory_order_release);
+}
+
+size_t Table::FilterMemoryUsage() const {
+  return rep_->filter != nullptr ? rep_->filter->size : 0;
 }
 
 Table::~Table() { delete rep_; }
@@ -211,41 +520,91 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
 Iterator* Table::NewIterator(const ReadOptions& options) const {
   return NewTwoLevelIterator(
       rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+      &Table::BlockReader, const_cast<Table*>(this), options,
+      rep_->filter_policy != nullptr ? &Table::BlockRangeFilter : nullptr,
+      rep_->options.comparator);
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
                                                 const Slice&)) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
-  iiter->Seek(k);
-  if (iiter->Valid()) {
+  InternalMultiGet(options, 1, &k, &arg, handle_result, &s);
+  return s;
+}
+
+void Table::InternalMultiGet(const ReadOptions& options, int n,
+                             const Slice* keys, void* const* args,
+                             void (*handle_result)(void*, const Slice&,
+                                                   const Slice&),
+                             Status* statuses) {
+  Cache::Handle* filter_handle;
+  Filter* uncached_filter;
+  const Filter* filter = AcquireFilter(options, &filter_handle, &uncached_filter);
+
+  // A full filter is probed for the whole batch up front, which lets the
+  // policy overlap the cache misses of different keys.
+  std::unique_ptr<bool[]> may_match;
+  if (filter != nullptr && filter->full != nullptr && n > 1) {
+    may_match.reset(new bool[n]);
+    filter->full->KeysMayMatch(keys, n, may_match.get());
+  }
+
+  Iterator* iiter = nullptr;
+  // Data block of the previous key, kept for the next one
+  Iterator* block_iter = nullptr;
+  uint64_t block_offset = 0;
+  for (int i = 0; i < n; i++) {
+    const Slice& k = keys[i];
+    statuses[i] = Status::OK();
+    if (filter != nullptr && filter->full != nullptr &&
+        !(may_match != nullptr ? may_match[i]
+                               : filter->full->KeyMayMatch(k))) {
+      continue;  // Not found, and no need to search the index block
+    }
+    if (iiter == nullptr) {
+      iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+    }
+    iiter->Seek(k);
+    if (!iiter->Valid()) {
+      statuses[i] = iiter->status();
+      continue;
+    }
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
-    if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
-        !filter->KeyMayMatch(handle.offset(), k)) {
-      // Not found
-    } else {
-
-//      std::chrono::microseconds  timespan(5); // or whatever
-//      std::this_thread::sleep_for(timespan);
+    BlockHandle partition;
+    const bool decoded = handle.DecodeFrom(&handle_value).ok();
+    if (!decoded) {
+      // Leave the error to the block read
+    } else if (filter != nullptr && filter->blocks != nullptr &&
+               !filter->blocks->KeyMayMatch(handle.offset(), k)) {
+      continue;  // Not found
+    } else if (filter != nullptr && filter->partitions != nullptr &&
+               filter->partitions->FindPartition(handle.offset(),
+                                                 &partition) &&
+               !FilterPartitionMayMatch(options, partition, k)) {
+      continue;  // Not found
+    }
 
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
-      block_iter->Seek(k);
-      if (block_iter->Valid()) {
-        (*handle_result)(arg, block_iter->key(), block_iter->value());
-      }
-      s = block_iter->status();
+    if (block_iter == nullptr || !decoded || handle.offset() != block_offset ||
+        !block_iter->status().ok()) {
       delete block_iter;
+      block_iter = BlockReader(this, options, iiter->value());
+      block_offset = handle.offset();
+    }
+    block_iter->Seek(k);
+    if (block_iter->Valid()) {
+      (*handle_result)(args[i], block_iter->key(), block_iter->value());
+    }
+    statuses[i] = block_iter->status();
+    if (statuses[i].ok()) {
+      statuses[i] = iiter->status();
     }
   }
-  if (s.ok()) {
-    s = iiter->status();
-  }
+  delete block_iter;
   delete iiter;
-  return s;
+
+  ReleaseFilter(filter_handle, uncached_filter);
 }
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
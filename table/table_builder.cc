@@ -12,6 +12,7 @@
 #include "leveldb/options.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
+#include "table/filter_build_pool.h"
 #include "table/format.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
@@ -28,9 +29,24 @@ struct TableBuilder::Rep {
         index_block(&index_block_options),
         num_entries(0),
         closed(false),
-        filter_block(opt.filter_policy == nullptr
+        filter_pool(opt.filter_policy == nullptr || opt.full_filter ||
+                            opt.filter_partition_keys <= 0 ||
+                            opt.filter_build_threads <= 0
+                        ? nullptr
+                        : new FilterBuildPool(opt.env, opt.filter_build_threads)),
+        filter_block(opt.filter_policy == nullptr ||
+                             (!opt.full_filter && opt.filter_partition_keys > 0)
                          ? nullptr
-                         : new FilterBlockBuilder(opt.filter_policy)),
+                         : new FilterBlockBuilder(opt.filter_policy,
+                                                  opt.full_filter)),
+        full_filter(opt.full_filter),
+        filter_partitions(opt.filter_policy == nullptr || opt.full_filter ||
+                                  opt.filter_partition_keys <= 0
+                              ? nullptr
+                              : new PartitionedFilterBlockBuilder(
+                                    opt.filter_policy,
+                                    opt.filter_partition_keys, filter_pool)),
+        filter_block_size(0),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
   }
@@ -45,7 +61,10 @@ struct TableBuilder::Rep {
   std::string last_key;
   int64_t num_entries;
   bool closed;  // Either Finish() or Abandon() has been called.
+  FilterBuildPool* filter_pool;  // Builds filter_partitions, if not null
   FilterBlockBuilder* filter_block;
+  const bool full_filter;  // filter_block builds a full filter
+  PartitionedFilterBlockBuilder* filter_partitions;  // Instead of filter_block
   uint64_t filter_block_size;
 
   // We do not emit the index entry for a block until we have seen the
@@ -68,11 +87,16 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
   if (rep_->filter_block != nullptr) {
     rep_->filter_block->StartBlock(0);
   }
+  if (rep_->filter_partitions != nullptr) {
+    rep_->filter_partitions->StartBlock(0);
+  }
 }
 
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->filter_partitions;  // Waits for the partitions it scheduled
+  delete rep_->filter_pool;
   delete rep_;
 }
 
@@ -112,6 +136,9 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   if (r->filter_block != nullptr) {
     r->filter_block->AddKey(key);
   }
+  if (r->filter_partitions != nullptr) {
+    r->filter_partitions->AddKey(key);
+  }
 
   r->last_key.assign(key.data(), key.size());
   r->num_entries++;
@@ -137,6 +164,32 @@ void TableBuilder::Flush() {
   if (r->filter_block != nullptr) {
     r->filter_block->StartBlock(r->offset);
   }
+  if (r->filter_partitions != nullptr) {
+    // Partitions end at data block boundaries, so a data block is covered
+    // by exactly one of them.
+    if (ok() && r->filter_partitions->PartitionFull()) {
+      EndFilterPartition();
+    }
+    r->filter_partitions->StartBlock(r->offset);
+  }
+}
+
+void TableBuilder::EndFilterPartition() {
+  Rep* r = rep_;
+  if (r->filter_pool != nullptr) {
+    // Built while the next data blocks are written, and written after them
+    r->filter_partitions->SchedulePartition();
+    return;
+  }
+  WriteFilterPartition(r->filter_partitions->FinishPartition());
+}
+
+void TableBuilder::WriteFilterPartition(const Slice& filter) {
+  Rep* r = rep_;
+  BlockHandle handle;
+  WriteRawBlock(filter, kNoCompression, &handle);
+  r->filter_partitions->AddPartition(handle);
+  r->filter_block_size += handle.size();
 }
 
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
@@ -212,12 +265,32 @@ Status TableBuilder::Finish() {
     r->filter_block_size = filter_block_handle.size();
   }
 
+  // Write the last filter partition and the partition index
+  if (ok() && r->filter_partitions != nullptr) {
+    if (!r->filter_partitions->PartitionEmpty()) {
+      EndFilterPartition();
+    }
+    while (ok() && r->filter_partitions->HasScheduledPartition()) {
+      WriteFilterPartition(r->filter_partitions->FinishScheduledPartition());
+    }
+    if (ok()) {
+      WriteRawBlock(r->filter_partitions->Finish(), kNoCompression,
+                    &filter_block_handle);
+      r->filter_block_size += filter_block_handle.size();
+    }
+  }
+
   // Write metaindex block
   if (ok()) {
     BlockBuilder meta_index_block(&r->options);
-    if (r->filter_block != nullptr) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
+    if (r->filter_block != nullptr || r->filter_partitions != nullptr) {
+      // Add mapping from "filter.Name" (or "fullfilter.Name", or
+      // "partitionedfilter.Name" for the partition index) to location of
+      // filter data
+      std::string key = r->full_filter ? "fullfilter."
+                        : r->filter_partitions != nullptr
+                            ? "partitionedfilter."
+                            : "filter.";
       key.append(r->options.filter_policy->Name());
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
@@ -266,7 +339,7 @@ uint64_t TableBuilder::NumEntries() const { return rep_->num_entries; }
 uint64_t TableBuilder::FileSize() const { return rep_->offset; }
 
 uint64_t TableBuilder::FilterSize() const {
-  if (rep_->filter_block != nullptr) {
+  if (rep_->filter_block != nullptr || rep_->filter_partitions != nullptr) {
     return rep_->filter_block_size;
   } else {
     return 0;
@@ -4,6 +4,7 @@
 
 #include "table/two_level_iterator.h"
 
+#include "leveldb/comparator.h"
 #include "leveldb/table.h"
 #include "table/block.h"
 #include "table/format.h"
@@ -14,15 +15,19 @@ namespace leveldb {
 namespace {
 
 typedef Iterator* (*BlockFunction)(void*, const ReadOptions&, const Slice&);
+typedef bool (*RangeFunction)(void*, const ReadOptions&, const Slice&,
+                              const Slice&, const Slice&);
 
 class TwoLevelIterator : public Iterator {
  public:
   TwoLevelIterator(Iterator* index_iter, BlockFunction block_function,
-                   void* arg, const ReadOptions& options);
+                   void* arg, const ReadOptions& options,
+                   RangeFunction range_function, const Comparator* comparator);
 
   ~TwoLevelIterator() override;
 
   void Seek(const Slice& target) override;
+  void SeekWithin(const Slice& target, const Slice& limit) override;
   void SeekToFirst() override;
   void SeekToLast() override;
   void Next() override;
@@ -60,6 +65,8 @@ class TwoLevelIterator : public Iterator {
   BlockFunction block_function_;
   void* arg_;
   const ReadOptions options_;
+  RangeFunction range_function_;   // May be nullptr
+  const Comparator* comparator_;  // Orders index keys, with range_function_
   Status status_;
   IteratorWrapper index_iter_;
   IteratorWrapper data_iter_;  // May be nullptr
@@ -70,10 +77,14 @@ class TwoLevelIterator : public Iterator {
 
 TwoLevelIterator::TwoLevelIterator(Iterator* index_iter,
                                    BlockFunction block_function, void* arg,
-                                   const ReadOptions& options)
+                                   const ReadOptions& options,
+                                   RangeFunction range_function,
+                                   const Comparator* comparator)
     : block_function_(block_function),
       arg_(arg),
       options_(options),
+      range_function_(range_function),
+      comparator_(comparator),
       index_iter_(index_iter),
       data_iter_(nullptr) {}
 
@@ -86,6 +97,28 @@ void TwoLevelIterator::Seek(const Slice& target) {
   SkipEmptyDataBlocksForward();
 }
 
+void TwoLevelIterator::SeekWithin(const Slice& target, const Slice& limit) {
+  if (range_function_ == nullptr) {
+    Seek(target);
+    return;
+  }
+  index_iter_.Seek(target);
+  while (index_iter_.Valid()) {
+    if ((*range_function_)(arg_, options_, index_iter_.value(), target,
+                           limit)) {
+      InitDataBlock();
+      // Blocks after the first one hold keys past target only, so this is
+      // SeekToFirst() for them.
+      if (data_iter_.iter() != nullptr) data_iter_.SeekWithin(target, limit);
+      if (data_iter_.Valid()) return;
+    }
+    // The next blocks hold keys past this index key only.
+    if (comparator_->Compare(index_iter_.key(), limit) >= 0) break;
+    index_iter_.Next();
+  }
+  SetDataIterator(nullptr);
+}
+
 void TwoLevelIterator::SeekToFirst() {
   index_iter_.SeekToFirst();
   InitDataBlock();
@@ -164,8 +197,11 @@ void TwoLevelIterator::InitDataBlock() {
 
 Iterator* NewTwoLevelIterator(Iterator* index_iter,
                               BlockFunction block_function, void* arg,
-                              const ReadOptions& options) {
-  return new TwoLevelIterator(index_iter, block_function, arg, options);
+                              const ReadOptions& options,
+                              RangeFunction range_function,
+                              const Comparator* comparator) {
+  return new TwoLevelIterator(index_iter, block_function, arg, options,
+                              range_function, comparator);
 }
 
 }  // namespace leveldb
@@ -9,6 +9,7 @@
 
 namespace leveldb {
 
+class Comparator;
 struct ReadOptions;
 
 // Return a new two level iterator.  A two-level iterator contains an
@@ -20,11 +21,22 @@ struct ReadOptions;
 //
 // Uses a supplied function to convert an index_iter value into
 // an iterator over the contents of the corresponding block.
+//
+// If range_function is non-null, SeekWithin(target, limit) skips the blocks
+// for which (*range_function)(arg, options, index_value, target, limit)
+// returns false, i.e. that hold no key in [target,limit), without reading
+// them.  It gives up at the first block whose index key is at or past limit
+// according to *comparator, since the blocks after it hold no keys before
+// limit.
 Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     Iterator* (*block_function)(void* arg, const ReadOptions& options,
                                 const Slice& index_value),
-    void* arg, const ReadOptions& options);
+    void* arg, const ReadOptions& options,
+    bool (*range_function)(void* arg, const ReadOptions& options,
+                           const Slice& index_value, const Slice& start,
+                           const Slice& limit) = nullptr,
+    const Comparator* comparator = nullptr);
 
 }  // namespace leveldb
 
@@ -49,6 +49,7 @@ struct LRUHandle {
   size_t charge;  // TODO(opt): Only allow uint32_t?
   size_t key_length;
   bool in_cache;     // Whether entry is in the cache.
+  bool high_pri;     // Whether entry belongs to the high priority pool.
   uint32_t refs;     // References, including cache reference, if present.
   uint32_t hash;     // Hash of key(); used for fast sharding and comparisons
   char key_data[1];  // Beginning of key
@@ -154,12 +155,16 @@ class LRUCache {
   ~LRUCache();
 
   // Separate from constructor so caller can easily make an array of LRUCache
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  void SetCapacity(size_t capacity, size_t high_pri_capacity) {
+    capacity_ = capacity;
+    high_pri_capacity_ = high_pri_capacity;
+  }
 
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
                         size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        bool high_pri);
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
@@ -168,6 +173,10 @@ class LRUCache {
     MutexLock l(&mutex_);
     return usage_;
   }
+  size_t HighPriorityCharge() const {
+    MutexLock l(&mutex_);
+    return high_pri_usage_;
+  }
 
  private:
   void LRU_Remove(LRUHandle* e);
@@ -175,19 +184,25 @@ class LRUCache {
   void Ref(LRUHandle* e);
   void Unref(LRUHandle* e);
   bool FinishErase(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  LRUHandle* NextToEvict() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   // Initialized before use.
   size_t capacity_;
+  size_t high_pri_capacity_;
 
   // mutex_ protects the following state.
   mutable port::Mutex mutex_;
   size_t usage_ GUARDED_BY(mutex_);
+  size_t high_pri_usage_ GUARDED_BY(mutex_);
 
   // Dummy head of LRU list.
   // lru.prev is newest entry, lru.next is oldest entry.
-  // Entries have refs==1 and in_cache==true.
+  // Entries have refs==1, in_cache==true and high_pri==false.
   LRUHandle lru_ GUARDED_BY(mutex_);
 
+  // Dummy head of high priority LRU list, like lru_ for high_pri==true.
+  LRUHandle high_pri_lru_ GUARDED_BY(mutex_);
+
   // Dummy head of in-use list.
   // Entries are in use by clients, and have refs >= 2 and in_cache==true.
   LRUHandle in_use_ GUARDED_BY(mutex_);
@@ -195,28 +210,33 @@ class LRUCache {
   HandleTable table_ GUARDED_BY(mutex_);
 };
 
-LRUCache::LRUCache() : capacity_(0), usage_(0) {
+LRUCache::LRUCache()
+    : capacity_(0), high_pri_capacity_(0), usage_(0), high_pri_usage_(0) {
   // Make empty circular linked lists.
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  high_pri_lru_.next = &high_pri_lru_;
+  high_pri_lru_.prev = &high_pri_lru_;
   in_use_.next = &in_use_;
   in_use_.prev = &in_use_;
 }
 
 LRUCache::~LRUCache() {
   assert(in_use_.next == &in_use_);  // Error if caller has an unreleased handle
-  for (LRUHandle* e = lru_.next; e != &lru_;) {
-    LRUHandle* next = e->next;
-    assert(e->in_cache);
-    e->in_cache = false;
-    assert(e->refs == 1);  // Invariant of lru_ list.
-    Unref(e);
-    e = next;
+  for (LRUHandle* list : {&lru_, &high_pri_lru_}) {
+    for (LRUHandle* e = list->next; e != list;) {
+      LRUHandle* next = e->next;
+      assert(e->in_cache);
+      e->in_cache = false;
+      assert(e->refs == 1);  // Invariant of lru_ lists.
+      Unref(e);
+      e = next;
+    }
   }
 }
 
 void LRUCache::Ref(LRUHandle* e) {
-  if (e->refs == 1 && e->in_cache) {  // If on lru_ list, move to in_use_ list.
+  if (e->refs == 1 && e->in_cache) {  // If on an lru_ list, move to in_use_.
     LRU_Remove(e);
     LRU_Append(&in_use_, e);
   }
@@ -231,9 +251,9 @@ void LRUCache::Unref(LRUHandle* e) {
     (*e->deleter)(e->key(), e->value);
     free(e);
   } else if (e->in_cache && e->refs == 1) {
-    // No longer in use; move to lru_ list.
+    // No longer in use; move to its lru_ list.
     LRU_Remove(e);
-    LRU_Append(&lru_, e);
+    LRU_Append(e->high_pri ? &high_pri_lru_ : &lru_, e);
   }
 }
 
@@ -267,7 +287,8 @@ void LRUCache::Release(Cache::Handle* handle) {
 Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
                                 size_t charge,
                                 void (*deleter)(const Slice& key,
-                                                void* value)) {
+                                                void* value),
+                                bool high_pri) {
   MutexLock l(&mutex_);
 
   LRUHandle* e =
@@ -278,6 +299,7 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
   e->key_length = key.size();
   e->hash = hash;
   e->in_cache = false;
+  e->high_pri = high_pri;
   e->refs = 1;  // for the returned handle.
   std::memcpy(e->key_data, key.data(), key.size());
 
@@ -286,13 +308,16 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
     e->in_cache = true;
     LRU_Append(&in_use_, e);
     usage_ += charge;
+    if (high_pri) {
+      high_pri_usage_ += charge;
+    }
     FinishErase(table_.Insert(e));
   } else {  // don't cache. (capacity_==0 is supported and turns off caching.)
     // next is read by key() in an assert, so it must be initialized
     e->next = nullptr;
   }
-  while (usage_ > capacity_ && lru_.next != &lru_) {
-    LRUHandle* old = lru_.next;
+  LRUHandle* old;
+  while (usage_ > capacity_ && (old = NextToEvict()) != nullptr) {
     assert(old->refs == 1);
     bool erased = FinishErase(table_.Remove(old->key(), old->hash));
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
@@ -311,11 +336,26 @@ bool LRUCache::FinishErase(LRUHandle* e) {
     LRU_Remove(e);
     e->in_cache = false;
     usage_ -= e->charge;
+    if (e->high_pri) {
+      high_pri_usage_ -= e->charge;
+    }
     Unref(e);
   }
   return e != nullptr;
 }
 
+// Returns the oldest entry of the high priority pool if the pool has
+// outgrown its capacity or nothing else is left, else the oldest normal
+// entry.  Returns nullptr if all entries are in use.
+LRUHandle* LRUCache::NextToEvict() {
+  const bool have_low = lru_.next != &lru_;
+  const bool have_high = high_pri_lru_.next != &high_pri_lru_;
+  if (have_high && (!have_low || high_pri_usage_ > high_pri_capacity_)) {
+    return high_pri_lru_.next;
+  }
+  return have_low ? lru_.next : nullptr;
+}
+
 void LRUCache::Erase(const Slice& key, uint32_t hash) {
   MutexLock l(&mutex_);
   FinishErase(table_.Remove(key, hash));
@@ -323,8 +363,8 @@ void LRUCache::Erase(const Slice& key, uint32_t hash) {
 
 void LRUCache::Prune() {
   MutexLock l(&mutex_);
-  while (lru_.next != &lru_) {
-    LRUHandle* e = lru_.next;
+  LRUHandle* e;
+  while ((e = NextToEvict()) != nullptr) {
     assert(e->refs == 1);
     bool erased = FinishErase(table_.Remove(e->key(), e->hash));
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
@@ -349,17 +389,27 @@ class ShardedLRUCache : public Cache {
   static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
 
  public:
-  explicit ShardedLRUCache(size_t capacity) : last_id_(0) {
+  ShardedLRUCache(size_t capacity, double high_pri_pool_ratio)
+      : last_id_(0) {
     const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
     for (int s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
+      shard_[s].SetCapacity(per_shard,
+                            static_cast<size_t>(per_shard * high_pri_pool_ratio));
     }
   }
   ~ShardedLRUCache() override {}
   Handle* Insert(const Slice& key, void* value, size_t charge,
                  void (*deleter)(const Slice& key, void* value)) override {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      false);
+  }
+  Handle* InsertHighPriority(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key,
+                                             void* value)) override {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      true);
   }
   Handle* Lookup(const Slice& key) override {
     const uint32_t hash = HashSlice(key);
@@ -392,10 +442,23 @@ class ShardedLRUCache : public Cache {
     }
     return total;
   }
+  size_t HighPriorityCharge() const override {
+    size_t total = 0;
+    for (int s = 0; s < kNumShards; s++) {
+      total += shard_[s].HighPriorityCharge();
+    }
+    return total;
+  }
 };
 
 }  // end anonymous namespace
 
-Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
+Cache* NewLRUCache(size_t capacity) {
+  return new ShardedLRUCache(capacity, 0.5);
+}
+
+Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio) {
+  return new ShardedLRUCache(capacity, high_pri_pool_ratio);
+}
 
 }  // namespace leveldb
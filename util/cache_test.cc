@@ -59,6 +59,12 @@ class CacheTest : public testing::Test {
                           &CacheTest::Deleter);
   }
 
+  void InsertHighPriority(int key, int value, int charge = 1) {
+    cache_->Release(cache_->InsertHighPriority(EncodeKey(key),
+                                               EncodeValue(value), charge,
+                                               &CacheTest::Deleter));
+  }
+
   void Erase(int key) { cache_->Erase(EncodeKey(key)); }
   static CacheTest* current_;
 };
@@ -213,6 +219,34 @@ TEST_F(CacheTest, Prune) {
   ASSERT_EQ(-1, Lookup(2));
 }
 
+TEST_F(CacheTest, HighPriorityEntries) {
+  InsertHighPriority(1, 100);
+  ASSERT_EQ(1, cache_->HighPriorityCharge());
+
+  // Normal entries are evicted ahead of high priority ones
+  for (int i = 0; i < kCacheSize + 100; i++) {
+    Insert(1000 + i, 2000 + i);
+  }
+  ASSERT_EQ(100, Lookup(1));
+  ASSERT_EQ(1, cache_->HighPriorityCharge());
+
+  Erase(1);
+  ASSERT_EQ(-1, Lookup(1));
+  ASSERT_EQ(0, cache_->HighPriorityCharge());
+}
+
+TEST_F(CacheTest, HighPriorityPoolIsBounded) {
+  // Once the pool outgrows its share of the cache, high priority entries
+  // are evicted ahead of normal ones
+  Insert(1, 100);
+  for (int i = 0; i < kCacheSize + 100; i++) {
+    InsertHighPriority(1000 + i, 2000 + i);
+  }
+  ASSERT_EQ(100, Lookup(1));
+  ASSERT_EQ(-1, Lookup(1000));
+  ASSERT_EQ(2000 + kCacheSize + 99, Lookup(1000 + kCacheSize + 99));
+}
+
 TEST_F(CacheTest, ZeroSizeCache) {
   delete cache_;
   cache_ = NewLRUCache(0);
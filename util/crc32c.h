@@ -16,6 +16,13 @@ namespace crc32c {
 // crc32c of a stream of data.
 uint32_t Extend(uint32_t init_crc, const char* data, size_t n);
 
+// The implementations Extend() chooses from, exposed for testing.
+// ExtendPortable() is table driven.  ExtendSse42() uses the SSE4.2 crc32
+// instruction and may only be called when Sse42Available() is true.
+uint32_t ExtendPortable(uint32_t init_crc, const char* data, size_t n);
+bool Sse42Available();
+uint32_t ExtendSse42(uint32_t init_crc, const char* data, size_t n);
+
 // Return the crc32c of data[0,n-1]
 inline uint32_t Value(const char* data, size_t n) { return Extend(0, data, n); }
 
@@ -44,6 +44,25 @@ TEST(CRC, Extend) {
   ASSERT_EQ(Value("hello world", 11), Extend(Value("hello ", 6), "world", 5));
 }
 
+TEST(CRC, Sse42MatchesPortable) {
+  if (!Sse42Available()) {
+    GTEST_SKIP() << "CPU lacks SSE4.2";
+  }
+  // Cover the unaligned head, the 8-byte words and the tail at every
+  // alignment.
+  char buf[600 + 16];
+  for (size_t i = 0; i < sizeof(buf); i++) {
+    buf[i] = static_cast<char>(i * 7 + 3);
+  }
+  for (size_t offset = 0; offset < 16; offset++) {
+    for (size_t n = 0; n < 600; n++) {
+      ASSERT_EQ(ExtendPortable(0x12345678, buf + offset, n),
+                ExtendSse42(0x12345678, buf + offset, n))
+          << "offset " << offset << ", length " << n;
+    }
+  }
+}
+
 TEST(CRC, Mask) {
   uint32_t crc = Value("foo", 3);
   ASSERT_NE(crc, Mask(crc));
@@ -0,0 +1,348 @@
+//
+// 4-wise binary fuse filter adapter, after
+// fastfilter_cpp/src/xorfilter/4wise_xor_binary_fuse_filter_lowmem.h.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+
+#include "util/coding.h"
+#include "util/filter_adapters/FilterEncoding.h"
+#include "util/filter_adapters/FilterKeyHash.h"
+#include "util/filter_adapters/FilterProbeBatch.h"
+
+#include "fastfilter_cpp/src/xorfilter/binaryfusefilter_singleheader.h"
+
+namespace leveldb {
+
+namespace {
+
+// A key is stored as the xor of the fingerprints in four slots, one in each
+// of four consecutive segments.  With four slots per key the array only
+// needs ~1.075 slots per key for large filters, against ~1.125 for the
+// 3-wise BinaryFuseFilterPolicy, at the cost of one more memory access per
+// probe.
+//
+// The library class draws its seed from std::random_device and keeps its
+// parameters in native size_t fields, so the construction is reimplemented
+// here: it uses the library's low-memory peeling (one byte of counter and
+// one xor of hashes per slot, no per-slot key lists) and writes the
+// fingerprints straight into the filter block.
+//
+// Filter layout, after the common adapter header (FilterEncoding.h):
+//    Seed                : fixed64
+//    SegmentLength       : fixed32 (power of two)
+//    SegmentCountLength  : fixed32
+//    ArrayLength         : fixed32
+//    Fingerprints        : ArrayLength little-endian 8 or 16 bit values
+template <typename FingerprintType>
+class BinaryFuse4WiseFilterPolicy : public FilterPolicy {
+ public:
+  static constexpr int kArity = 4;
+  static constexpr uint32_t kMaxSegmentLength = 1 << 18;
+  static constexpr int kMaxIterations = 100;
+  static constexpr size_t kHeaderSize = sizeof(uint64_t) + 3 * sizeof(uint32_t);
+  static constexpr size_t kFingerprintSize = sizeof(FingerprintType);
+  static constexpr FilterType kType =
+      kFingerprintSize == 2 ? kBinaryFuse4Wise16Filter : kBinaryFuse4Wise8Filter;
+
+  struct Params {
+    uint64_t seed;
+    uint32_t segment_length;
+    uint32_t segment_count_length;
+    uint32_t array_length;
+  };
+
+  static uint64_t keyHash(const leveldb::Slice& key) {
+    return FilterKeyHash(key);
+  }
+
+  const char* Name() const override {
+    return kFingerprintSize == 2 ? "BinaryFuse4WiseFilterPolicy16"
+                                 : "BinaryFuse4WiseFilterPolicy8";
+  }
+
+  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
+    std::vector<uint64_t> hashes;
+    FilterKeyHashes(keys, n, &hashes);
+    CreateFilterFromHashes(hashes.data(), n, dst);
+  }
+
+  bool HashesKeys() const override { return true; }
+
+  uint64_t KeyHash(const leveldb::Slice& key) const override { return keyHash(key); }
+
+  void CreateFilterFromHashes(const uint64_t* hashes, int n, std::string* dst) const override {
+    if (n <= 0) return;
+
+    Params params = Allocate(n);
+    PutFilterHeader(dst, kType);
+    const size_t header_end = dst->size() + kHeaderSize;
+    dst->resize(header_end + kFingerprintSize * size_t{params.array_length});
+    char* fingerprints = &(*dst)[header_end];
+
+    Populate(hashes, n, &params, fingerprints);
+
+    char* p = &(*dst)[header_end - kHeaderSize];
+    EncodeFixed64(p, params.seed);
+    EncodeFixed32(p + 8, params.segment_length);
+    EncodeFixed32(p + 12, params.segment_count_length);
+    EncodeFixed32(p + 16, params.array_length);
+  }
+
+  bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override {
+    bool result;
+    KeysMayMatch(&key, 1, filter, &result);
+    return result;
+  }
+
+  void KeysMayMatch(const leveldb::Slice* keys, int n, const leveldb::Slice& filter,
+                    bool* results) const override {
+    if (filter.empty()) {
+      std::fill(results, results + n, false);
+      return;
+    }
+
+    Params params;
+    const char* fingerprints;
+    if (!Decode(filter, &params, &fingerprints)) {
+      std::fill(results, results + n, true);  // Errors are treated as potential matches
+      return;
+    }
+
+    BatchKeysMayMatch(
+        keys, n, results,
+        [&](uint64_t key) {
+          uint32_t h[kArity];
+          Slots(params, binary_fuse_murmur64(key + params.seed), h);
+          for (int i = 0; i < kArity; i++) {
+            PrefetchFilterLine(fingerprints + h[i] * kFingerprintSize);
+          }
+        },
+        [&](uint64_t key) {
+          const uint64_t hash = binary_fuse_murmur64(key + params.seed);
+          uint32_t h[kArity];
+          Slots(params, hash, h);
+          FingerprintType f = Fingerprint(hash);
+          for (int i = 0; i < kArity; i++) {
+            f ^= Load(fingerprints, h[i]);
+          }
+          return f == 0;
+        });
+  }
+
+ private:
+  // The low bits of the hash also pick h[1], so fold in the high half like
+  // binary_fuse8_fingerprint() does.
+  static FingerprintType Fingerprint(uint64_t hash) {
+    return static_cast<FingerprintType>(hash ^ (hash >> 32));
+  }
+
+  // The slot of the key in each of its four segments: h[0] anywhere in the
+  // first SegmentCountLength slots, h[i] in the i-th segment after it at an
+  // offset taken from bits [16*(i-1), 16*(i-1)+18) of the hash.
+  static void Slots(const Params& params, uint64_t hash, uint32_t h[kArity]) {
+    const uint32_t mask = params.segment_length - 1;
+    h[0] = static_cast<uint32_t>(binary_fuse_mulhi(hash, params.segment_count_length));
+    for (int i = 1; i < kArity; i++) {
+      h[i] = (h[0] + i * params.segment_length) ^
+             (static_cast<uint32_t>(hash >> ((i - 1) * 16)) & mask);
+    }
+  }
+
+  static FingerprintType Load(const char* fingerprints, uint32_t index) {
+    FingerprintType f;
+    std::memcpy(&f, fingerprints + index * kFingerprintSize, kFingerprintSize);
+    return f;
+  }
+
+  static void Store(char* fingerprints, uint32_t index, FingerprintType f) {
+    std::memcpy(fingerprints + index * kFingerprintSize, &f, kFingerprintSize);
+  }
+
+  // Sizes the filter for n keys like binary_fuse8_allocate() does for arity
+  // 4, clamping the small sizes for which the library formulas break down.
+  static Params Allocate(uint32_t n) {
+    const double size = std::max(n, 2u);
+    const int log_segment_length = std::min(
+        18, std::max(0, static_cast<int>(std::floor(std::log(size) / std::log(2.91) - 0.5))));
+    Params params;
+    params.seed = 0;
+    params.segment_length = uint32_t{1} << log_segment_length;
+    const double size_factor =
+        std::max(1.075, 0.77 + 0.305 * std::log(600000.0) / std::log(size));
+    const uint32_t capacity = static_cast<uint32_t>(std::round(size * size_factor));
+    const uint32_t segments =
+        (capacity + params.segment_length - 1) / params.segment_length;
+    const uint32_t segment_count = segments > kArity ? segments - (kArity - 1) : 1;
+    params.segment_count_length = segment_count * params.segment_length;
+    params.array_length = (segment_count + kArity - 1) * params.segment_length;
+    return params;
+  }
+
+  // Picks a seed for which the keys peel and fills in the fingerprints
+  // (initially zero).  Duplicate hashes are dropped.
+  static void Populate(const uint64_t* keys, uint32_t size, Params* params,
+                       char* fingerprints) {
+    const uint32_t capacity = params->array_length;
+    std::unique_ptr<uint64_t[]> reverse_order(new uint64_t[size + 1]);
+    std::unique_ptr<uint8_t[]> reverse_h(new uint8_t[size]);
+    std::unique_ptr<uint8_t[]> t2count(new uint8_t[capacity]);
+    std::unique_ptr<uint64_t[]> t2hash(new uint64_t[capacity]);
+    std::unique_ptr<uint32_t[]> alone(new uint32_t[capacity]);
+
+    // Hashes are bucketed by their top bits, which orders them roughly by
+    // their first slot and keeps the counting pass cache friendly.
+    uint32_t block_bits = 1;
+    while ((uint32_t{1} << block_bits) < params->segment_count_length / params->segment_length) {
+      block_bits++;
+    }
+    const uint32_t block = uint32_t{1} << block_bits;
+    std::unique_ptr<uint32_t[]> start_pos(new uint32_t[block]);
+
+    uint64_t rng_counter = 0x726b2b9d438b9d4d;
+    uint32_t h[kArity];
+    uint32_t stack_size = 0;
+    for (int loop = 0;; loop++) {
+      if (loop == kMaxIterations) {
+        // Practically unreachable; a filter of ones matches every key.
+        std::memset(fingerprints, 0xff, capacity * kFingerprintSize);
+        return;
+      }
+      params->seed = binary_fuse_rng_splitmix64(&rng_counter);
+      std::fill(reverse_order.get(), reverse_order.get() + size, 0);
+      reverse_order[size] = 1;
+      std::fill(t2count.get(), t2count.get() + capacity, 0);
+      std::fill(t2hash.get(), t2hash.get() + capacity, 0);
+
+      for (uint32_t i = 0; i < block; i++) {
+        start_pos[i] = (uint64_t{i} * size) >> block_bits;
+      }
+      for (uint32_t i = 0; i < size; i++) {
+        const uint64_t hash = binary_fuse_murmur64(keys[i] + params->seed);
+        uint32_t segment_index = hash >> (64 - block_bits);
+        while (reverse_order[start_pos[segment_index]] != 0) {
+          segment_index = (segment_index + 1) & (block - 1);
+        }
+        reverse_order[start_pos[segment_index]] = hash;
+        start_pos[segment_index]++;
+      }
+
+      // The low two bits of t2count xor the indexes (0-3) of the key's slots
+      // that fall on the slot, the upper six count the keys on it.
+      bool error = false;
+      uint32_t duplicates = 0;
+      for (uint32_t i = 0; i < size; i++) {
+        const uint64_t hash = reverse_order[i];
+        Slots(*params, hash, h);
+        for (int j = 0; j < kArity; j++) {
+          t2count[h[j]] += 4;
+          t2count[h[j]] ^= j;
+          t2hash[h[j]] ^= hash;
+        }
+        // A second copy of a key cancels the first one's hash.
+        bool duplicate = false;
+        for (int j = 0; j < kArity; j++) {
+          duplicate |= t2hash[h[j]] == 0 && t2count[h[j]] == 8;
+        }
+        if (duplicate) {
+          duplicates++;
+          for (int j = 0; j < kArity; j++) {
+            t2count[h[j]] -= 4;
+            t2count[h[j]] ^= j;
+            t2hash[h[j]] ^= hash;
+          }
+        }
+        for (int j = 0; j < kArity; j++) {
+          error |= t2count[h[j]] < 4 || t2count[h[j]] >= 0x80;
+        }
+      }
+      if (error) continue;
+
+      uint32_t queue_size = 0;
+      for (uint32_t i = 0; i < capacity; i++) {
+        alone[queue_size] = i;
+        queue_size += (t2count[i] >> 2) == 1 ? 1 : 0;
+      }
+      stack_size = 0;
+      while (queue_size > 0) {
+        const uint32_t index = alone[--queue_size];
+        if ((t2count[index] >> 2) != 1) continue;
+
+        const uint64_t hash = t2hash[index];
+        const int found = t2count[index] & 3;
+        reverse_h[stack_size] = found;
+        reverse_order[stack_size] = hash;
+        stack_size++;
+
+        Slots(*params, hash, h);
+        for (int j = 0; j < kArity; j++) {
+          if (j == found) continue;
+          const uint32_t other = h[j];
+          alone[queue_size] = other;
+          queue_size += (t2count[other] >> 2) == 2 ? 1 : 0;
+          t2count[other] -= 4;
+          t2count[other] ^= j;
+          t2hash[other] ^= hash;
+        }
+      }
+      if (stack_size + duplicates == size) break;
+    }
+
+    for (uint32_t i = stack_size; i-- > 0;) {
+      const uint64_t hash = reverse_order[i];
+      const int found = reverse_h[i];
+      Slots(*params, hash, h);
+      FingerprintType f = Fingerprint(hash);
+      for (int j = 0; j < kArity; j++) {
+        if (j != found) f ^= Load(fingerprints, h[j]);
+      }
+      Store(fingerprints, h[found], f);
+    }
+  }
+
+  // Points *params and *fingerprints at a non-empty filter.  Returns false if
+  // it is corrupt.
+  static bool Decode(const leveldb::Slice& filter, Params* params,
+                     const char** fingerprints) {
+    Slice input = filter;
+    if (!GetFilterHeader(&input, kType) || input.size() < kHeaderSize)
+      return false;
+
+    const char* p = input.data();
+    params->seed = DecodeFixed64(p);
+    params->segment_length = DecodeFixed32(p + 8);
+    params->segment_count_length = DecodeFixed32(p + 12);
+    params->array_length = DecodeFixed32(p + 16);
+
+    const uint32_t segment_length = params->segment_length;
+    if (segment_length == 0 || (segment_length & (segment_length - 1)) != 0 ||
+        segment_length > kMaxSegmentLength ||
+        kHeaderSize + uint64_t{kFingerprintSize} * params->array_length > input.size() ||
+        params->segment_count_length + uint64_t{kArity - 1} * segment_length >
+            params->array_length)
+      return false;  // Corrupt parameters would index past the fingerprints
+
+    *fingerprints = p + kHeaderSize;
+    return true;
+  }
+};
+
+}  // namespace
+
+const FilterPolicy* NewBinaryFuse4WiseFilterPolicy(size_t bits_per_key) {
+  switch (bits_per_key) {
+    case 16:
+      return new BinaryFuse4WiseFilterPolicy<uint16_t>();
+    default:
+      return new BinaryFuse4WiseFilterPolicy<uint8_t>();
+  }
+}
+
+}  // namespace leveldb
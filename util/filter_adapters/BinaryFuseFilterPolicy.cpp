@@ -3,56 +3,75 @@
 //
 
 #include <algorithm>
+#include <vector>
 
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
 
-#include "util/MurmurHash3.h"
+#include "util/coding.h"
+#include "util/filter_adapters/FilterEncoding.h"
+#include "util/filter_adapters/FilterKeyHash.h"
+#include "util/filter_adapters/FilterProbeBatch.h"
 
 #include "fastfilter_cpp/src/xorfilter/binaryfusefilter_singleheader.h"
 
 namespace leveldb {
 
+// Filter layout, after the common adapter header (FilterEncoding.h):
+//    Seed                : fixed64
+//    SegmentLength       : fixed32
+//    SegmentLengthMask   : fixed32
+//    SegmentCount        : fixed32
+//    SegmentCountLength  : fixed32
+//    ArrayLength         : fixed32
+//    Fingerprints        : ArrayLength little-endian 8 or 16 bit values
 template <typename binary_fuseN_s>
 class BinaryFuseFilterPolicy : public FilterPolicy {
  public:
+  static constexpr size_t kHeaderSize = sizeof(uint64_t) + 5 * sizeof(uint32_t);
+  static constexpr size_t kFingerprintSize =
+      sizeof(*binary_fuseN_s{}.Fingerprints);
+  static constexpr FilterType kType =
+      kFingerprintSize == 2 ? kBinaryFuse16Filter : kBinaryFuse8Filter;
 
   static uint64_t keyHash(const leveldb::Slice& key) {
+    return FilterKeyHash(key);
+  }
 
-    uint64_t hash_value = 0;
-
-    MurmurHash3_x86_32((void*) key.data(), key.size(), 1e9 + 9, &hash_value);
+  const char* Name() const override {
+    return kFingerprintSize == 2 ? "BinaryFuseFilterPolicy16" : "BinaryFuseFilterPolicy8";
+  }
 
-    return hash_value;
+  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
+    std::vector<uint64_t> hashes;
+    FilterKeyHashes(keys, n, &hashes);
+    CreateFilterFromHashes(hashes.data(), n, dst);
   }
 
-  const char* Name() const override { return "BinaryFuseFilterPolicy"; }
+  bool HashesKeys() const override { return true; }
 
-  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
-    auto* hashed_keys = new uint64_t[n];
-    std::transform(keys, &keys[n], hashed_keys, [](const Slice& x){return keyHash(x);});
+  uint64_t KeyHash(const leveldb::Slice& key) const override { return keyHash(key); }
 
+  void CreateFilterFromHashes(const uint64_t* hashes, int n, std::string* dst) const override {
     auto filter = binary_fuseN_s {};
 
     allocate(n, &filter);
-    populate(hashed_keys, n, &filter);
+    populate(hashes, n, &filter);
 
     size_t fingerprints_bytes = sizeof(uint8_t) * filter.ArrayLength;;
     if (std::is_same<binary_fuseN_s, binary_fuse16_s>::value)
         fingerprints_bytes *= 2;
 
-    const size_t init_size = dst->size();
-    const size_t additional_size = sizeof(binary_fuseN_s) + fingerprints_bytes;
-    dst->resize(init_size + additional_size, 0);
-
-    auto filter_persist_ptr = (binary_fuseN_s*) &(*dst)[init_size];
-    auto fingerprints_ptr = (uint8_t*) &(filter_persist_ptr[1]);
-
-    // save the filter and then the fingerprints
-    *filter_persist_ptr = filter;
-    std::memcpy(fingerprints_ptr, filter.Fingerprints, fingerprints_bytes);
+    // save the filter parameters and then the fingerprints
+    PutFilterHeader(dst, kType);
+    PutFixed64(dst, filter.Seed);
+    PutFixed32(dst, filter.SegmentLength);
+    PutFixed32(dst, filter.SegmentLengthMask);
+    PutFixed32(dst, filter.SegmentCount);
+    PutFixed32(dst, filter.SegmentCountLength);
+    PutFixed32(dst, filter.ArrayLength);
+    dst->append(reinterpret_cast<const char*>(filter.Fingerprints), fingerprints_bytes);
 
-    delete[] hashed_keys;
     free(&filter);
   }
 
@@ -60,13 +79,72 @@ class BinaryFuseFilterPolicy : public FilterPolicy {
     if (filter.size() <= 0)
       return false;
 
-    auto filter_persist_pointer = (binary_fuseN_s*) filter.data();
-    auto bf_filter = filter_persist_pointer[0];
-    auto fingerprints_ptr = (uint8_t*) &filter_persist_pointer[1];
+    auto bf_filter = binary_fuseN_s {};
+    uint8_t* fingerprints_ptr;
+    if (!decode(filter, &bf_filter, &fingerprints_ptr))
+      return true;  // Errors are treated as potential matches
 
     return contains(keyHash(key), &bf_filter, fingerprints_ptr);
   }
 
+  void KeysMayMatch(const leveldb::Slice* keys, int n, const leveldb::Slice& filter,
+                    bool* results) const override {
+    if (filter.size() <= 0) {
+      std::fill(results, results + n, false);
+      return;
+    }
+
+    auto bf_filter = binary_fuseN_s {};
+    uint8_t* fingerprints_ptr;
+    if (!decode(filter, &bf_filter, &fingerprints_ptr)) {
+      std::fill(results, results + n, true);  // Errors are treated as potential matches
+      return;
+    }
+
+    BatchKeysMayMatch(
+        keys, n, results,
+        [&](uint64_t key) {
+          // The three slots binary_fuse8_contain() and binary_fuse16_contain() read
+          const uint64_t hash = binary_fuse_mix_split(key, bf_filter.Seed);
+          const uint32_t h0 =
+              (uint32_t) binary_fuse_mulhi(hash, bf_filter.SegmentCountLength);
+          const uint32_t h1 = (h0 + bf_filter.SegmentLength) ^
+                              ((uint32_t) (hash >> 18) & bf_filter.SegmentLengthMask);
+          const uint32_t h2 = (h0 + 2 * bf_filter.SegmentLength) ^
+                              ((uint32_t) hash & bf_filter.SegmentLengthMask);
+          PrefetchFilterLine(fingerprints_ptr + h0 * kFingerprintSize);
+          PrefetchFilterLine(fingerprints_ptr + h1 * kFingerprintSize);
+          PrefetchFilterLine(fingerprints_ptr + h2 * kFingerprintSize);
+        },
+        [&](uint64_t key) { return contains(key, &bf_filter, fingerprints_ptr); });
+  }
+
+  // Points *bf_filter and *fingerprints at a non-empty filter.  Returns false
+  // if it is corrupt.
+  static bool decode(const leveldb::Slice& filter, binary_fuseN_s* bf_filter,
+                     uint8_t** fingerprints) {
+    Slice input = filter;
+    if (!GetFilterHeader(&input, kType) || input.size() < kHeaderSize)
+      return false;
+
+    const char* p = input.data();
+    bf_filter->Seed = DecodeFixed64(p);
+    bf_filter->SegmentLength = DecodeFixed32(p + 8);
+    bf_filter->SegmentLengthMask = DecodeFixed32(p + 12);
+    bf_filter->SegmentCount = DecodeFixed32(p + 16);
+    bf_filter->SegmentCountLength = DecodeFixed32(p + 20);
+    bf_filter->ArrayLength = DecodeFixed32(p + 24);
+
+    if (kHeaderSize + uint64_t{kFingerprintSize} * bf_filter->ArrayLength > input.size() ||
+        bf_filter->SegmentLengthMask >= bf_filter->SegmentLength ||
+        bf_filter->SegmentCountLength + 2 * uint64_t{bf_filter->SegmentLength} >
+            bf_filter->ArrayLength)
+      return false;  // Corrupt parameters would index past the fingerprints
+
+    *fingerprints = (uint8_t*) (p + kHeaderSize);
+    return true;
+  }
+
   bool contains(uint64_t key, binary_fuseN_s* filter, uint8_t* fingerprints) const;
 
   void allocate(uint32_t size, binary_fuseN_s *filter) const;
@@ -2,100 +2,247 @@
 // Created by Maciej Gajek on 25/04/2023.
 //
 
+#include <algorithm>
+#include <vector>
+
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
-#include <iostream>
 
-#ifdef __AVX2__
-
-#include <iostream>
-#include <algorithm>
-#include <memory>
+#include "util/coding.h"
+#include "util/filter_adapters/FilterEncoding.h"
+#include "util/filter_adapters/FilterKeyHash.h"
+#include "util/filter_adapters/FilterProbeBatch.h"
+#include "util/filter_adapters/FilterSimd.h"
+#include "fastfilter_cpp/src/hashutil.h"
 
-#include "util/MurmurHash3.h"
-#include "fastfilter_cpp/src/bloom/simd-block.h"
+#if LEVELDB_FILTER_SIMD_X86
+#include <immintrin.h>
+#endif  // LEVELDB_FILTER_SIMD_X86
 
-#endif //__AVX2__
 namespace leveldb {
-#ifdef __AVX2__
 
+// Filter layout, after the common adapter header (FilterEncoding.h):
+//    log_num_buckets : 1 byte
+//    hasher seed     : fixed64
+//    padding length  : 1 byte
+//    padding         : so that the buckets start kFilterBlockAlignment-aligned
+//    buckets         : (1 << log_num_buckets) * 32 bytes
+//
+// Every bucket is eight little-endian 32-bit words and a key sets one bit in
+// each, the layout of fastfilter's SimdBlockFilter<>.  The buckets are probed
+// straight out of the filter slice, so a lookup neither allocates nor copies
+// the directory.  The AVX2 kernels are used when the CPU has them
+// (FilterSimd.h), the portable ones otherwise; both read the same filters.
 class BlockedBloomFilterPolicy : public FilterPolicy {
  public:
+  static constexpr size_t kHeaderSize = 1 + sizeof(uint64_t) + 1;
+  static constexpr size_t kBucketBytes = 32;
 
-  static uint64_t keyHash(const leveldb::Slice& key) {
-
-    uint64_t hash_value = 0;
-
-    MurmurHash3_x86_32((void*) key.data(), key.size(), 1e9 + 9, &hash_value);
+  explicit BlockedBloomFilterPolicy(size_t bits_per_key)
+      : bits_per_key_(std::max<size_t>(1, bits_per_key)),
+        simd_level_(FilterSimdLevelSupported()) {}
 
-    return hash_value;
+  static uint64_t keyHash(const leveldb::Slice& key) {
+    return FilterKeyHash(key);
   }
 
-  const char* Name() const override { return "XorPlusFilterPolicy"; }
+  const char* Name() const override { return "BlockedBloomFilterPolicy"; }
 
   void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
-    auto bloom_filter = SimdBlockFilter<>(ceil(log2(n)));
-    for (int i = 0; i < n; ++i)
-      bloom_filter.Add(keyHash(keys[i]));
-
-    auto bucket_bytes = (1ull << (bloom_filter.log_num_buckets_ + bloom_filter.LOG_BUCKET_BYTE_SIZE));
-
-    const size_t init_size = dst->size();
-    const size_t additional_size =
-      sizeof(int) + // save log_num_buckets_
-      sizeof(uint32_t) + // save directory_mask_
-      sizeof(hashing::SimpleMixSplit) + // save hasher_
-      sizeof(size_t) + // save buckets_size_
-      bucket_bytes;
-
-    dst->resize(init_size + additional_size, 0);
-
-    auto log_num_buckets_ptr = (int*) &dst->data()[init_size];
-    auto directory_mask_ptr = (uint32_t*) (log_num_buckets_ptr + 1);
-    auto hasher_ptr = (hashing::SimpleMixSplit*) (directory_mask_ptr + 1);
-    auto buckets_size_ptr = (size_t*) (hasher_ptr + 1);
-    auto buckets_ptr = (SimdBlockFilter<>::Bucket*) (buckets_size_ptr + 1);
-
-    *log_num_buckets_ptr = bloom_filter.log_num_buckets_;
-    *directory_mask_ptr = bloom_filter.directory_mask_;
-    *hasher_ptr = bloom_filter.hasher_;
-    *buckets_size_ptr = bucket_bytes;
-    std::memcpy(buckets_ptr, bloom_filter.directory_, bucket_bytes);
+    std::vector<uint64_t> hashes;
+    FilterKeyHashes(keys, n, &hashes);
+    CreateFilterFromHashes(hashes.data(), n, dst);
+  }
+
+  bool HashesKeys() const override { return true; }
+
+  uint64_t KeyHash(const leveldb::Slice& key) const override { return keyHash(key); }
+
+  void CreateFilterFromHashes(const uint64_t* hashes, int n, std::string* dst) const override {
+    if (n <= 0) return;
+
+    // At least bits_per_key bits per key, rounded up to a power of two
+    // buckets as SimdBlockFilter<> requires.
+    const uint64_t bits = static_cast<uint64_t>(n) * bits_per_key_;
+    const uint64_t num_buckets = (bits + 8 * kBucketBytes - 1) / (8 * kBucketBytes);
+    Buckets buckets;
+    buckets.log_num_buckets = 1;
+    while ((uint64_t{1} << buckets.log_num_buckets) < num_buckets) {
+      buckets.log_num_buckets++;
+    }
+    buckets.seed = hashing::SimpleMixSplit().seed;
+
+    PutFilterHeader(dst, kBlockedBloomFilter);
+
+    const size_t padding =
+        AlignmentPadding(dst->size() + kHeaderSize, kFilterBlockAlignment);
+
+    dst->push_back(static_cast<char>(buckets.log_num_buckets));
+    PutFixed64(dst, buckets.seed);
+    dst->push_back(static_cast<char>(padding));
+    dst->append(padding, '\0');
+
+    const size_t offset = dst->size();
+    dst->append(kBucketBytes << buckets.log_num_buckets, '\0');
+    char* data = &(*dst)[offset];
+    for (int i = 0; i < n; ++i) {
+      const uint64_t hash = BucketHash(buckets, hashes[i]);
+      char* bucket = data + kBucketBytes * BucketIndex(buckets, hash);
+      const uint32_t lane_hash = static_cast<uint32_t>(hash >> buckets.log_num_buckets);
+      for (int lane = 0; lane < 8; ++lane) {
+        char* word = bucket + sizeof(uint32_t) * lane;
+        EncodeFixed32(word, DecodeFixed32(word) | LaneBit(lane_hash, lane));
+      }
+    }
   }
 
   bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override {
     if (filter.empty()) return false;
 
-    auto log_num_buckets_ptr = (int*) filter.data();
-    auto directory_mask_ptr = (uint32_t*) (log_num_buckets_ptr + 1);
-    auto hasher_ptr = (hashing::SimpleMixSplit*) (directory_mask_ptr + 1);
-    auto buckets_size_ptr = (size_t*) (hasher_ptr + 1);
-    auto buckets_ptr = (SimdBlockFilter<>::Bucket*) (buckets_size_ptr + 1);
+    Buckets buckets;
+    if (!Decode(filter, &buckets)) {
+      return true;  // Errors are treated as potential matches
+    }
+#if LEVELDB_FILTER_SIMD_X86
+    if (simd_level_ >= kFilterSimdAvx2) {
+      return ContainsAvx2(buckets, keyHash(key));
+    }
+#endif  // LEVELDB_FILTER_SIMD_X86
+    return Contains(buckets, keyHash(key));
+  }
 
-    SimdBlockFilter<> bloom_filter(
-      *log_num_buckets_ptr,
-      *directory_mask_ptr,
-      *hasher_ptr
-    );
+  void KeysMayMatch(const leveldb::Slice* keys, int n, const leveldb::Slice& filter,
+                    bool* results) const override {
+    if (filter.empty()) {
+      std::fill(results, results + n, false);
+      return;
+    }
+
+    Buckets buckets;
+    if (!Decode(filter, &buckets)) {
+      std::fill(results, results + n, true);  // Errors are treated as potential matches
+      return;
+    }
+#if LEVELDB_FILTER_SIMD_X86
+    if (simd_level_ >= kFilterSimdAvx2) {
+      KeysMayMatchAvx2(buckets, keys, n, results);
+      return;
+    }
+#endif  // LEVELDB_FILTER_SIMD_X86
+    BatchKeysMayMatch(
+        keys, n, results,
+        [&](uint64_t key_hash) {
+          PrefetchFilterLine(BucketAddress(buckets, BucketHash(buckets, key_hash)));
+        },
+        [&](uint64_t key_hash) { return Contains(buckets, key_hash); });
+  }
 
-    posix_memalign(reinterpret_cast<void**>(&bloom_filter.directory_), 64, *buckets_size_ptr);
-    std::memcpy(bloom_filter.directory_, buckets_ptr, *buckets_size_ptr);
+ private:
+  struct Buckets {
+    const char* data;
+    int log_num_buckets;
+    uint64_t seed;
+  };
+
+  static bool Decode(const leveldb::Slice& filter, Buckets* buckets) {
+    Slice input = filter;
+    if (!GetFilterHeader(&input, kBlockedBloomFilter) || input.size() < kHeaderSize) {
+      return false;
+    }
+
+    const char* header = input.data();
+    buckets->log_num_buckets = static_cast<uint8_t>(header[0]);
+    buckets->seed = DecodeFixed64(header + 1);
+    const size_t padding = static_cast<uint8_t>(header[kHeaderSize - 1]);
+    buckets->data = header + kHeaderSize + padding;
+
+    return buckets->log_num_buckets < 32 &&
+           kHeaderSize + padding + (kBucketBytes << buckets->log_num_buckets) <= input.size();
+  }
 
-    auto res = bloom_filter.Find(keyHash(key));
+  static uint64_t BucketHash(const Buckets& buckets, uint64_t key_hash) {
+    return hashing::SimpleMixSplit::murmur64(key_hash + buckets.seed);
+  }
 
-    return res;
+  static uint32_t BucketIndex(const Buckets& buckets, uint64_t hash) {
+    return hash & ((uint32_t{1} << buckets.log_num_buckets) - 1);
   }
-};
 
-#endif //__AVX2__
+  static const char* BucketAddress(const Buckets& buckets, uint64_t hash) {
+    return buckets.data + kBucketBytes * BucketIndex(buckets, hash);
+  }
+
+  // Same bit selection as SimdBlockFilter<>::MakeMask(), one 32-bit lane at
+  // a time.
+  static uint32_t LaneBit(uint32_t lane_hash, int lane) {
+    static const uint32_t kRehash[8] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU,
+        0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+    return uint32_t{1} << ((kRehash[lane] * lane_hash) >> 27);
+  }
+
+  static bool Contains(const Buckets& buckets, uint64_t key_hash) {
+    const uint64_t hash = BucketHash(buckets, key_hash);
+    const char* bucket = BucketAddress(buckets, hash);
+    const uint32_t lane_hash = static_cast<uint32_t>(hash >> buckets.log_num_buckets);
+    bool found = true;
+    for (int lane = 0; lane < 8; ++lane) {
+      const uint32_t bit = LaneBit(lane_hash, lane);
+      found &= (DecodeFixed32(bucket + sizeof(uint32_t) * lane) & bit) == bit;
+    }
+    return found;
+  }
+
+  static size_t AlignmentPadding(size_t offset, size_t alignment) {
+    return (alignment - offset % alignment) % alignment;
+  }
+
+#if LEVELDB_FILTER_SIMD_X86
+  // Same bit selection as SimdBlockFilter<>::MakeMask().
+  LEVELDB_TARGET_AVX2 static __m256i MakeMask(const uint32_t hash) {
+    const __m256i ones = _mm256_set1_epi32(1);
+    const __m256i rehash = _mm256_setr_epi32(0x47b6137bU, 0x44974d91U, 0x8824ad5bU,
+        0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U);
+    __m256i hash_data = _mm256_set1_epi32(hash);
+    hash_data = _mm256_mullo_epi32(rehash, hash_data);
+    hash_data = _mm256_srli_epi32(hash_data, 27);
+    return _mm256_sllv_epi32(ones, hash_data);
+  }
+
+  LEVELDB_TARGET_AVX2 static bool ContainsAvx2(const Buckets& buckets, uint64_t key_hash) {
+    const uint64_t hash = BucketHash(buckets, key_hash);
+    const __m256i mask = MakeMask(hash >> buckets.log_num_buckets);
+    // Unaligned load instruction, but the writer padded the buckets so that
+    // each one sits inside a single cache line of the aligned filter block.
+    const __m256i bucket = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(BucketAddress(buckets, hash)));
+    return _mm256_testc_si256(bucket, mask);
+  }
+
+  // BatchKeysMayMatch() spelled out: its callbacks would not be compiled for
+  // AVX2, so ContainsAvx2() could not be inlined into them.
+  LEVELDB_TARGET_AVX2 static void KeysMayMatchAvx2(const Buckets& buckets,
+                                                   const leveldb::Slice* keys, int n,
+                                                   bool* results) {
+    uint64_t hashes[kFilterProbeBatch];
+    for (int start = 0; start < n; start += kFilterProbeBatch) {
+      const int count = std::min(kFilterProbeBatch, n - start);
+      for (int i = 0; i < count; i++) {
+        hashes[i] = FilterKeyHash(keys[start + i]);
+        PrefetchFilterLine(BucketAddress(buckets, BucketHash(buckets, hashes[i])));
+      }
+      for (int i = 0; i < count; i++) {
+        results[start + i] = ContainsAvx2(buckets, hashes[i]);
+      }
+    }
+  }
+#endif  // LEVELDB_FILTER_SIMD_X86
+
+  const size_t bits_per_key_;
+  const FilterSimdLevel simd_level_;
+};
 
 const leveldb::FilterPolicy* NewBlockedBloomFilterPolicy(size_t bits_per_key) {
-#ifdef __AVX2__
-  return new BlockedBloomFilterPolicy();
-#else
-  std::cerr << "AVX instructions are not supported on this machine" << std::endl;
-  exit(1);
-#endif //__AVX2__
+  return new BlockedBloomFilterPolicy(bits_per_key);
 }
 
 }  // namespace leveldb
@@ -0,0 +1,256 @@
+//
+// Blocked Bloom filter with 512-bit buckets of sixteen 32-bit lanes.
+//
+
+#include <algorithm>
+#include <string>
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+
+#include "util/coding.h"
+#include "util/filter_adapters/FilterEncoding.h"
+#include "util/filter_adapters/FilterKeyHash.h"
+#include "util/filter_adapters/FilterPolicyAdapter.h"
+#include "util/filter_adapters/FilterProbeBatch.h"
+#include "util/filter_adapters/FilterSimd.h"
+#include "fastfilter_cpp/src/bloom/simd-block-fixed-fpp.h"
+
+#if LEVELDB_FILTER_SIMD_X86
+#include <immintrin.h>
+#endif  // LEVELDB_FILTER_SIMD_X86
+
+namespace leveldb {
+
+namespace {
+
+// Odd multipliers picking each lane's bit from the low half of the hash: the
+// eight of SimdBlockFilter<> followed by eight more.
+const uint32_t kRehash512[16] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+    0x9e3779b1U, 0x85ebca77U, 0xc2b2ae3dU, 0x27d4eb2fU,
+    0x165667b1U, 0xd3a2646dU, 0xfd7046c5U, 0xb55a4f09U};
+
+// Filter layout, after the common adapter header (FilterEncoding.h):
+//    bucket count    : fixed32
+//    hasher seed     : fixed64
+//    padding length  : 1 byte
+//    padding         : so that the buckets start kFilterBlockAlignment-aligned
+//    buckets         : bucket count * 64 bytes
+//
+// A bucket is one cache line of sixteen little-endian 32-bit lanes and every
+// key sets one bit in each lane, so a probe reads one line and tests sixteen
+// bits.  SimdBlockFilterFixed64<> sets eight bits per 64-byte bucket, which
+// wastes fewer bits at low bits per key; sixteen bits pay off from about 18
+// bits per key.  The bucket count comes from bits_per_key directly.
+//
+// Filters are built and probed with AVX-512 when the CPU has it
+// (FilterSimd.h) and with the portable kernels otherwise.
+static constexpr size_t kHeaderSize = sizeof(uint32_t) + sizeof(uint64_t) + 1;
+static constexpr size_t kBucketBytes = 64;
+static constexpr int kLanes = 16;
+
+struct Buckets {
+  const char* data;
+  uint32_t count;
+  uint64_t seed;
+};
+
+inline uint64_t BucketHash(const Buckets& buckets, uint64_t key_hash) {
+  return hashing::SimpleMixSplit::murmur64(key_hash + buckets.seed);
+}
+
+// The high half of the hash picks the bucket, the low half the lane bits.
+inline const char* BucketAddress(const Buckets& buckets, uint64_t hash) {
+  return buckets.data + uint64_t{kBucketBytes} * reduce(hash >> 32, buckets.count);
+}
+
+inline uint32_t LaneBit(uint32_t hash, int lane) {
+  return uint32_t{1} << ((kRehash512[lane] * hash) >> 27);
+}
+
+// The portable kernels, which the tests also use to check the AVX-512 ones.
+// When adding, buckets.data points into the filter being built.
+void Add(const Buckets& buckets, const uint64_t* hashes, int n) {
+  for (int i = 0; i < n; ++i) {
+    const uint64_t hash = BucketHash(buckets, hashes[i]);
+    char* bucket = const_cast<char*>(BucketAddress(buckets, hash));
+    for (int lane = 0; lane < kLanes; ++lane) {
+      char* word = bucket + sizeof(uint32_t) * lane;
+      EncodeFixed32(word, DecodeFixed32(word) | LaneBit(static_cast<uint32_t>(hash), lane));
+    }
+  }
+}
+
+inline bool Contains(const Buckets& buckets, uint64_t key_hash) {
+  const uint64_t hash = BucketHash(buckets, key_hash);
+  const char* bucket = BucketAddress(buckets, hash);
+  bool found = true;
+  for (int lane = 0; lane < kLanes; ++lane) {
+    const uint32_t bit = LaneBit(static_cast<uint32_t>(hash), lane);
+    found &= (DecodeFixed32(bucket + sizeof(uint32_t) * lane) & bit) == bit;
+  }
+  return found;
+}
+
+#if LEVELDB_FILTER_SIMD_X86
+// The unmasked forms of some of these intrinsics start from an undefined
+// vector in GCC's headers, which -Wmaybe-uninitialized reports once they are
+// inlined.  Their zero-masked forms start from _mm512_setzero_si512(), and
+// compile to the same instructions under kAllLanes.
+static constexpr __mmask16 kAllLanes = 0xffff;
+
+LEVELDB_TARGET_AVX512 inline __m512i MakeMask(uint32_t hash) {
+  const __m512i rehash = _mm512_loadu_si512(kRehash512);
+  __m512i h = _mm512_mullo_epi32(rehash, _mm512_set1_epi32(hash));
+  h = _mm512_maskz_srli_epi32(kAllLanes, h, 27);
+  return _mm512_maskz_sllv_epi32(kAllLanes, _mm512_set1_epi32(1), h);
+}
+
+LEVELDB_TARGET_AVX512 void AddAvx512(const Buckets& buckets, const uint64_t* hashes,
+                                     int n) {
+  for (int i = 0; i < n; ++i) {
+    const uint64_t hash = BucketHash(buckets, hashes[i]);
+    char* bucket = const_cast<char*>(BucketAddress(buckets, hash));
+    const __m512i mask = MakeMask(static_cast<uint32_t>(hash));
+    _mm512_storeu_si512(bucket, _mm512_or_si512(_mm512_loadu_si512(bucket), mask));
+  }
+}
+
+LEVELDB_TARGET_AVX512 inline bool ContainsAvx512(const Buckets& buckets,
+                                                 uint64_t key_hash) {
+  const uint64_t hash = BucketHash(buckets, key_hash);
+  const __m512i mask = MakeMask(static_cast<uint32_t>(hash));
+  // The writer padded the buckets so that each one is a whole cache line of
+  // the aligned filter block.
+  const __m512i bucket = _mm512_loadu_si512(BucketAddress(buckets, hash));
+  return _mm512_test_epi32_mask(_mm512_maskz_andnot_epi32(kAllLanes, bucket, mask),
+                                mask) == 0;
+}
+
+// BatchKeysMayMatch() spelled out: its callbacks would not be compiled for
+// AVX-512, so ContainsAvx512() could not be inlined into them.
+LEVELDB_TARGET_AVX512 void KeysMayMatchAvx512(const Buckets& buckets,
+                                              const leveldb::Slice* keys, int n,
+                                              bool* results) {
+  uint64_t hashes[kFilterProbeBatch];
+  for (int start = 0; start < n; start += kFilterProbeBatch) {
+    const int count = std::min(kFilterProbeBatch, n - start);
+    for (int i = 0; i < count; i++) {
+      hashes[i] = FilterKeyHash(keys[start + i]);
+      PrefetchFilterLine(BucketAddress(buckets, BucketHash(buckets, hashes[i])));
+    }
+    for (int i = 0; i < count; i++) {
+      results[start + i] = ContainsAvx512(buckets, hashes[i]);
+    }
+  }
+}
+#endif  // LEVELDB_FILTER_SIMD_X86
+
+class BlockedBloom512View {
+ public:
+  bool Open(Slice input, FilterSimdLevel simd_level) {
+    if (input.size() < kHeaderSize) return false;
+
+    const char* header = input.data();
+    buckets_.count = DecodeFixed32(header);
+    buckets_.seed = DecodeFixed64(header + sizeof(uint32_t));
+    const size_t padding = static_cast<uint8_t>(header[kHeaderSize - 1]);
+    buckets_.data = header + kHeaderSize + padding;
+    simd_level_ = simd_level;
+
+    return buckets_.count > 0 &&
+           kHeaderSize + padding + uint64_t{kBucketBytes} * buckets_.count <= input.size();
+  }
+
+  bool MayContain(uint64_t key_hash) const {
+#if LEVELDB_FILTER_SIMD_X86
+    if (simd_level_ >= kFilterSimdAvx512) {
+      return ContainsAvx512(buckets_, key_hash);
+    }
+#endif  // LEVELDB_FILTER_SIMD_X86
+    return Contains(buckets_, key_hash);
+  }
+
+  void Prefetch(uint64_t key_hash) const {
+    PrefetchFilterLine(BucketAddress(buckets_, BucketHash(buckets_, key_hash)));
+  }
+
+  bool KeysMayMatch(const leveldb::Slice* keys, int n, bool* results) const {
+#if LEVELDB_FILTER_SIMD_X86
+    if (simd_level_ >= kFilterSimdAvx512) {
+      KeysMayMatchAvx512(buckets_, keys, n, results);
+      return true;
+    }
+#endif  // LEVELDB_FILTER_SIMD_X86
+    return false;
+  }
+
+ private:
+  Buckets buckets_;
+  FilterSimdLevel simd_level_;
+};
+
+class BlockedBloom512Traits {
+ public:
+  typedef BlockedBloom512View View;
+
+  explicit BlockedBloom512Traits(size_t bits_per_key)
+      : bits_per_key_(std::max<size_t>(1, bits_per_key)),
+        simd_level_(FilterSimdLevelSupported()) {}
+
+  static const char* Name() { return "BlockedBloomFilterPolicy512"; }
+
+  void Build(const uint64_t* hashes, int n, std::string* dst) const {
+    if (n <= 0) return;
+
+    const uint64_t bits = static_cast<uint64_t>(n) * bits_per_key_;
+    Buckets buckets;
+    buckets.count = static_cast<uint32_t>(
+        std::max<uint64_t>(1, (bits + 8 * kBucketBytes - 1) / (8 * kBucketBytes)));
+    buckets.seed = hashing::SimpleMixSplit().seed;
+
+    PutFilterHeader(dst, kBlockedBloom512Filter);
+
+    const size_t padding =
+        AlignmentPadding(dst->size() + kHeaderSize, kFilterBlockAlignment);
+
+    PutFixed32(dst, buckets.count);
+    PutFixed64(dst, buckets.seed);
+    dst->push_back(static_cast<char>(padding));
+    dst->append(padding, '\0');
+
+    const size_t offset = dst->size();
+    dst->append(kBucketBytes * buckets.count, '\0');
+    buckets.data = &(*dst)[offset];
+#if LEVELDB_FILTER_SIMD_X86
+    if (simd_level_ >= kFilterSimdAvx512) {
+      AddAvx512(buckets, hashes, n);
+      return;
+    }
+#endif  // LEVELDB_FILTER_SIMD_X86
+    Add(buckets, hashes, n);
+  }
+
+  bool Open(const Slice& filter, View* view) const {
+    Slice input = filter;
+    return GetFilterHeader(&input, kBlockedBloom512Filter) && view->Open(input, simd_level_);
+  }
+
+ private:
+  static size_t AlignmentPadding(size_t offset, size_t alignment) {
+    return (alignment - offset % alignment) % alignment;
+  }
+
+  size_t bits_per_key_;
+  FilterSimdLevel simd_level_;
+};
+
+}  // namespace
+
+const leveldb::FilterPolicy* NewBlockedBloomFilterPolicy512(size_t bits_per_key) {
+  return new FilterPolicyAdapter<BlockedBloom512Traits>(BlockedBloom512Traits(bits_per_key));
+}
+
+}  // namespace leveldb
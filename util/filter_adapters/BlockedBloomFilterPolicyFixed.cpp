@@ -2,89 +2,234 @@
 // Created by Maciej Gajek on 25/04/2023.
 //
 
-#include "leveldb/filter_policy.h"
-#include "leveldb/slice.h"
-#include <iostream>
-
-#ifdef __AVX2__
 #include <algorithm>
+#include <vector>
 
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
 
-#include "util/MurmurHash3.h"
+#include "util/coding.h"
+#include "util/filter_adapters/FilterEncoding.h"
+#include "util/filter_adapters/FilterKeyHash.h"
+#include "util/filter_adapters/FilterProbeBatch.h"
+#include "util/filter_adapters/FilterSimd.h"
 #include "fastfilter_cpp/src/bloom/simd-block-fixed-fpp.h"
-#endif //__AVX2__
+
+#if LEVELDB_FILTER_SIMD_X86
+#include <immintrin.h>
+#endif  // LEVELDB_FILTER_SIMD_X86
+
 namespace leveldb {
-#ifdef __AVX2__
+
+// Filter layout, after the common adapter header (FilterEncoding.h):
+//    bucket count    : fixed32
+//    hasher seed     : fixed64
+//    padding length  : 1 byte
+//    padding         : so that the buckets start kFilterBlockAlignment-aligned
+//    buckets         : bucket count * 64 bytes
+//
+// Every bucket is eight little-endian 64-bit words and a key sets one bit in
+// each, the layout of fastfilter's SimdBlockFilterFixed64<>.  A bucket
+// therefore occupies exactly one cache line of the filter block, and a lookup
+// reads it in place without allocating.  The AVX2 kernels are used when the
+// CPU has them (FilterSimd.h), the portable ones otherwise.
 template <size_t buckets_div>
 class BlockedBloomFilterPolicyFixed : public FilterPolicy {
  public:
+  static constexpr size_t kHeaderSize = sizeof(uint32_t) + sizeof(uint64_t) + 1;
+  static constexpr size_t kBucketBytes = 64;
 
-  static uint64_t keyHash(const leveldb::Slice& key) {
+  BlockedBloomFilterPolicyFixed() : simd_level_(FilterSimdLevelSupported()) {}
 
-    uint64_t hash_value = 0;
+  static uint64_t keyHash(const leveldb::Slice& key) {
+    return FilterKeyHash(key);
+  }
 
-    MurmurHash3_x86_32((void*) key.data(), key.size(), 1e9 + 9, &hash_value);
+  const char* Name() const override { return "BlockedBloomFilterPolicyFixed"; }
 
-    return hash_value;
+  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
+    std::vector<uint64_t> hashes;
+    FilterKeyHashes(keys, n, &hashes);
+    CreateFilterFromHashes(hashes.data(), n, dst);
   }
 
-  const char* Name() const override { return "XorPlusFilterPolicy"; }
+  bool HashesKeys() const override { return true; }
 
-  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
-    auto bloom_filter = SimdBlockFilterFixed64<buckets_div>(n);
-    for (int i = 0; i < n; ++i)
-      bloom_filter.Add(keyHash(keys[i]));
-
-    auto bucket_bytes = sizeof(typename SimdBlockFilterFixed64<buckets_div>::Bucket) * bloom_filter.bucketCount;
-
-    const size_t init_size = dst->size();
-    const size_t additional_size =
-      sizeof(int) + // save bucketCount
-      sizeof(hashing::SimpleMixSplit) + // save hasher_
-      sizeof(size_t) + // save buckets_size_
-      bucket_bytes;
-
-    dst->resize(init_size + additional_size, 0);
-
-    auto bucketCount_ptr = (int*) &dst->data()[init_size];
-    auto hasher_ptr = (hashing::SimpleMixSplit*) (bucketCount_ptr + 1);
-    auto buckets_size_ptr = (size_t*) (hasher_ptr + 1);
-    auto buckets_ptr = reinterpret_cast<typename SimdBlockFilterFixed64<buckets_div>::Bucket*> (buckets_size_ptr + 1);
-
-    *bucketCount_ptr = bloom_filter.bucketCount;
-    *hasher_ptr = bloom_filter.hasher_;
-    *buckets_size_ptr = bucket_bytes;
-    std::memcpy(buckets_ptr, bloom_filter.directory_, bucket_bytes);
+  uint64_t KeyHash(const leveldb::Slice& key) const override { return keyHash(key); }
+
+  void CreateFilterFromHashes(const uint64_t* hashes, int n, std::string* dst) const override {
+    if (n <= 0) return;
+
+    // Sized like SimdBlockFilterFixed64<buckets_div>(n).
+    Buckets buckets;
+    buckets.count = std::max(1, n / static_cast<int>(buckets_div));
+    buckets.seed = hashing::SimpleMixSplit().seed;
+
+    PutFilterHeader(dst, kBlockedBloomFixedFilter);
+
+    const size_t padding =
+        AlignmentPadding(dst->size() + kHeaderSize, kFilterBlockAlignment);
+
+    PutFixed32(dst, buckets.count);
+    PutFixed64(dst, buckets.seed);
+    dst->push_back(static_cast<char>(padding));
+    dst->append(padding, '\0');
+
+    const size_t offset = dst->size();
+    dst->append(kBucketBytes * buckets.count, '\0');
+    buckets.data = &(*dst)[offset];
+    for (int i = 0; i < n; ++i) {
+      const uint64_t hash = BucketHash(buckets, hashes[i]);
+      char* bucket = const_cast<char*>(BucketAddress(buckets, hash));
+      for (int word = 0; word < 8; ++word) {
+        char* p = bucket + sizeof(uint64_t) * word;
+        EncodeFixed64(p, DecodeFixed64(p) | WordBit(static_cast<uint32_t>(hash), word));
+      }
+    }
   }
 
   bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override {
     if (filter.empty()) return false;
 
-    auto bucketCount_ptr =  (int*) filter.data();
-    auto hasher_ptr = (hashing::SimpleMixSplit*) (bucketCount_ptr + 1);
-    auto buckets_size_ptr = (size_t*) (hasher_ptr + 1);
-    auto buckets_ptr = reinterpret_cast<typename SimdBlockFilterFixed64<buckets_div>::Bucket*> (buckets_size_ptr + 1);
+    Buckets buckets;
+    if (!Decode(filter, &buckets)) {
+      return true;  // Errors are treated as potential matches
+    }
+#if LEVELDB_FILTER_SIMD_X86
+    if (simd_level_ >= kFilterSimdAvx2) {
+      return ContainsAvx2(buckets, keyHash(key));
+    }
+#endif  // LEVELDB_FILTER_SIMD_X86
+    return Contains(buckets, keyHash(key));
+  }
+
+  void KeysMayMatch(const leveldb::Slice* keys, int n, const leveldb::Slice& filter,
+                    bool* results) const override {
+    if (filter.empty()) {
+      std::fill(results, results + n, false);
+      return;
+    }
 
-    SimdBlockFilterFixed64<buckets_div> bloom_filter(
-      *bucketCount_ptr,
-      *hasher_ptr
-    );
+    Buckets buckets;
+    if (!Decode(filter, &buckets)) {
+      std::fill(results, results + n, true);  // Errors are treated as potential matches
+      return;
+    }
+#if LEVELDB_FILTER_SIMD_X86
+    if (simd_level_ >= kFilterSimdAvx2) {
+      KeysMayMatchAvx2(buckets, keys, n, results);
+      return;
+    }
+#endif  // LEVELDB_FILTER_SIMD_X86
+    BatchKeysMayMatch(
+        keys, n, results,
+        [&](uint64_t key_hash) {
+          PrefetchFilterLine(BucketAddress(buckets, BucketHash(buckets, key_hash)));
+        },
+        [&](uint64_t key_hash) { return Contains(buckets, key_hash); });
+  }
+
+ private:
+  struct Buckets {
+    const char* data;
+    uint32_t count;
+    uint64_t seed;
+  };
+
+  static bool Decode(const leveldb::Slice& filter, Buckets* buckets) {
+    Slice input = filter;
+    if (!GetFilterHeader(&input, kBlockedBloomFixedFilter) || input.size() < kHeaderSize) {
+      return false;
+    }
+
+    const char* header = input.data();
+    buckets->count = DecodeFixed32(header);
+    buckets->seed = DecodeFixed64(header + sizeof(uint32_t));
+    const size_t padding = static_cast<uint8_t>(header[kHeaderSize - 1]);
+    buckets->data = header + kHeaderSize + padding;
+
+    return kHeaderSize + padding + uint64_t{kBucketBytes} * buckets->count <= input.size();
+  }
+
+  static uint64_t BucketHash(const Buckets& buckets, uint64_t key_hash) {
+    return hashing::SimpleMixSplit::murmur64(key_hash + buckets.seed);
+  }
+
+  static const char* BucketAddress(const Buckets& buckets, uint64_t hash) {
+    return buckets.data + uint64_t{kBucketBytes} * reduce(rotl64(hash, 32), buckets.count);
+  }
 
-    posix_memalign(reinterpret_cast<void**>(&bloom_filter.directory_), 64, *buckets_size_ptr);
-    std::memcpy(bloom_filter.directory_, buckets_ptr, *buckets_size_ptr);
+  // Same bit selection as SimdBlockFilterFixed64<>::MakeMask(), one 64-bit
+  // word at a time.  Its unpacks leave the 32-bit lanes 2, 3, 6, 7 in the
+  // first half of the bucket and 0, 1, 4, 5 in the second.
+  static uint64_t WordBit(uint32_t hash, int word) {
+    static const uint32_t kRehash[8] = {0x8824ad5bU, 0xa2b7289dU, 0x9efc4947U,
+        0x5c6bfb31U, 0x47b6137bU, 0x44974d91U, 0x705495c7U, 0x2df1424bU};
+    return uint64_t{1} << ((kRehash[word] * hash) >> 26);
+  }
+
+  static bool Contains(const Buckets& buckets, uint64_t key_hash) {
+    const uint64_t hash = BucketHash(buckets, key_hash);
+    const char* bucket = BucketAddress(buckets, hash);
+    bool found = true;
+    for (int word = 0; word < 8; ++word) {
+      const uint64_t bit = WordBit(static_cast<uint32_t>(hash), word);
+      found &= (DecodeFixed64(bucket + sizeof(uint64_t) * word) & bit) == bit;
+    }
+    return found;
+  }
+
+  static size_t AlignmentPadding(size_t offset, size_t alignment) {
+    return (alignment - offset % alignment) % alignment;
+  }
 
-    auto res = bloom_filter.Find(keyHash(key));
+#if LEVELDB_FILTER_SIMD_X86
+  // Same bit selection as SimdBlockFilterFixed64<>::MakeMask().
+  LEVELDB_TARGET_AVX2 static void MakeMask(const uint64_t hash, __m256i* first,
+                                           __m256i* second) {
+    const __m256i ones = _mm256_set1_epi64x(1);
+    const __m256i rehash1 = _mm256_setr_epi32(0x47b6137bU, 0x44974d91U, 0x8824ad5bU,
+        0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U);
+    __m256i hash_data = _mm256_set1_epi32(hash);
+    __m256i h = _mm256_mullo_epi32(rehash1, hash_data);
+    h = _mm256_srli_epi32(h, 26);
+    *first = _mm256_sllv_epi64(ones, _mm256_unpackhi_epi32(h, _mm256_setzero_si256()));
+    *second = _mm256_sllv_epi64(ones, _mm256_unpacklo_epi32(h, _mm256_setzero_si256()));
+  }
+
+  LEVELDB_TARGET_AVX2 static bool ContainsAvx2(const Buckets& buckets, uint64_t key_hash) {
+    const uint64_t hash = BucketHash(buckets, key_hash);
+    __m256i first, second;
+    MakeMask(hash, &first, &second);
+    const __m256i* bucket = reinterpret_cast<const __m256i*>(BucketAddress(buckets, hash));
+    return _mm256_testc_si256(_mm256_loadu_si256(bucket), first) &
+           _mm256_testc_si256(_mm256_loadu_si256(bucket + 1), second);
+  }
 
-    return res;
+  // BatchKeysMayMatch() spelled out: its callbacks would not be compiled for
+  // AVX2, so ContainsAvx2() could not be inlined into them.
+  LEVELDB_TARGET_AVX2 static void KeysMayMatchAvx2(const Buckets& buckets,
+                                                   const leveldb::Slice* keys, int n,
+                                                   bool* results) {
+    uint64_t hashes[kFilterProbeBatch];
+    for (int start = 0; start < n; start += kFilterProbeBatch) {
+      const int count = std::min(kFilterProbeBatch, n - start);
+      for (int i = 0; i < count; i++) {
+        hashes[i] = FilterKeyHash(keys[start + i]);
+        PrefetchFilterLine(BucketAddress(buckets, BucketHash(buckets, hashes[i])));
+      }
+      for (int i = 0; i < count; i++) {
+        results[start + i] = ContainsAvx2(buckets, hashes[i]);
+      }
+    }
   }
+#endif  // LEVELDB_FILTER_SIMD_X86
+
+  const FilterSimdLevel simd_level_;
 };
-#endif //__AVX2__
 
 const leveldb::FilterPolicy* NewBlockedBloomFilterPolicyFixed(size_t bits_per_key) {
   switch (bits_per_key) {
-#ifdef __AVX2__
     case 40:
       return new BlockedBloomFilterPolicyFixed<40>();
     case 41:
@@ -109,11 +254,6 @@ const leveldb::FilterPolicy* NewBlockedBloomFilterPolicyFixed(size_t bits_per_ke
       return new BlockedBloomFilterPolicyFixed<50>();
     default:
       return new BlockedBloomFilterPolicyFixed<45>();
-#else
-    default:
-      std::cerr << "AVX instructions are not supported on this machine" << std::endl;
-      exit(1);
-#endif //__AVX2__
   }
 }
 
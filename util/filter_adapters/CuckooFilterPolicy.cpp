@@ -5,230 +5,82 @@
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "cuckoofilter/src/cuckoofilter.h"
 #include "cuckoofilter/src/singletable.h"
-#include "util/MurmurHash3.h"
+#include "util/filter_adapters/CuckooTableView.h"
+#include "util/filter_adapters/FilterEncoding.h"
+#include "util/filter_adapters/FilterPolicyAdapter.h"
 
 namespace leveldb {
 constexpr size_t BITS8_PER_KEY = 8;
 constexpr size_t BITS12_PER_KEY = 12;
 constexpr size_t BITS16_PER_KEY = 16;
 
-class CuckooFilterPolicy8 : public FilterPolicy {
- public:
-
-  static uint64_t keyHash(const leveldb::Slice& key) {
-
-    uint64_t hash_value = 0;
-
-    MurmurHash3_x86_32((void*) key.data(), key.size(), 1e9 + 9, &hash_value);
-
-    return hash_value;
-  }
-
-  const char* Name() const override { return "CuckooFilterPolicy"; }
-
-  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
-    //TODO add more bits
-    auto filter = cuckoofilter::CuckooFilter<uint64_t, BITS8_PER_KEY>(n);
-    for (int i = 0; i < n; ++i) {
-      filter.Add(keyHash(keys[i]));
+namespace {
+
+// Add() gives up once the victim slot is taken, silently dropping the key,
+// so keep doubling the table until every distinct key made it in.
+template <size_t bits_per_tag>
+void AppendCuckooFilter(const uint64_t* key_hashes, int n, std::string* dst) {
+  std::vector<uint64_t> hashes(key_hashes, key_hashes + n);
+  std::sort(hashes.begin(), hashes.end());
+  hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+  for (size_t capacity = hashes.size();; capacity *= 2) {
+    cuckoofilter::CuckooFilter<uint64_t, bits_per_tag, cuckoofilter::SingleTable,
+                               CuckooTableHash> filter(capacity);
+    size_t added = 0;
+    while (added < hashes.size() && filter.Add(hashes[added]) == cuckoofilter::Ok)
+      ++added;
+
+    if (added == hashes.size()) {
+      PutFilterHeader(dst, kCuckooFilter);
+      AppendCuckooTable<bits_per_tag>(filter, nullptr, dst);
+      return;
     }
-
-    const size_t init_size = dst->size();
-
-    //TODO persist only values that are needed
-    const size_t additional_size = sizeof(cuckoofilter::CuckooFilter<uint64_t, BITS8_PER_KEY>) +
-                                   sizeof(size_t) +
-                                   sizeof(cuckoofilter::SingleTable<BITS8_PER_KEY>::Bucket) * filter.table_->num_buckets_;
-
-    dst->resize(init_size + additional_size, 0);
-
-    auto filter_persist_ptr = (cuckoofilter::CuckooFilter<uint64_t, BITS8_PER_KEY>*) &(*dst)[init_size];
-    auto num_buckets_ptr = (size_t*) &filter_persist_ptr[1];
-    auto buckets_persist_ptr = (cuckoofilter::SingleTable<
-                                BITS8_PER_KEY>::Bucket*) &num_buckets_ptr[1];
-
-    *filter_persist_ptr = filter;
-    *num_buckets_ptr = filter.table_->num_buckets_;
-    std::memcpy(buckets_persist_ptr, filter.table_->buckets_,
-                sizeof(cuckoofilter::SingleTable<BITS8_PER_KEY>::Bucket) * filter.table_->num_buckets_);
-  }
-
-  bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override {
-    if (filter.size() <= 0)
-      return false;
-
-    auto cuckoo_filter_ptr = (cuckoofilter::CuckooFilter<uint64_t, BITS8_PER_KEY>*) filter.data();
-    auto num_buckets_ptr = (size_t*) &cuckoo_filter_ptr[1];
-    auto buckets_persist_ptr = (cuckoofilter::SingleTable<
-                                BITS8_PER_KEY>::Bucket*) &num_buckets_ptr[1];
-
-    auto cuckoo_filter = *cuckoo_filter_ptr;
-
-    cuckoo_filter.table_ = new cuckoofilter::SingleTable<BITS8_PER_KEY>();
-    cuckoo_filter.table_->num_buckets_ = *num_buckets_ptr;
-    cuckoo_filter.table_->buckets_ = buckets_persist_ptr;
-
-    auto res = cuckoo_filter.Contain(keyHash(key)) == cuckoofilter::Status::Ok;
-
-    cuckoo_filter.table_->buckets_ = nullptr;
-    delete cuckoo_filter.table_;
-    cuckoo_filter.table_ = nullptr;
-
-    return res;
-  }
-
- private:
-  size_t bits_per_key_;
-};
-
-class CuckooFilterPolicy12 : public FilterPolicy {
- public:
-
-  static uint64_t keyHash(const leveldb::Slice& key) {
-
-    uint64_t hash_value = 0;
-
-    MurmurHash3_x86_32((void*) key.data(), key.size(), 1e9 + 9, &hash_value);
-
-    return hash_value;
   }
+}
 
-  const char* Name() const override { return "CuckooFilterPolicy"; }
-
-  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
-    //TODO add more bits
-    auto filter = cuckoofilter::CuckooFilter<uint64_t, BITS12_PER_KEY>(n);
-    for (int i = 0; i < n; ++i) {
-      filter.Add(keyHash(keys[i]));
+template <size_t bits_per_tag>
+struct CuckooFilterTraits {
+  typedef CuckooTableView<bits_per_tag> View;
+
+  static const char* Name() {
+    switch (bits_per_tag) {
+      case BITS16_PER_KEY:
+        return "CuckooFilterPolicy16";
+      case BITS12_PER_KEY:
+        return "CuckooFilterPolicy12";
+      default:
+        return "CuckooFilterPolicy8";
     }
-    
-    const size_t init_size = dst->size();
-
-    //TODO persist only values that are needed
-    const size_t additional_size = sizeof(cuckoofilter::CuckooFilter<uint64_t, BITS12_PER_KEY>) +
-                                   sizeof(size_t) +
-                                   sizeof(cuckoofilter::SingleTable<BITS12_PER_KEY>::Bucket) * filter.table_->num_buckets_;
-
-    dst->resize(init_size + additional_size, 0);
-
-    auto filter_persist_ptr = (cuckoofilter::CuckooFilter<uint64_t, BITS12_PER_KEY>*) &(*dst)[init_size];
-    auto num_buckets_ptr = (size_t*) &filter_persist_ptr[1];
-    auto buckets_persist_ptr = (cuckoofilter::SingleTable<
-                                BITS12_PER_KEY>::Bucket*) &num_buckets_ptr[1];
-
-    *filter_persist_ptr = filter;
-    *num_buckets_ptr = filter.table_->num_buckets_;
-    std::memcpy(buckets_persist_ptr, filter.table_->buckets_,
-                sizeof(cuckoofilter::SingleTable<BITS12_PER_KEY>::Bucket) * filter.table_->num_buckets_);
-  }
-
-  bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override {
-    if (filter.size() <= 0)
-      return false;
-
-    auto cuckoo_filter_ptr = (cuckoofilter::CuckooFilter<uint64_t, BITS12_PER_KEY>*) filter.data();
-    auto num_buckets_ptr = (size_t*) &cuckoo_filter_ptr[1];
-    auto buckets_persist_ptr = (cuckoofilter::SingleTable<
-                                BITS12_PER_KEY>::Bucket*) &num_buckets_ptr[1];
-
-    auto cuckoo_filter = *cuckoo_filter_ptr;
-
-    cuckoo_filter.table_ = new cuckoofilter::SingleTable<BITS12_PER_KEY>();
-    cuckoo_filter.table_->num_buckets_ = *num_buckets_ptr;
-    cuckoo_filter.table_->buckets_ = buckets_persist_ptr;
-
-    auto res = cuckoo_filter.Contain(keyHash(key)) == cuckoofilter::Status::Ok;
-
-    cuckoo_filter.table_->buckets_ = nullptr;
-    delete cuckoo_filter.table_;
-    cuckoo_filter.table_ = nullptr;
-
-    return res;
-  }
-
- private:
-  size_t bits_per_key_;
-};
-
-class CuckooFilterPolicy16 : public FilterPolicy {
- public:
-
-  static uint64_t keyHash(const leveldb::Slice& key) {
-
-    uint64_t hash_value = 0;
-
-    MurmurHash3_x86_32((void*) key.data(), key.size(), 1e9 + 9, &hash_value);
-
-    return hash_value;
   }
 
-  const char* Name() const override { return "CuckooFilterPolicy"; }
-
-  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
-    //TODO add more bits
-    auto filter = cuckoofilter::CuckooFilter<uint64_t, BITS16_PER_KEY>(n);
-    for (int i = 0; i < n; ++i) {
-      filter.Add(keyHash(keys[i]));
-    }
-    
-    const size_t init_size = dst->size();
-    
-    //TODO persist only values that are needed
-    const size_t additional_size = sizeof(cuckoofilter::CuckooFilter<uint64_t, BITS16_PER_KEY>) +
-                                   sizeof(size_t) +
-                                   sizeof(cuckoofilter::SingleTable<BITS16_PER_KEY>::Bucket) * filter.table_->num_buckets_;
-
-    dst->resize(init_size + additional_size, 0);
-
-    auto filter_persist_ptr = (cuckoofilter::CuckooFilter<uint64_t, BITS16_PER_KEY>*) &(*dst)[init_size];
-    auto num_buckets_ptr = (size_t*) &filter_persist_ptr[1];
-    auto buckets_persist_ptr = (cuckoofilter::SingleTable<
-                                BITS16_PER_KEY>::Bucket*) &num_buckets_ptr[1];
-
-    *filter_persist_ptr = filter;
-    *num_buckets_ptr = filter.table_->num_buckets_;
-    std::memcpy(buckets_persist_ptr, filter.table_->buckets_,
-                sizeof(cuckoofilter::SingleTable<BITS16_PER_KEY>::Bucket) * filter.table_->num_buckets_);
+  static void Build(const uint64_t* hashes, int n, std::string* dst) {
+    AppendCuckooFilter<bits_per_tag>(hashes, n, dst);
   }
 
-  bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override {
-    if (filter.size() <= 0)
-      return false;
-
-    auto cuckoo_filter_ptr = (cuckoofilter::CuckooFilter<uint64_t, BITS16_PER_KEY>*) filter.data();
-    auto num_buckets_ptr = (size_t*) &cuckoo_filter_ptr[1];
-    auto buckets_persist_ptr = (cuckoofilter::SingleTable<
-                                BITS16_PER_KEY>::Bucket*) &num_buckets_ptr[1];
-
-    auto cuckoo_filter = *cuckoo_filter_ptr;
-
-    cuckoo_filter.table_ = new cuckoofilter::SingleTable<BITS16_PER_KEY>();
-    cuckoo_filter.table_->num_buckets_ = *num_buckets_ptr;
-    cuckoo_filter.table_->buckets_ = buckets_persist_ptr;
-
-    auto res = cuckoo_filter.Contain(keyHash(key)) == cuckoofilter::Status::Ok;
-
-    cuckoo_filter.table_->buckets_ = nullptr;
-    delete cuckoo_filter.table_;
-    cuckoo_filter.table_ = nullptr;
-
-    return res;
+  // Filters of the other tag widths share the filter type and are rejected
+  // by View::Open().
+  static bool Open(const Slice& filter, View* view) {
+    Slice input = filter;
+    return GetFilterHeader(&input, kCuckooFilter) && view->Open(input);
   }
-
- private:
-  size_t bits_per_key_;
 };
 
+}  // namespace
+
 const FilterPolicy* NewCuckooFilterPolicy(size_t bits_per_key) {
   switch (bits_per_key) {
     case BITS12_PER_KEY:
-      return new CuckooFilterPolicy12();
+      return new FilterPolicyAdapter<CuckooFilterTraits<BITS12_PER_KEY>>();
     case BITS16_PER_KEY:
-      return new CuckooFilterPolicy16();
+      return new FilterPolicyAdapter<CuckooFilterTraits<BITS16_PER_KEY>>();
     default:
-      return new CuckooFilterPolicy8();
+      return new FilterPolicyAdapter<CuckooFilterTraits<BITS8_PER_KEY>>();
   }
 }
 
@@ -0,0 +1,282 @@
+//
+// Read-only views over serialized cuckoo and vacuum filter tables.
+//
+
+#ifndef LEVELDB_CUCKOOTABLEVIEW_H
+#define LEVELDB_CUCKOOTABLEVIEW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include "leveldb/slice.h"
+
+#include "util/coding.h"
+#include "util/filter_adapters/FilterProbeBatch.h"
+
+namespace leveldb {
+
+// Serialized table layout (all integers are little-endian):
+//    num_buckets   : fixed32
+//    victim index  : fixed32
+//    victim tag    : fixed32   (0 when the victim slot is unused)
+//    bits per tag  : 1 byte
+//    alt ranges    : 4 x fixed32, vacuum tables only
+//    buckets       : num_buckets * kBytesPerBucket bytes
+//    tail padding  : 7 zero bytes, probes always load a whole uint64
+//
+// Tags are never 0 (TagHash() maps 0 to 1), which is what lets a zero victim
+// tag mean "no victim".
+
+// Deterministic replacement for the libraries' default hash family, which is
+// seeded from std::random_device.  Readers have to recompute bucket indexes
+// from the serialized table alone, so the builder must not use hidden state.
+struct CuckooTableHash {
+  uint64_t operator()(uint64_t key) const {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+  }
+};
+
+struct CuckooTableHeader {
+  static constexpr size_t kEncodedLength = 3 * sizeof(uint32_t) + 1;
+  static constexpr size_t kAltRanges = 4;
+  static constexpr size_t kTailPadding = sizeof(uint64_t) - 1;
+
+  uint32_t num_buckets = 0;
+  uint32_t victim_index = 0;
+  uint32_t victim_tag = 0;
+  uint8_t bits_per_tag = 0;
+};
+
+inline void EncodeCuckooTableHeader(const CuckooTableHeader& header,
+                                    std::string* dst) {
+  PutFixed32(dst, header.num_buckets);
+  PutFixed32(dst, header.victim_index);
+  PutFixed32(dst, header.victim_tag);
+  dst->push_back(static_cast<char>(header.bits_per_tag));
+}
+
+// Consumes the header from the front of *input.  Returns false when the
+// input is too short to hold one.
+inline bool DecodeCuckooTableHeader(Slice* input, CuckooTableHeader* header) {
+  if (input->size() < CuckooTableHeader::kEncodedLength) return false;
+  const char* p = input->data();
+  header->num_buckets = DecodeFixed32(p);
+  header->victim_index = DecodeFixed32(p + 4);
+  header->victim_tag = DecodeFixed32(p + 8);
+  header->bits_per_tag = static_cast<uint8_t>(p[12]);
+  input->remove_prefix(CuckooTableHeader::kEncodedLength);
+  return true;
+}
+
+// Maps the low hash bits to a tag, the same way the filters' TagHash() does.
+template <size_t bits_per_tag>
+inline uint32_t CuckooTagHash(uint32_t hv) {
+  uint32_t tag = hv & ((1ULL << bits_per_tag) - 1);
+  tag += (tag == 0);
+  return tag;
+}
+
+// Appends the header and bucket array of a built cuckoofilter::CuckooFilter
+// or modifiedcuckoofilter::VacuumFilter.  Vacuum filters must also pass their
+// alternate-bucket ranges.
+template <size_t bits_per_tag, typename FilterType>
+void AppendCuckooTable(const FilterType& filter, const int* alt_ranges,
+                       std::string* dst) {
+  using TableType = typename std::remove_pointer<decltype(filter.table_)>::type;
+  const size_t bytes_per_bucket = TableType::kBytesPerBucket;
+
+  CuckooTableHeader header;
+  header.num_buckets = static_cast<uint32_t>(filter.table_->num_buckets_);
+  if (filter.victim_.used) {
+    header.victim_index = static_cast<uint32_t>(filter.victim_.index);
+    header.victim_tag = filter.victim_.tag;
+  }
+  header.bits_per_tag = bits_per_tag;
+  EncodeCuckooTableHeader(header, dst);
+
+  if (alt_ranges != nullptr) {
+    for (size_t i = 0; i < CuckooTableHeader::kAltRanges; ++i)
+      PutFixed32(dst, static_cast<uint32_t>(alt_ranges[i]));
+  }
+
+  dst->append(reinterpret_cast<const char*>(filter.table_->buckets_),
+              bytes_per_bucket * header.num_buckets);
+  dst->append(CuckooTableHeader::kTailPadding, '\0');
+}
+
+// Bucket array of four bits_per_tag-bit tags per bucket, laid out like the
+// libraries' SingleTable.  Does not own the bytes it points to.
+template <size_t bits_per_tag>
+class SingleTableView {
+ public:
+  static_assert(bits_per_tag == 8 || bits_per_tag == 12 || bits_per_tag == 16,
+                "tag width not supported by the word-parallel probe");
+
+  static constexpr size_t kBytesPerBucket = (bits_per_tag * 4 + 7) >> 3;
+
+  SingleTableView() : buckets_(nullptr) {}
+
+  // Points the view at the num_buckets buckets at the front of *input, and
+  // consumes them and the tail padding.  Returns false if *input is short.
+  bool Init(uint32_t num_buckets, Slice* input) {
+    const size_t needed = kBytesPerBucket * static_cast<size_t>(num_buckets) +
+                          CuckooTableHeader::kTailPadding;
+    if (input->size() < needed) return false;
+    buckets_ = input->data();
+    input->remove_prefix(needed);
+    return true;
+  }
+
+  void PrefetchBucket(size_t i) const {
+    PrefetchFilterLine(buckets_ + i * kBytesPerBucket);
+  }
+
+  bool FindTagInBucket(size_t i, uint32_t tag) const {
+    uint64_t v;
+    std::memcpy(&v, buckets_ + i * kBytesPerBucket, sizeof(v));
+    return HasValue(v, tag);
+  }
+
+ private:
+  // Word-parallel "any of the four tags equals tag", see
+  // http://graphics.stanford.edu/~seander/bithacks.html#ZeroInWord
+  static bool HasValue(uint64_t v, uint32_t tag) {
+    if (bits_per_tag == 8) {
+      v ^= 0x01010101ULL * tag;
+      return ((v - 0x01010101ULL) & ~v & 0x80808080ULL) != 0;
+    } else if (bits_per_tag == 12) {
+      v ^= 0x001001001001ULL * tag;
+      return ((v - 0x001001001001ULL) & ~v & 0x800800800800ULL) != 0;
+    } else {
+      v ^= 0x0001000100010001ULL * tag;
+      return ((v - 0x0001000100010001ULL) & ~v & 0x8000800080008000ULL) != 0;
+    }
+  }
+
+  const char* buckets_;
+};
+
+// Probes a serialized cuckoofilter::CuckooFilter<uint64_t, bits_per_tag,
+// SingleTable, CuckooTableHash> without copying or allocating.
+template <size_t bits_per_tag>
+class CuckooTableView {
+ public:
+  CuckooTableView() = default;
+
+  // Returns false if filter does not hold a well-formed table.
+  bool Open(const Slice& filter) {
+    Slice input = filter;
+    if (!DecodeCuckooTableHeader(&input, &header_) ||
+        header_.bits_per_tag != bits_per_tag || header_.num_buckets == 0 ||
+        (header_.num_buckets & (header_.num_buckets - 1)) != 0) {
+      return false;
+    }
+    return table_.Init(header_.num_buckets, &input);
+  }
+
+  bool MayContain(uint64_t key) const {
+    const uint64_t hash = CuckooTableHash()(key);
+    const uint32_t tag = CuckooTagHash<bits_per_tag>(hash);
+    const size_t i1 = IndexHash(hash >> 32);
+    const size_t i2 = IndexHash(static_cast<uint32_t>(i1 ^ (tag * 0x5bd1e995)));
+
+    if (tag == header_.victim_tag &&
+        (i1 == header_.victim_index || i2 == header_.victim_index)) {
+      return true;
+    }
+    return table_.FindTagInBucket(i1, tag) || table_.FindTagInBucket(i2, tag);
+  }
+
+  // Requests the buckets MayContain(key) reads.
+  void Prefetch(uint64_t key) const {
+    const uint64_t hash = CuckooTableHash()(key);
+    const uint32_t tag = CuckooTagHash<bits_per_tag>(hash);
+    const size_t i1 = IndexHash(hash >> 32);
+    const size_t i2 = IndexHash(static_cast<uint32_t>(i1 ^ (tag * 0x5bd1e995)));
+    table_.PrefetchBucket(i1);
+    table_.PrefetchBucket(i2);
+  }
+
+ private:
+  size_t IndexHash(uint32_t hv) const {
+    return hv & (header_.num_buckets - 1);
+  }
+
+  CuckooTableHeader header_;
+  SingleTableView<bits_per_tag> table_;
+};
+
+// Probes a serialized modifiedcuckoofilter::VacuumFilter<uint64_t,
+// bits_per_tag, TableType, CuckooTableHash>.  TableView decodes the bucket
+// array written by TableType, and must provide Init(), PrefetchBucket() and
+// FindTagInBucket() like SingleTableView.
+template <size_t bits_per_tag,
+          typename TableView = SingleTableView<bits_per_tag>>
+class VacuumTableView {
+ public:
+  VacuumTableView() = default;
+
+  // Returns false if filter does not hold a well-formed table.
+  bool Open(const Slice& filter) {
+    Slice input = filter;
+    if (!DecodeCuckooTableHeader(&input, &header_) ||
+        header_.bits_per_tag != bits_per_tag ||
+        input.size() < CuckooTableHeader::kAltRanges * sizeof(uint32_t)) {
+      return false;
+    }
+    for (size_t i = 0; i < CuckooTableHeader::kAltRanges; ++i)
+      alt_ranges_[i] = DecodeFixed32(input.data() + i * sizeof(uint32_t));
+    input.remove_prefix(CuckooTableHeader::kAltRanges * sizeof(uint32_t));
+    return table_.Init(header_.num_buckets, &input);
+  }
+
+  bool MayContain(uint64_t key) const {
+    if (header_.num_buckets == 0) return false;
+
+    const uint64_t hash = CuckooTableHash()(key);
+    const uint32_t tag = CuckooTagHash<bits_per_tag>(hash);
+    const size_t i1 = (((hash >> 32) * header_.num_buckets) >> 32);
+    if ((i1 == header_.victim_index && tag == header_.victim_tag) ||
+        table_.FindTagInBucket(i1, tag)) {
+      return true;
+    }
+
+    uint32_t t = (tag * 0x5bd1e995U) & alt_ranges_[tag & 3];
+    t += (t == 0);
+    const size_t i2 = i1 ^ t;
+    if (i2 >= header_.num_buckets) return true;  // Corrupt alt ranges
+    return (i2 == header_.victim_index && tag == header_.victim_tag) ||
+           table_.FindTagInBucket(i2, tag);
+  }
+
+  // Requests the buckets MayContain(key) may read.
+  void Prefetch(uint64_t key) const {
+    if (header_.num_buckets == 0) return;
+
+    const uint64_t hash = CuckooTableHash()(key);
+    const uint32_t tag = CuckooTagHash<bits_per_tag>(hash);
+    const size_t i1 = (((hash >> 32) * header_.num_buckets) >> 32);
+    uint32_t t = (tag * 0x5bd1e995U) & alt_ranges_[tag & 3];
+    t += (t == 0);
+    const size_t i2 = i1 ^ t;
+    table_.PrefetchBucket(i1);
+    if (i2 < header_.num_buckets) table_.PrefetchBucket(i2);
+  }
+
+ private:
+  CuckooTableHeader header_;
+  uint32_t alt_ranges_[CuckooTableHeader::kAltRanges];
+  TableView table_;
+};
+
+}  // namespace leveldb
+
+#endif  // LEVELDB_CUCKOOTABLEVIEW_H
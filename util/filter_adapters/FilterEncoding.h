@@ -0,0 +1,73 @@
+//
+// Common framing for filters built by the adapters in util/filter_adapters.
+//
+
+#ifndef LEVELDB_FILTERENCODING_H
+#define LEVELDB_FILTERENCODING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+// Every adapter filter starts with
+//    format version : 1 byte (kFilterFormatVersion)
+//    filter type    : 1 byte (FilterType)
+// followed by an adapter specific payload.  Payload integers are fixed-width
+// little-endian (see util/coding.h) and never native size_t/int or raw C++
+// structs, so filters do not depend on the layout of the library types.
+//
+// Version history:
+//    1 : keys hashed with MurmurHash3_x86_32
+//    2 : keys hashed with FilterKeyHash() (FilterKeyHash.h)
+// Readers reject other versions, so filters from older tables are treated as
+// potential matches until those tables are compacted.
+static const uint8_t kFilterFormatVersion = 2;
+static const size_t kFilterHeaderSize = 2;
+
+// Values are persisted, never renumber them.
+enum FilterType {
+  kXor8Filter = 0x1,
+  kXor16Filter = 0x2,
+  kBinaryFuse8Filter = 0x3,
+  kBinaryFuse16Filter = 0x4,
+  kXorPlus8Filter = 0x5,
+  kXorPlus16Filter = 0x6,
+  kRibbonFilter = 0x7,
+  kCuckooFilter = 0x8,
+  kVacuumFilter = 0x9,
+  kPackedVacuumFilter = 0xa,
+  kBlockedBloomFilter = 0xb,
+  kBlockedBloomFixedFilter = 0xc,
+  kMortonFilter = 0xd,
+  kPrefixFilter = 0xe,
+  kTCShortcut8Filter = 0xf,
+  kTCShortcut16Filter = 0x10,
+  kBinaryFuse4Wise8Filter = 0x11,
+  kBinaryFuse4Wise16Filter = 0x12,
+  kBlockedBloom512Filter = 0x13,
+};
+
+inline void PutFilterHeader(std::string* dst, FilterType type) {
+  dst->push_back(static_cast<char>(kFilterFormatVersion));
+  dst->push_back(static_cast<char>(type));
+}
+
+// Consumes the header from the front of *filter.  Returns false if the filter
+// was not written by an adapter of the given type at a known format version.
+inline bool GetFilterHeader(Slice* filter, FilterType type) {
+  if (filter->size() < kFilterHeaderSize ||
+      static_cast<uint8_t>((*filter)[0]) != kFilterFormatVersion ||
+      static_cast<uint8_t>((*filter)[1]) != type) {
+    return false;
+  }
+  filter->remove_prefix(kFilterHeaderSize);
+  return true;
+}
+
+}  // namespace leveldb
+
+#endif  // LEVELDB_FILTERENCODING_H
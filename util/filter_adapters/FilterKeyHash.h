@@ -0,0 +1,45 @@
+//
+// Key hashing shared by the adapters in util/filter_adapters.
+//
+
+#ifndef LEVELDB_FILTERKEYHASH_H
+#define LEVELDB_FILTERKEYHASH_H
+
+#include <cstdint>
+#include <vector>
+
+#include "leveldb/slice.h"
+
+#include "util/MurmurHash3.h"
+
+namespace leveldb {
+
+// Changing the seed or the hash function changes every persisted filter, so
+// either one requires bumping kFilterFormatVersion (FilterEncoding.h).
+static const uint32_t kFilterKeyHashSeed = 1000000009;
+
+// Full 64-bit hash of a user key: MurmurHash3_x64_128 folded to 64 bits.
+//
+// The filters derive fingerprints and one or more bucket indexes from this
+// single value, so every bit has to be random.  A 32-bit hash widened to
+// uint64_t leaves the upper half zero, which makes index/fingerprint pairs
+// collide long before the filters reach their theoretical false positive
+// rate.
+inline uint64_t FilterKeyHash(const Slice& key) {
+  uint64_t h[2];
+  MurmurHash3_x64_128(key.data(), static_cast<int>(key.size()),
+                      kFilterKeyHashSeed, h);
+  return h[0] ^ h[1];
+}
+
+// Hashes keys[0,n-1] into *hashes, for CreateFilter() implementations that
+// forward to CreateFilterFromHashes().
+inline void FilterKeyHashes(const Slice* keys, int n,
+                            std::vector<uint64_t>* hashes) {
+  hashes->resize(n);
+  for (int i = 0; i < n; i++) (*hashes)[i] = FilterKeyHash(keys[i]);
+}
+
+}  // namespace leveldb
+
+#endif  // LEVELDB_FILTERKEYHASH_H
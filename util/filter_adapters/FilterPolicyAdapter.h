@@ -0,0 +1,122 @@
+//
+// FilterPolicy implemented on top of a traits struct, for adapters whose
+// filters are built from key hashes and probed through a read-only view.
+//
+
+#ifndef LEVELDB_FILTERPOLICYADAPTER_H
+#define LEVELDB_FILTERPOLICYADAPTER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+
+#include "util/filter_adapters/FilterKeyHash.h"
+#include "util/filter_adapters/FilterProbeBatch.h"
+
+namespace leveldb {
+
+// Traits must provide
+//    static const char* Name();
+//      The policy name, which tables store their filters under.  It has to
+//      be unique among the adapters and, where the filter layout depends on
+//      a fingerprint width, include that width.
+//    static void Build(const uint64_t* hashes, int n, std::string* dst);
+//      Appends a filter, common adapter header included (FilterEncoding.h),
+//      for the FilterKeyHash() of n keys, possibly with duplicates.
+//    typedef ... View;
+//    static bool Open(const Slice& filter, View* view);
+//      Points *view at a non-empty filter without copying it.  Returns false
+//      if the filter is corrupt or was written by another adapter.
+// and View
+//    bool MayContain(uint64_t hash) const;
+//    void Prefetch(uint64_t hash) const;
+//      Requests the cache lines MayContain(hash) is going to read.
+// and optionally
+//    bool KeysMayMatch(const Slice* keys, int n, bool* results) const;
+//      Probes keys with a kernel of its own, e.g. one compiled for a wider
+//      instruction set (FilterSimd.h) that MayContain() could not be inlined
+//      into.  Returns false to leave them to the adapter's loop.
+//
+// Traits whose filters depend on settings, e.g. a fractional bits per key,
+// can make these const members instead: the adapter keeps the Traits object
+// it is constructed with.
+//
+// The filter is decoded once per call and every probe is a direct call into
+// the view, so the probe paths inline into KeysMayMatch().
+template <typename Traits>
+class FilterPolicyAdapter : public FilterPolicy {
+ public:
+  typedef typename Traits::View View;
+
+  FilterPolicyAdapter() : traits_() {}
+
+  explicit FilterPolicyAdapter(const Traits& traits) : traits_(traits) {}
+
+  const char* Name() const override { return traits_.Name(); }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    std::vector<uint64_t> hashes;
+    FilterKeyHashes(keys, n, &hashes);
+    traits_.Build(hashes.data(), n, dst);
+  }
+
+  bool HashesKeys() const override { return true; }
+
+  uint64_t KeyHash(const Slice& key) const override { return FilterKeyHash(key); }
+
+  void CreateFilterFromHashes(const uint64_t* hashes, int n,
+                              std::string* dst) const override {
+    traits_.Build(hashes, n, dst);
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    if (filter.empty()) return false;
+
+    View view;
+    if (!traits_.Open(filter, &view)) {
+      return true;  // Errors are treated as potential matches
+    }
+    return view.MayContain(FilterKeyHash(key));
+  }
+
+  void KeysMayMatch(const Slice* keys, int n, const Slice& filter,
+                    bool* results) const override {
+    if (filter.empty()) {
+      std::fill(results, results + n, false);
+      return;
+    }
+
+    View view;
+    if (!traits_.Open(filter, &view)) {
+      std::fill(results, results + n, true);  // Errors are treated as potential matches
+      return;
+    }
+    if (ViewKeysMayMatch(view, keys, n, results, 0)) return;
+    BatchKeysMayMatch(
+        keys, n, results, [&](uint64_t hash) { view.Prefetch(hash); },
+        [&](uint64_t hash) { return view.MayContain(hash); });
+  }
+
+ private:
+  // Preferred, through the int argument, if V has KeysMayMatch().
+  template <typename V>
+  static auto ViewKeysMayMatch(const V& view, const Slice* keys, int n, bool* results,
+                               int) -> decltype(view.KeysMayMatch(keys, n, results)) {
+    return view.KeysMayMatch(keys, n, results);
+  }
+
+  template <typename V>
+  static bool ViewKeysMayMatch(const V&, const Slice*, int, bool*, long) {
+    return false;
+  }
+
+  const Traits traits_;
+};
+
+}  // namespace leveldb
+
+#endif  // LEVELDB_FILTERPOLICYADAPTER_H
@@ -0,0 +1,50 @@
+//
+// Batched filter probes shared by the adapters in util/filter_adapters.
+//
+
+#ifndef LEVELDB_FILTERPROBEBATCH_H
+#define LEVELDB_FILTERPROBEBATCH_H
+
+#include <algorithm>
+#include <cstdint>
+
+#include "leveldb/slice.h"
+
+#include "util/filter_adapters/FilterKeyHash.h"
+
+namespace leveldb {
+
+// Number of keys whose cache lines are requested before the first of them
+// is matched.  Enough to overlap the misses of a group, few enough for the
+// prefetched lines to still be in L1 when they are read.
+static const int kFilterProbeBatch = 16;
+
+inline void PrefetchFilterLine(const void* p) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(p, 0 /* read */, 3 /* high temporal locality */);
+#endif
+}
+
+// KeysMayMatch() for a decoded filter: prefetch(hash) requests the cache
+// lines that match(hash) is going to read, for every key of a group before
+// any of them is matched, so the filter's random accesses overlap instead
+// of stalling one key at a time.
+template <typename Prefetch, typename Match>
+inline void BatchKeysMayMatch(const Slice* keys, int n, bool* results,
+                              const Prefetch& prefetch, const Match& match) {
+  uint64_t hashes[kFilterProbeBatch];
+  for (int start = 0; start < n; start += kFilterProbeBatch) {
+    const int count = std::min(kFilterProbeBatch, n - start);
+    for (int i = 0; i < count; i++) {
+      hashes[i] = FilterKeyHash(keys[start + i]);
+      prefetch(hashes[i]);
+    }
+    for (int i = 0; i < count; i++) {
+      results[start + i] = match(hashes[i]);
+    }
+  }
+}
+
+}  // namespace leveldb
+
+#endif  // LEVELDB_FILTERPROBEBATCH_H
@@ -0,0 +1,41 @@
+//
+// CPU feature detection for FilterSimd.h.
+//
+
+#include "util/filter_adapters/FilterSimd.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace leveldb {
+
+namespace {
+
+std::atomic<int> simd_level_limit(kFilterSimdAvx512);
+
+FilterSimdLevel DetectFilterSimdLevel() {
+#if LEVELDB_FILTER_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+    return kFilterSimdAvx512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return kFilterSimdAvx2;
+  }
+#endif  // LEVELDB_FILTER_SIMD_X86
+  return kFilterSimdScalar;
+}
+
+}  // namespace
+
+FilterSimdLevel FilterSimdLevelSupported() {
+  static const FilterSimdLevel detected = DetectFilterSimdLevel();
+  return static_cast<FilterSimdLevel>(
+      std::min<int>(detected, simd_level_limit.load(std::memory_order_relaxed)));
+}
+
+void SetFilterSimdLevelLimitForTesting(FilterSimdLevel limit) {
+  simd_level_limit.store(limit, std::memory_order_relaxed);
+}
+
+}  // namespace leveldb
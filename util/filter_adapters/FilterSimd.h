@@ -0,0 +1,41 @@
+//
+// Runtime selection of the SIMD probe kernels used by the adapters in
+// util/filter_adapters.
+//
+
+#ifndef LEVELDB_FILTERSIMD_H
+#define LEVELDB_FILTERSIMD_H
+
+// The library is built for the baseline ISA, so one binary runs everywhere.
+// Kernels for wider instruction sets are compiled per function with
+// LEVELDB_TARGET_* and only called once FilterSimdLevelSupported() says the
+// CPU has them.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define LEVELDB_FILTER_SIMD_X86 1
+#define LEVELDB_TARGET_AVX2 __attribute__((target("avx2")))
+#define LEVELDB_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#else
+#define LEVELDB_FILTER_SIMD_X86 0
+#endif
+
+namespace leveldb {
+
+// Ordered: every level implies the ones before it.
+enum FilterSimdLevel {
+  kFilterSimdScalar = 0,
+  kFilterSimdAvx2 = 1,
+  kFilterSimdAvx512 = 2,
+};
+
+// The widest kernels this CPU can run.  Detected once per process; policies
+// read it when they are constructed and keep their choice.
+FilterSimdLevel FilterSimdLevelSupported();
+
+// Caps FilterSimdLevelSupported() so tests can compare the kernels of
+// policies constructed afterwards against each other.
+void SetFilterSimdLevelLimitForTesting(FilterSimdLevel limit);
+
+}  // namespace leveldb
+
+#endif  // LEVELDB_FILTERSIMD_H
@@ -0,0 +1,413 @@
+//
+// Morton filter adapter over fastfilter_cpp/src/morton.
+//
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "fastfilter_cpp/src/morton/morton_filter.h"
+#include "util/coding.h"
+#include "util/filter_adapters/FilterEncoding.h"
+#include "util/filter_adapters/FilterKeyHash.h"
+#include "util/filter_adapters/FilterProbeBatch.h"
+
+namespace leveldb {
+
+namespace {
+
+// Probes the blocks of a serialized CompressedCuckoo::CompressedCuckooFilter
+// without instantiating the library type, which allocates its block store.
+//
+// A block is a 512-bit cache line holding, from bit 0, the fullness counter
+// array (one counter per bucket), the overflow tracking array (OTA) and the
+// fingerprint storage array (FSA).  Buckets are stored back to back in the
+// FSA, so a bucket starts at the sum of the counters before it.  A key is
+// looked up in its primary bucket, and in the alternate bucket only if the
+// primary block's OTA records an overflow for it: most negative lookups read
+// a single cache line.
+template <typename Morton>
+class MortonTableView {
+ public:
+  static constexpr uint64_t kFingerprintBits = Morton::_fingerprint_len_bits;
+  static constexpr uint64_t kBucketsPerBlock = Morton::_buckets_per_block;
+  static constexpr uint64_t kCounterBits = Morton::_fullness_counter_width;
+  static constexpr uint64_t kBlockBytes = Morton::_block_size_bits / 8;
+  // Fields are read with one unaligned 8-byte load past their first byte.
+  static constexpr size_t kTailPadding = sizeof(uint64_t);
+  // determine_alternate_bucket() moves up to this many buckets away and
+  // wraps around the table once, so smaller tables would index past it.
+  static constexpr uint64_t kMinBuckets = 0x1fff + kBucketsPerBlock + 2;
+
+  static_assert(Morton::_block_size_bits == 512, "blocks must be cache lines");
+  static_assert(Morton::_remap_enabled &&
+                    Morton::_morton_filter_functionality_enabled &&
+                    !Morton::_resizing_enabled && !Morton::_use_bloom_ota &&
+                    Morton::_ota_lbi_insertion_threshold == -1,
+                "lookup path implemented for plain Morton filters only");
+  static_assert(Morton::_alternate_bucket_selection_method ==
+                    CompressedCuckoo::AlternateBucketSelectionMethodEnum::
+                        FUNCTION_BASED_OFFSET,
+                "alternate buckets implemented for FUNCTION_BASED_OFFSET only");
+  static_assert(kCounterBits * kBucketsPerBlock <= 128,
+                "counters are summed within 128 bits");
+  static_assert(Morton::_fullness_counters_offset == 0,
+                "counters must start the block");
+  static_assert(kFingerprintBits <= 32, "fields are read with 8-byte loads");
+
+  MortonTableView() = default;
+
+  // Layout, after any padding (see AppendMortonTable()):
+  //    total buckets : fixed64
+  //    blocks        : total buckets / kBucketsPerBlock, each as 8 fixed64
+  //    tail padding  : kTailPadding bytes
+  // Returns false if filter does not hold a well-formed table.
+  bool Open(const Slice& filter) {
+    if (filter.size() < sizeof(uint64_t)) return false;
+    const uint64_t total_buckets = DecodeFixed64(filter.data());
+    const uint64_t num_blocks = total_buckets / kBucketsPerBlock;
+    if (total_buckets < kMinBuckets || total_buckets % kBucketsPerBlock != 0 ||
+        total_buckets % 2 != 0 ||
+        num_blocks > (filter.size() - sizeof(uint64_t)) / kBlockBytes ||
+        filter.size() - sizeof(uint64_t) !=
+            num_blocks * kBlockBytes + kTailPadding) {
+      return false;
+    }
+    total_buckets_ = total_buckets;
+    blocks_ = filter.data() + sizeof(uint64_t);
+    return true;
+  }
+
+  bool MayContain(uint64_t key) const {
+    const uint64_t hash = ::BitMixMurmur()(key);
+    const uint64_t fingerprint = hash >> (64 - kFingerprintBits);
+    const uint64_t bucket = PrimaryBucket(hash);
+    if (BucketContains(bucket, fingerprint)) return true;
+    if (!MayHaveOverflowed(bucket, fingerprint)) return false;
+    return BucketContains(AlternateBucket(bucket, fingerprint), fingerprint);
+  }
+
+  // Requests the block MayContain(key) reads first.
+  void Prefetch(uint64_t key) const {
+    const uint64_t hash = ::BitMixMurmur()(key);
+    PrefetchFilterLine(Block(PrimaryBucket(hash)));
+  }
+
+ private:
+  const char* Block(uint64_t bucket) const {
+    return blocks_ + (bucket / kBucketsPerBlock) * kBlockBytes;
+  }
+
+  // The field of width bits starting at bit offset of block.
+  static uint64_t Field(const char* block, uint64_t offset, uint64_t width) {
+    return (DecodeFixed64(block + offset / 8) >> (offset % 8)) &
+           ((uint64_t{1} << width) - 1);
+  }
+
+  uint64_t PrimaryBucket(uint64_t hash) const {
+    constexpr uint64_t kShift = 64 - kFingerprintBits;
+    return util::fast_mod_alternative<uint64_t>(
+        hash & ((uint64_t{1} << kShift) - 1), total_buckets_, kShift);
+  }
+
+  uint64_t AlternateBucket(uint64_t bucket, uint64_t fingerprint) const {
+    const int64_t offset =
+        ((::BitMixMurmur()(fingerprint) & 0x1fff) + kBucketsPerBlock) | 1;
+    const int64_t total = static_cast<int64_t>(total_buckets_);
+    int64_t alternate = static_cast<int64_t>(bucket) +
+                        ((bucket & 1) ? offset : -offset);
+    if (alternate < 0) alternate += total;
+    if (alternate >= total) alternate -= total;
+    return static_cast<uint64_t>(alternate);
+  }
+
+  bool MayHaveOverflowed(uint64_t bucket, uint64_t fingerprint) const {
+    using Hashing = CompressedCuckoo::OverflowTrackingArrayHashingMethodEnum;
+    constexpr uint64_t kOtaBits = Morton::_ota_len_bits;
+    uint64_t index;
+    switch (Morton::_morton_ota_hashing_method) {
+      case Hashing::LEMIRE_FINGERPRINT_MULTIPLY:
+        index = util::fast_mod_alternative<uint64_t>(fingerprint, kOtaBits,
+                                                     kFingerprintBits);
+        break;
+      case Hashing::RAW_BUCKET_HASH:
+        index = bucket % kOtaBits;
+        break;
+      case Hashing::CLUSTERED_BUCKET_HASH:
+      default:
+        index = (bucket % kBucketsPerBlock) /
+                ((kBucketsPerBlock + kOtaBits - 1) / kOtaBits);
+        break;
+    }
+    return Field(Block(bucket),
+                 Morton::_overflow_tracking_array_offset + index, 1) != 0;
+  }
+
+  // Sum of the counters of the buckets before counter_index, i.e. the FSA
+  // slot of its first fingerprint.  Adds up each bit position of the
+  // counters with one popcount, like exclusive_reduce_with_popcount().
+  static uint64_t BucketStart(const char* block, uint64_t counter_index) {
+    __uint128_t counters =
+        (static_cast<__uint128_t>(DecodeFixed64(block + 8)) << 64) |
+        DecodeFixed64(block);
+    counters &= (static_cast<__uint128_t>(1) << (kCounterBits * counter_index)) - 1;
+
+    // The lowest bit of every counter: 0b...0101 for two bit counters.
+    constexpr __uint128_t kOne = 1;
+    constexpr __uint128_t kCounterMask =
+        kCounterBits * kBucketsPerBlock == 128
+            ? ~static_cast<__uint128_t>(0)
+            : (kOne << (kCounterBits * kBucketsPerBlock)) - 1;
+    constexpr __uint128_t kLowBits = kCounterMask / ((kOne << kCounterBits) - 1);
+    uint64_t sum = 0;
+    for (uint64_t bit = 0; bit < kCounterBits; bit++) {
+      const __uint128_t set = counters & (kLowBits << bit);
+      sum += static_cast<uint64_t>(
+                 __builtin_popcountll(static_cast<uint64_t>(set)) +
+                 __builtin_popcountll(static_cast<uint64_t>(set >> 64)))
+             << bit;
+    }
+    return sum;
+  }
+
+  bool BucketContains(uint64_t bucket, uint64_t fingerprint) const {
+    const char* block = Block(bucket);
+    const uint64_t counter_index = bucket % kBucketsPerBlock;
+    const uint64_t full_slots =
+        Field(block, counter_index * kCounterBits, kCounterBits);
+    const uint64_t start = BucketStart(block, counter_index);
+    if (start + full_slots > Morton::_max_fingerprints_per_block) {
+      return true;  // Corrupt counters
+    }
+    for (uint64_t i = 0; i < full_slots; i++) {
+      if (Field(block,
+                Morton::_fingerprint_offset + (start + i) * kFingerprintBits,
+                kFingerprintBits) == fingerprint) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  uint64_t total_buckets_ = 0;
+  const char* blocks_ = nullptr;
+};
+
+// The Morton configuration with its block sums taken by a counter scan.  The
+// library's POP_CNT reduction masks the counters below counter_index with
+// (1 << width * counter_index) - 1, and sums whole blocks with counter_index
+// equal to the bucket count: a shift by the full 64 or 128 bits, which is
+// undefined.  Optimized builds happen to get the full mask; unoptimized ones
+// do not, miscount the block's load and corrupt the table.  The reduction
+// method only changes how inserts find a bucket's slots, not the layout that
+// MortonTableView reads.
+template <typename Morton>
+struct ScanReduced;
+
+template <uint16_t t_slots_per_bucket, uint16_t t_fingerprint_len_bits,
+          uint16_t t_ota_len_bits, uint16_t t_block_size_bits,
+          CompressedCuckoo::SerializedFixedPoint t_target_compression_ratio,
+          CompressedCuckoo::CounterReadMethodEnum t_read_counters_method,
+          CompressedCuckoo::FingerprintReadMethodEnum t_read_fingerprints_method,
+          CompressedCuckoo::ReductionMethodEnum t_reduction_method,
+          CompressedCuckoo::AlternateBucketSelectionMethodEnum
+              t_alternate_bucket_selection_method,
+          CompressedCuckoo::OverflowTrackingArrayHashingMethodEnum
+              t_morton_ota_hashing_method,
+          bool t_resizing_enabled, bool t_remap_enabled,
+          bool t_collision_resolution_enabled,
+          bool t_morton_filter_functionality_enabled,
+          bool t_block_fullness_array_enabled, bool t_handle_conflicts,
+          CompressedCuckoo::FingerprintComparisonMethodEnum
+              t_fingerprint_comparison_method>
+struct ScanReduced<CompressedCuckoo::CompressedCuckooFilter<
+    t_slots_per_bucket, t_fingerprint_len_bits, t_ota_len_bits, t_block_size_bits,
+    t_target_compression_ratio, t_read_counters_method, t_read_fingerprints_method,
+    t_reduction_method, t_alternate_bucket_selection_method,
+    t_morton_ota_hashing_method, t_resizing_enabled, t_remap_enabled,
+    t_collision_resolution_enabled, t_morton_filter_functionality_enabled,
+    t_block_fullness_array_enabled, t_handle_conflicts,
+    t_fingerprint_comparison_method>> {
+  typedef CompressedCuckoo::CompressedCuckooFilter<
+      t_slots_per_bucket, t_fingerprint_len_bits, t_ota_len_bits, t_block_size_bits,
+      t_target_compression_ratio, t_read_counters_method, t_read_fingerprints_method,
+      CompressedCuckoo::ReductionMethodEnum::NAIVE_FULL_EXCLUSIVE_SCAN,
+      t_alternate_bucket_selection_method, t_morton_ota_hashing_method,
+      t_resizing_enabled, t_remap_enabled, t_collision_resolution_enabled,
+      t_morton_filter_functionality_enabled, t_block_fullness_array_enabled,
+      t_handle_conflicts, t_fingerprint_comparison_method>
+      type;
+};
+
+// Payload of a kMorton filter: padding, then a table MortonTableView reads.
+//    padding length : 1 byte
+//    padding        : padding length bytes
+// The padding puts the first block at a multiple of 64 bytes from the start
+// of the filter, so a lookup touches one cache line per block when the
+// filter itself is cache line aligned (as full filters are).
+template <typename Morton>
+bool AppendMortonTable(const std::vector<uint64_t>& hashes, std::string* dst) {
+  using View = MortonTableView<Morton>;
+  using Builder = typename ScanReduced<Morton>::type;
+
+  // Same sizing as the fastfilter benchmarks, i.e. a load of 0.95.  Inserts
+  // that do not fit are retried in a larger table.
+  uint64_t capacity = static_cast<uint64_t>(hashes.size() / 0.95) + 64;
+  for (;; capacity += capacity / 4) {
+    std::unique_ptr<Builder> filter(new Builder(capacity));
+    if (filter->_total_buckets < View::kMinBuckets) return false;
+
+    size_t added = 0;
+    while (added < hashes.size() && filter->insert(hashes[added])) ++added;
+    if (added < hashes.size()) continue;
+
+    // Pad so that the blocks start at a multiple of View::kBlockBytes.
+    const size_t header_end = dst->size() + 1 + sizeof(uint64_t);
+    const size_t padding = (View::kBlockBytes - header_end % View::kBlockBytes) %
+                           View::kBlockBytes;
+    dst->push_back(static_cast<char>(padding));
+    dst->append(padding, '\0');
+    PutFixed64(dst, filter->_total_buckets);
+    for (uint64_t b = 0; b < filter->_total_blocks; b++) {
+      for (uint64_t a = 0; a < View::kBlockBytes / sizeof(uint64_t); a++) {
+        PutFixed64(dst, filter->_storage[b][a]);
+      }
+    }
+    dst->append(View::kTailPadding, '\0');
+    return true;
+  }
+}
+
+template <typename Morton>
+bool OpenMortonTable(Slice input, MortonTableView<Morton>* view) {
+  if (input.empty()) return false;
+  const size_t padding = static_cast<uint8_t>(input[0]);
+  if (input.size() < 1 + padding) return false;
+  input.remove_prefix(1 + padding);
+  return view->Open(input);
+}
+
+}  // namespace
+
+// Filter layout, after the common adapter header (FilterEncoding.h):
+//    kind : 1 byte, kMorton or kCuckooFallback
+// kCuckooFallback is followed by the fallback policy's filter, kMorton by
+// the table written by AppendMortonTable().
+//
+// The library's alternate bucket selection needs tables of at least
+// MortonTableView::kMinBuckets buckets (about 8KB), so filters over fewer
+// keys than fill one are cuckoo filters.  Their fingerprints are wider than
+// the Morton filter's: a cuckoo filter's four-slot buckets and lower load
+// need about four more bits for a similar false positive rate.
+template <typename Morton>
+class MortonFilterPolicy : public FilterPolicy {
+ public:
+  enum Kind { kMorton = 0, kCuckooFallback = 1 };
+
+  explicit MortonFilterPolicy(size_t fallback_bits_per_key)
+      : fallbackPolicy_(NewCuckooFilterPolicy(fallback_bits_per_key)) {}
+
+  ~MortonFilterPolicy() override { delete fallbackPolicy_; }
+
+  static uint64_t keyHash(const leveldb::Slice& key) {
+    return FilterKeyHash(key);
+  }
+
+  const char* Name() const override {
+    switch (MortonTableView<Morton>::kFingerprintBits) {
+      case 16:
+        return "MortonFilterPolicy16";
+      case 12:
+        return "MortonFilterPolicy12";
+      default:
+        return "MortonFilterPolicy8";
+    }
+  }
+
+  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
+    std::vector<uint64_t> hashes;
+    FilterKeyHashes(keys, n, &hashes);
+    CreateFilterFromHashes(hashes.data(), n, dst);
+  }
+
+  // The cuckoo fallback hashes keys with FilterKeyHash() as well.
+  bool HashesKeys() const override { return true; }
+
+  uint64_t KeyHash(const leveldb::Slice& key) const override { return keyHash(key); }
+
+  void CreateFilterFromHashes(const uint64_t* key_hashes, int n, std::string* dst) const override {
+    if (n <= 0) return;
+
+    // Inserting a fingerprint twice can overflow its buckets.
+    std::vector<uint64_t> hashes(key_hashes, key_hashes + n);
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+    const size_t start = dst->size();
+    PutFilterHeader(dst, kMortonFilter);
+    dst->push_back(static_cast<char>(kMorton));
+    if (!AppendMortonTable<Morton>(hashes, dst)) {
+      dst->resize(start);
+      PutFilterHeader(dst, kMortonFilter);
+      dst->push_back(static_cast<char>(kCuckooFallback));
+      fallbackPolicy_->CreateFilterFromHashes(
+          hashes.data(), static_cast<int>(hashes.size()), dst);
+    }
+  }
+
+  bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override {
+    bool result;
+    KeysMayMatch(&key, 1, filter, &result);
+    return result;
+  }
+
+  void KeysMayMatch(const leveldb::Slice* keys, int n, const leveldb::Slice& filter,
+                    bool* results) const override {
+    if (filter.empty()) {
+      std::fill(results, results + n, false);
+      return;
+    }
+
+    Slice input = filter;
+    if (!GetFilterHeader(&input, kMortonFilter) || input.empty()) {
+      std::fill(results, results + n, true);  // Errors are treated as potential matches
+      return;
+    }
+
+    const uint8_t kind = static_cast<uint8_t>(input[0]);
+    input.remove_prefix(1);
+
+    if (kind == kCuckooFallback) {
+      fallbackPolicy_->KeysMayMatch(keys, n, input, results);
+      return;
+    }
+
+    MortonTableView<Morton> view;
+    if (kind != kMorton || !OpenMortonTable(input, &view)) {
+      std::fill(results, results + n, true);
+      return;
+    }
+    BatchKeysMayMatch(
+        keys, n, results, [&](uint64_t key_hash) { view.Prefetch(key_hash); },
+        [&](uint64_t key_hash) { return view.MayContain(key_hash); });
+  }
+
+ private:
+  const FilterPolicy* const fallbackPolicy_;
+};
+
+const FilterPolicy* NewMortonFilterPolicy(size_t bits_per_key) {
+  switch (bits_per_key) {
+    case 12:
+      return new MortonFilterPolicy<CompressedCuckoo::Morton3_12>(16);
+    case 16:
+      return new MortonFilterPolicy<CompressedCuckoo::Morton3_16>(16);
+    default:
+      return new MortonFilterPolicy<CompressedCuckoo::Morton3_8>(12);
+  }
+}
+
+}  // namespace leveldb
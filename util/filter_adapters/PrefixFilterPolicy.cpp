@@ -0,0 +1,350 @@
+//
+// Prefix filter adapter over the PD layout of fastfilter_cpp/src/prefix.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+
+#include "util/coding.h"
+#include "util/filter_adapters/FilterEncoding.h"
+#include "util/filter_adapters/FilterKeyHash.h"
+#include "util/filter_adapters/FilterProbeBatch.h"
+#include "util/filter_adapters/FilterSimd.h"
+
+#if LEVELDB_FILTER_SIMD_X86 || defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+namespace leveldb {
+
+namespace {
+
+// A pocket dictionary (PD) is a 32-byte bin of up to kMaxCapacity
+// fingerprints, laid out like the PDs of min_pd256.hpp:
+//    bits 0-4   : quotient of the largest fingerprint, if the PD overflowed
+//    bit  5     : set unless the PD overflowed
+//    bits 6-55  : for every quotient, a 0 bit per fingerprint, then a 1 bit
+//    bytes 7-31 : remainders, by quotient and then by value
+// A fingerprint qr is a quotient below kQuotients and an 8-bit remainder.
+static const size_t kPdBytes = 32;
+static const uint64_t kQuotients = 25;
+static const uint64_t kMaxCapacity = 25;
+static const size_t kBodyOffset = 7;
+static const uint64_t kNotOverflowedBit = 32;
+static const int kPdHeaderShift = 6;
+static const uint64_t kPdHeaderMask = (uint64_t{1} << (kQuotients + kMaxCapacity)) - 1;
+
+// PDs are sized for this load, as in the fastfilter benchmarks.
+static const double kPdLoad = 0.95;
+
+inline uint32_t PdIndex(uint64_t hash, uint32_t num_pds) {
+  return static_cast<uint32_t>((static_cast<uint64_t>(hash >> 32) * num_pds) >> 32);
+}
+
+// Maps the low 16 bits of hash onto [0, kQuotients * 256).
+inline uint16_t Fingerprint(uint64_t hash) {
+  return static_cast<uint16_t>(
+      (static_cast<uint32_t>(static_cast<uint16_t>(hash)) * (kQuotients << 8)) >> 16);
+}
+
+// Position of the j-th (from 0) set bit of x, or 64 if x has no more than j.
+inline uint64_t Select64(uint64_t x, uint64_t j) {
+#ifdef __BMI2__
+  x = _pdep_u64(uint64_t{1} << j, x);
+#else
+  for (; j > 0 && x != 0; j--) x &= x - 1;
+#endif  // __BMI2__
+  return x == 0 ? 64 : __builtin_ctzll(x);
+}
+
+inline bool HasZeroByte(uint64_t x) {
+  return ((x - 0x0101010101010101ull) & ~x & 0x8080808080808080ull) != 0;
+}
+
+// Body indexes [*begin, *end) of the run of quotient quot: each 1 bit of the
+// header before the run ends a lower quotient's.  Corrupt headers keep the
+// run inside the PD.
+inline bool PdRun(uint64_t word, uint64_t quot, uint64_t* begin, uint64_t* end) {
+  const uint64_t header = (word >> kPdHeaderShift) & kPdHeaderMask;
+  *begin = quot == 0 ? 0 : std::min(Select64(header, quot - 1) + 1 - quot, kMaxCapacity);
+  *end = std::min(Select64(header, quot) - quot, kMaxCapacity);
+  return *begin < *end;
+}
+
+// Returns true if the PD holds fingerprint qr.
+inline bool PdContains(const char* pd, uint64_t word, uint16_t qr) {
+  const uint8_t rem = static_cast<uint8_t>(qr);
+  // Most lookups find no remainder equal to rem anywhere in the PD, and are
+  // answered eight bytes at a time without decoding the header.
+  const uint64_t pattern = 0x0101010101010101ull * rem;
+  if (static_cast<uint8_t>(pd[kBodyOffset]) != rem &&
+      !HasZeroByte(DecodeFixed64(pd + 8) ^ pattern) &&
+      !HasZeroByte(DecodeFixed64(pd + 16) ^ pattern) &&
+      !HasZeroByte(DecodeFixed64(pd + 24) ^ pattern)) {
+    return false;
+  }
+
+  uint64_t begin, end;
+  if (!PdRun(word, qr >> 8, &begin, &end)) return false;
+  for (uint64_t i = begin; i < end; i++) {
+    if (static_cast<uint8_t>(pd[kBodyOffset + i]) == rem) return true;
+  }
+  return false;
+}
+
+#if LEVELDB_FILTER_SIMD_X86
+// PdContains() with the remainders of the whole PD compared at once.
+LEVELDB_TARGET_AVX2 inline bool PdContainsAvx2(const char* pd, uint64_t word,
+                                               uint16_t qr) {
+  const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pd));
+  const uint64_t matches =
+      static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+          bytes, _mm256_set1_epi8(static_cast<char>(static_cast<uint8_t>(qr)))))) >>
+      kBodyOffset;
+  if (matches == 0) return false;
+
+  uint64_t begin, end;
+  if (!PdRun(word, qr >> 8, &begin, &end)) return false;
+  return (matches & ((uint64_t{1} << end) - (uint64_t{1} << begin))) != 0;
+}
+#endif  // LEVELDB_FILTER_SIMD_X86
+
+// Returns true if the PD overflowed and fingerprint qr is larger than any
+// it kept, so that only the spare can hold qr.
+inline bool InSpare(const char* pd, uint64_t word, uint16_t qr) {
+  if ((word & kNotOverflowedBit) != 0) return false;
+  const uint16_t largest = static_cast<uint16_t>(
+      ((word & (kNotOverflowedBit - 1)) << 8) | static_cast<uint8_t>(pd[kPdBytes - 1]));
+  return qr > largest;
+}
+
+// Appends the PD of fingerprints qrs[0,n-1], sorted and distinct, n at most
+// kMaxCapacity.  overflowed is true if larger fingerprints of the PD went to
+// the spare.
+void AppendPd(const uint16_t* qrs, size_t n, bool overflowed, std::string* dst) {
+  char pd[kPdBytes] = {0};
+  uint64_t header = 0;
+  uint64_t position = 0;
+  size_t i = 0;
+  for (uint64_t quot = 0; quot < kQuotients; quot++) {
+    for (; i < n && (qrs[i] >> 8) == quot; i++, position++) {
+      pd[kBodyOffset + i] = static_cast<char>(qrs[i]);
+    }
+    header |= uint64_t{1} << position++;
+  }
+
+  const uint64_t status = overflowed ? (qrs[n - 1] >> 8) : kNotOverflowedBit;
+  char word[sizeof(uint64_t)];
+  EncodeFixed64(word, (header << kPdHeaderShift) | status);
+  std::copy(word, word + kBodyOffset, pd);
+  dst->append(pd, kPdBytes);
+}
+
+// Key of the spare filter for fingerprint qr of PD pd_index.
+inline uint64_t SpareKey(uint32_t pd_index, uint16_t qr) {
+  return (static_cast<uint64_t>(pd_index) << 13) | qr;
+}
+
+}  // namespace
+
+// Filter layout, after the common adapter header (FilterEncoding.h):
+//    PD count       : fixed32
+//    padding length : 1 byte
+//    padding        : so that the PDs start kFilterBlockAlignment-aligned
+//    PDs            : PD count * 32 bytes
+//    spare          : the rest, the spare policy's filter over SpareKey()s
+//
+// Every key maps to one PD, which keeps the kMaxCapacity smallest
+// fingerprints mapped to it.  The larger ones go to the spare, and the PD
+// records the largest fingerprint it kept, so only keys with larger
+// fingerprints than that read the spare: about 6% of the keys at kPdLoad,
+// and every other lookup reads a single cache line.  The filters are built
+// from all keys at once, so unlike Prefix_Filter::Add() the PDs do not need
+// min_pd256.hpp's AVX-512 insertion path.
+class PrefixFilterPolicy : public FilterPolicy {
+ public:
+  static constexpr size_t kPrefixHeaderSize = sizeof(uint32_t) + 1;
+
+  // Same second level as the paper's PF[CF-12].
+  PrefixFilterPolicy()
+      : sparePolicy_(NewCuckooFilterPolicy(12)), simd_level_(FilterSimdLevelSupported()) {}
+
+  ~PrefixFilterPolicy() override { delete sparePolicy_; }
+
+  static uint64_t keyHash(const leveldb::Slice& key) {
+    return FilterKeyHash(key);
+  }
+
+  const char* Name() const override { return "PrefixFilterPolicy"; }
+
+  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
+    std::vector<uint64_t> hashes;
+    FilterKeyHashes(keys, n, &hashes);
+    CreateFilterFromHashes(hashes.data(), n, dst);
+  }
+
+  bool HashesKeys() const override { return true; }
+
+  uint64_t KeyHash(const leveldb::Slice& key) const override { return keyHash(key); }
+
+  void CreateFilterFromHashes(const uint64_t* hashes, int n, std::string* dst) const override {
+    if (n <= 0) return;
+
+    const uint32_t num_pds =
+        static_cast<uint32_t>(std::ceil(n / (kMaxCapacity * kPdLoad)));
+
+    // Sorting by SpareKey() groups the fingerprints by PD, in order.
+    std::vector<uint64_t> entries(n);
+    for (int i = 0; i < n; i++) {
+      entries[i] = SpareKey(PdIndex(hashes[i], num_pds), Fingerprint(hashes[i]));
+    }
+    std::sort(entries.begin(), entries.end());
+    entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+    PutFilterHeader(dst, kPrefixFilter);
+    const size_t padding =
+        AlignmentPadding(dst->size() + kPrefixHeaderSize, kFilterBlockAlignment);
+    PutFixed32(dst, num_pds);
+    dst->push_back(static_cast<char>(padding));
+    dst->append(padding, '\0');
+
+    std::vector<std::string> spare_keys;
+    std::vector<uint16_t> qrs;
+    size_t next = 0;
+    for (uint32_t pd_index = 0; pd_index < num_pds; pd_index++) {
+      qrs.clear();
+      bool overflowed = false;
+      for (; next < entries.size() && (entries[next] >> 13) == pd_index; next++) {
+        if (qrs.size() < kMaxCapacity) {
+          qrs.push_back(static_cast<uint16_t>(entries[next] & 0x1fff));
+        } else {
+          overflowed = true;
+          spare_keys.emplace_back(sizeof(uint64_t), '\0');
+          EncodeFixed64(&spare_keys.back()[0], entries[next]);
+        }
+      }
+      AppendPd(qrs.data(), qrs.size(), overflowed, dst);
+    }
+
+    if (!spare_keys.empty()) {
+      std::vector<Slice> spare_slices(spare_keys.begin(), spare_keys.end());
+      sparePolicy_->CreateFilter(spare_slices.data(),
+                                 static_cast<int>(spare_slices.size()), dst);
+    }
+  }
+
+  bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override {
+    bool result;
+    KeysMayMatch(&key, 1, filter, &result);
+    return result;
+  }
+
+  void KeysMayMatch(const leveldb::Slice* keys, int n, const leveldb::Slice& filter,
+                    bool* results) const override {
+    if (filter.empty()) {
+      std::fill(results, results + n, false);
+      return;
+    }
+
+    Table table;
+    if (!Decode(filter, &table)) {
+      std::fill(results, results + n, true);  // Errors are treated as potential matches
+      return;
+    }
+#if LEVELDB_FILTER_SIMD_X86
+    if (simd_level_ >= kFilterSimdAvx2) {
+      KeysMayMatchAvx2(table, keys, n, results);
+      return;
+    }
+#endif  // LEVELDB_FILTER_SIMD_X86
+    BatchKeysMayMatch(
+        keys, n, results,
+        [&](uint64_t key_hash) {
+          PrefetchFilterLine(table.pds + kPdBytes * PdIndex(key_hash, table.num_pds));
+        },
+        [&](uint64_t key_hash) { return Contains(table, key_hash); });
+  }
+
+ private:
+  struct Table {
+    const char* pds;
+    uint32_t num_pds;
+    Slice spare;
+  };
+
+  static bool Decode(const leveldb::Slice& filter, Table* table) {
+    Slice input = filter;
+    if (!GetFilterHeader(&input, kPrefixFilter) || input.size() < kPrefixHeaderSize) {
+      return false;
+    }
+
+    table->num_pds = DecodeFixed32(input.data());
+    const size_t padding = static_cast<uint8_t>(input[kPrefixHeaderSize - 1]);
+    const uint64_t pds_end = kPrefixHeaderSize + padding + uint64_t{kPdBytes} * table->num_pds;
+    if (table->num_pds == 0 || pds_end > input.size()) return false;
+
+    table->pds = input.data() + kPrefixHeaderSize + padding;
+    table->spare = Slice(input.data() + pds_end, input.size() - pds_end);
+    return true;
+  }
+
+  bool SpareContains(const Table& table, uint32_t pd_index, uint16_t qr) const {
+    char spare_key[sizeof(uint64_t)];
+    EncodeFixed64(spare_key, SpareKey(pd_index, qr));
+    return sparePolicy_->KeyMayMatch(Slice(spare_key, sizeof(spare_key)), table.spare);
+  }
+
+  bool Contains(const Table& table, uint64_t key_hash) const {
+    const uint32_t pd_index = PdIndex(key_hash, table.num_pds);
+    const uint16_t qr = Fingerprint(key_hash);
+    const char* pd = table.pds + kPdBytes * pd_index;
+    const uint64_t word = DecodeFixed64(pd);
+    if (InSpare(pd, word, qr)) return SpareContains(table, pd_index, qr);
+    return PdContains(pd, word, qr);
+  }
+
+#if LEVELDB_FILTER_SIMD_X86
+  LEVELDB_TARGET_AVX2 bool ContainsAvx2(const Table& table, uint64_t key_hash) const {
+    const uint32_t pd_index = PdIndex(key_hash, table.num_pds);
+    const uint16_t qr = Fingerprint(key_hash);
+    const char* pd = table.pds + kPdBytes * pd_index;
+    const uint64_t word = DecodeFixed64(pd);
+    if (InSpare(pd, word, qr)) return SpareContains(table, pd_index, qr);
+    return PdContainsAvx2(pd, word, qr);
+  }
+
+  // BatchKeysMayMatch() spelled out: its callbacks would not be compiled for
+  // AVX2, so ContainsAvx2() could not be inlined into them.
+  LEVELDB_TARGET_AVX2 void KeysMayMatchAvx2(const Table& table, const leveldb::Slice* keys,
+                                            int n, bool* results) const {
+    uint64_t hashes[kFilterProbeBatch];
+    for (int start = 0; start < n; start += kFilterProbeBatch) {
+      const int count = std::min(kFilterProbeBatch, n - start);
+      for (int i = 0; i < count; i++) {
+        hashes[i] = FilterKeyHash(keys[start + i]);
+        PrefetchFilterLine(table.pds + kPdBytes * PdIndex(hashes[i], table.num_pds));
+      }
+      for (int i = 0; i < count; i++) {
+        results[start + i] = ContainsAvx2(table, hashes[i]);
+      }
+    }
+  }
+#endif  // LEVELDB_FILTER_SIMD_X86
+
+  static size_t AlignmentPadding(size_t offset, size_t alignment) {
+    return (alignment - offset % alignment) % alignment;
+  }
+
+  const FilterPolicy* const sparePolicy_;
+  const FilterSimdLevel simd_level_;
+};
+
+const FilterPolicy* NewPrefixFilterPolicy() {
+  return new PrefixFilterPolicy();
+}
+
+}  // namespace leveldb
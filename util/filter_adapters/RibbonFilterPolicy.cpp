@@ -2,149 +2,197 @@
 // Created by Maciej Gajek on 30/03/2023.
 //
 
-#include <iostream>
-#include <memory>
+#include <algorithm>
+#include <cmath>
 
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
 
-#include "util/MurmurHash3.h"
-//#include "util/filter_adapters/ribbon/ribbon_serialization.h"
-#include "util/filter_adapters/ribbon/BalancedRibbonFilter.h"
-#include "util/filter_adapters/XorFilterPolicy.h"
+#include "util/coding.h"
+#include "util/filter_adapters/FilterEncoding.h"
+#include "util/filter_adapters/FilterPolicyAdapter.h"
+#include "util/filter_adapters/ribbon/ribbon_serialization.h"
 
 namespace leveldb {
+namespace {
+
+// Filter layout, after the common adapter header (FilterEncoding.h):
+//    kind            : 1 byte, kStandard128 or kBloom
+// kStandard128 is followed by
+//    seed            : 1 byte
+//    num_blocks      : fixed32
+//    solution        : the rest of the filter, 16-byte segments
+// and kBloom by
+//    num_probes      : 1 byte
+//    bits            : the rest of the filter
+//
+// Kinds 0 and 1, the balanced Ribbon and its xor fallback of earlier
+// releases, are no longer read; their tables see potential matches until
+// they are compacted.
+enum RibbonKind { kStandard128 = 2, kBloom = 3 };
+static constexpr size_t kStandard128HeaderSize = 1 + sizeof(uint32_t);
+
+// The Bloom kind probes num_probes bits selected by the upper bits of hash,
+// hash * kMul, hash * kMul^2, ...; the multiplications keep the upper bits
+// well mixed while the low bits a modulus would use are not.
+static constexpr uint64_t kMul = 0x9e3779b97f4a7c15ULL;
+
+inline uint64_t BitPosition(uint64_t h, uint64_t bits) {
+  return static_cast<uint64_t>((static_cast<__uint128_t>(h) * bits) >> 64);
+}
 
-class RibbonFilterPolicy : public FilterPolicy {
+// Probes either kind of filter in place.
+class RibbonFilterView {
  public:
+  bool Open(Slice input) {
+    if (input.empty()) return false;
+    kind_ = static_cast<uint8_t>(input[0]);
+    input.remove_prefix(1);
+
+    if (kind_ == kBloom) {
+      if (input.size() <= 1) return false;
+      num_probes_ = static_cast<uint8_t>(input[0]);
+      input.remove_prefix(1);
+      bloom_bits_ = input;
+      return true;
+    }
 
-  static uint64_t keyHash(const leveldb::Slice& key) {
-
-    uint64_t hash_value = 0;
-
-    MurmurHash3_x86_32((void*) key.data(), key.size(), 1e9 + 9, &hash_value);
+    if (kind_ != kStandard128 || input.size() < kStandard128HeaderSize) return false;
+    const uint32_t seed = static_cast<uint8_t>(input[0]);
+    const uint64_t num_blocks = DecodeFixed32(input.data() + 1);
+    input.remove_prefix(kStandard128HeaderSize);
 
-    return hash_value;
+    // Between one and 32 columns of 16-byte segments per block.
+    const uint64_t num_segments = input.size() / Standard128RibbonBitsBuilder::kSegmentBytes;
+    if (num_blocks < 2 || num_blocks * 128 > UINT32_MAX ||
+        input.size() % Standard128RibbonBitsBuilder::kSegmentBytes != 0 ||
+        num_segments < num_blocks || num_segments > num_blocks * 32) {
+      return false;
+    }
+    reader_.Reset(input.data(), input.size(), static_cast<uint32_t>(num_blocks), seed);
+    return true;
   }
 
-  const char* Name() const override { return "Ribbon"
-                                             "]06FilterPolicy"; }
+  bool MayContain(uint64_t hash) const {
+    if (kind_ == kStandard128) return reader_.HashMayMatch(hash);
 
-  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
-//    Standard128RibbonBitsBuilder builder(0.03, true);
-//
-//    for (int i = 0; i < n; ++i) {
-//      builder.AddKey(keyHash(keys[i]));
-//    }
-//
-//    const size_t init_size = dst->size();
-//    const size_t additional_size = builder.CalculateSpace(n);
-//
-//    dst->resize(init_size + additional_size, 0);
-//
-//    std::unique_ptr<const char[]> buffer(&(*dst)[init_size]);
-//
-//    builder.Finish(&buffer);
-    if (n <= 0) return;
+    const uint64_t bits = bloom_bits_.size() * 8;
+    uint64_t h = hash;
+    for (int j = 0; j < num_probes_; j++) {
+      const uint64_t bitpos = BitPosition(h, bits);
+      if ((bloom_bits_[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
+      h *= kMul;
+    }
+    return true;
+  }
 
-    if (n < 1400 || n > 950000000) {
-      const size_t init_size = dst->size();
+  void Prefetch(uint64_t hash) const {
+    if (kind_ == kStandard128) reader_.Prefetch(hash);
+  }
 
-      const size_t additional_size = sizeof(uint8_t);
+ private:
+  int kind_ = 0;
+  int num_probes_ = 0;
+  Slice bloom_bits_;
+  Standard128RibbonBitsReader reader_;
+};
 
-      dst->resize(init_size + additional_size, 0);
+// Both kinds are sized for bits_per_key bits per distinct key, which need
+// not be a whole number.  A Standard128 Ribbon needs at least 256 slots and,
+// for a few hundred keys, noticeably more slots than keys, so small filters
+// that would be worse than a Bloom filter of the same size are built as one.
+class RibbonFilterTraits {
+ public:
+  typedef RibbonFilterView View;
 
-      uint8_t* filter_type_ptr = (uint8_t*) &(*dst)[init_size];
-      *filter_type_ptr = 1;
+  explicit RibbonFilterTraits(double bits_per_key)
+      : bits_per_key_(std::max(1.0, std::min(bits_per_key, 32.0))),
+        num_probes_(std::max(1, std::min(static_cast<int>(bits_per_key_ * 0.69), 30))) {}
 
-      fallbackPolicy_->CreateFilter(keys, n, dst);
-    } else {
-      BalancedRibbonFilter<uint64_t, 8, 0> filter(n);
+  static const char* Name() { return "RibbonFilterPolicy"; }
 
-      std::vector<uint64_t> vec(n);
+  void Build(const uint64_t* hashes, int n, std::string* dst) const {
+    if (n <= 0) return;
 
-      for (int i = 0; i < n; ++i) {
-        vec[i] = keyHash(keys[i]);
+    Standard128RibbonBitsBuilder builder;
+    for (int i = 0; i < n; ++i) {
+      builder.AddKey(hashes[i]);
+    }
+    const size_t num_entries = builder.NumEntries();
+
+    if (num_entries <= Standard128RibbonBitsBuilder::kMaxEntries) {
+      const uint32_t num_slots =
+          Standard128RibbonBitsBuilder::NumSlots(static_cast<uint32_t>(num_entries));
+      const size_t len = Standard128RibbonBitsBuilder::SolutionBytes(
+          static_cast<uint32_t>(num_entries), num_slots, bits_per_key_);
+      if (len > 0 && Standard128RibbonBitsBuilder::ExpectedFpRate(num_slots, len) <=
+                         BloomFpRate(num_entries)) {
+        const size_t init_size = dst->size();
+        PutFilterHeader(dst, kRibbonFilter);
+        dst->push_back(static_cast<char>(kStandard128));
+        dst->push_back(0);  // Seed, set below
+        PutFixed32(dst, num_slots / 128);
+
+        const size_t offset = dst->size();
+        dst->resize(offset + len);
+        uint32_t seed;
+        if (builder.Finish(num_slots, &(*dst)[offset], len, &seed)) {
+          (*dst)[offset - kStandard128HeaderSize] = static_cast<char>(seed);
+          return;
+        }
+        // No seed solved the keys, fall back to Bloom.
+        dst->resize(init_size);
       }
+    }
 
-      filter.AddAll(vec, 0, vec.size());
-
-      using SolnT = BalancedRibbonFilter<uint64_t, 8, 0>::InterleavedSoln;
-
-      const size_t init_size = dst->size();
-      const size_t additional_size = sizeof(uint8_t) + sizeof(uint32_t) +
-                                     2 * sizeof(size_t) + sizeof(SolnT) +
-                                     filter.SizeInBytes();
-
-      dst->resize(init_size + additional_size, 0);
-
-      uint8_t* filter_type_ptr = (uint8_t*)&(*dst)[init_size];
-      uint32_t* log2_vshards_ptr = (uint32_t*)(filter_type_ptr + 1);
-      SolnT* soln_ptr = (SolnT*)(log2_vshards_ptr + 1);
-      size_t* num_slots_ptr = (size_t*)(soln_ptr + 1);
-      size_t* meta_len_ptr = num_slots_ptr + 1;
-      uint8_t* meta_ptr = (uint8_t*)meta_len_ptr + sizeof(size_t);
-      uint8_t* bytes_ptr = meta_ptr + filter.meta_bytes;
+    BuildBloom(hashes, n, num_entries, dst);
+  }
 
-      *filter_type_ptr = 0;
-      *log2_vshards_ptr = filter.log2_vshards;
-      std::memcpy(soln_ptr, &filter.soln, sizeof(SolnT));
-      *num_slots_ptr = filter.num_slots;
-      *meta_len_ptr = filter.meta_bytes;
-      std::memcpy(meta_ptr, filter.meta_ptr.get(), filter.meta_bytes);
-      std::memcpy(bytes_ptr, filter.ptr.get(), filter.bytes);
-    }
+  static bool Open(const Slice& filter, View* view) {
+    Slice input = filter;
+    return GetFilterHeader(&input, kRibbonFilter) && view->Open(input);
   }
 
-  bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override {
-    if (filter.empty())
-      return false;
+ private:
+  // Bits of a Bloom filter for num_entries keys, at least 64 so that tiny
+  // filters do not have a very high false positive rate.
+  size_t BloomBits(size_t num_entries) const {
+    const size_t bits = static_cast<size_t>(std::ceil(num_entries * bits_per_key_));
+    return (std::max<size_t>(bits, 64) + 7) / 8 * 8;
+  }
 
-    uint8_t* filter_type_ptr = (uint8_t*) filter.data();
-    uint8_t filter_type = *filter_type_ptr;
+  double BloomFpRate(size_t num_entries) const {
+    const double keys_per_bit = static_cast<double>(num_entries) / BloomBits(num_entries);
+    return std::pow(1.0 - std::exp(-num_probes_ * keys_per_bit), num_probes_);
+  }
 
-    if (filter_type == 1) {
-      return fallbackPolicy_->KeyMayMatch(key, leveldb::Slice(&(filter.data()[1]), filter.size()-1));
+  void BuildBloom(const uint64_t* hashes, int n, size_t num_entries, std::string* dst) const {
+    const uint64_t bits = BloomBits(num_entries);
+    PutFilterHeader(dst, kRibbonFilter);
+    dst->push_back(static_cast<char>(kBloom));
+    dst->push_back(static_cast<char>(num_probes_));
+
+    const size_t offset = dst->size();
+    dst->resize(offset + bits / 8, 0);
+    char* array = &(*dst)[offset];
+    for (int i = 0; i < n; i++) {
+      uint64_t h = hashes[i];
+      for (int j = 0; j < num_probes_; j++) {
+        const uint64_t bitpos = BitPosition(h, bits);
+        array[bitpos / 8] |= (1 << (bitpos % 8));
+        h *= kMul;
+      }
     }
-
-    using SolnT = BalancedRibbonFilter<uint64_t, 8, 0>::InterleavedSoln;
-
-    uint32_t* log2_vshards_ptr = (uint32_t*) (filter_type_ptr+1);
-    SolnT* soln_ptr = (SolnT*) (log2_vshards_ptr + 1);
-    size_t* num_slots_ptr = (size_t*) (soln_ptr + 1);
-    size_t* meta_len_ptr = num_slots_ptr + 1;
-
-    auto meta_len = *meta_len_ptr;
-
-    char* meta_ptr = (char*) meta_len_ptr + sizeof(size_t);
-    char* bytes_ptr = meta_ptr + meta_len;
-
-    BalancedRibbonFilter<uint64_t, 8, 0> ribbon(
-        *log2_vshards_ptr,
-        *num_slots_ptr,
-        bytes_ptr,
-        filter.size() - (sizeof(uint8_t) + sizeof(uint32_t) + 2* sizeof(size_t) + sizeof(SolnT) + meta_len),
-        meta_ptr,
-        meta_len
-        );
-
-    ribbon.soln.num_starts_ = soln_ptr->num_starts_;
-    ribbon.soln.upper_num_columns_ = soln_ptr->upper_num_columns_;
-    ribbon.soln.upper_start_block_ = soln_ptr->upper_start_block_;
-
-    auto res = ribbon.Contain(keyHash(key));
-
-    ribbon.meta_ptr.release();
-    ribbon.ptr.release();
-
-    return res;
   }
 
-  const FilterPolicy* fallbackPolicy_ = NewXorFilterPolicy(8);
+  double bits_per_key_;
+  int num_probes_;
 };
 
-const FilterPolicy* NewRibbonFilterPolicy() {
-  return new RibbonFilterPolicy();
+}  // namespace
+
+const FilterPolicy* NewRibbonFilterPolicy(double bits_per_key) {
+  return new FilterPolicyAdapter<RibbonFilterTraits>(RibbonFilterTraits(bits_per_key));
 }
 
-}  // namespace leveldb
\ No newline at end of file
+}  // namespace leveldb
@@ -0,0 +1,256 @@
+//
+// Semi-sorted cuckoo table buckets, the "packed" table of the vacuum filter.
+//
+
+#ifndef LEVELDB_SEMISORTEDTABLE_H
+#define LEVELDB_SEMISORTEDTABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "leveldb/slice.h"
+
+#include "util/coding.h"
+#include "util/filter_adapters/CuckooTableView.h"
+#include "util/filter_adapters/FilterProbeBatch.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+// A bucket holds four tags.  Sorting them by their low 4 bits leaves one of
+// only C(16 + 3, 4) = 3876 multisets of low bits, which fits a 12-bit
+// codeword instead of 16 bits: one bit saved per tag.
+//
+// Bucket layout, kBitsPerBucket = 12 + 4 * (bits_per_tag - 4) bits starting
+// at bit kBitsPerBucket * i of the little-endian bucket array:
+//    bits [0, 12)  : codeword, the rank of the sorted low bits among all
+//                    non-decreasing 4-tuples of 4-bit values in
+//                    lexicographic order
+//    then for j = 0..3 the upper bits_per_tag - 4 bits of the j-th tag in
+//    that order
+// An all-zero bucket is four empty (0) tags.  This is the layout that
+// modifiedcuckoofilter::PackedTable writes on little-endian machines.
+class SemiSortCodec {
+ public:
+  static constexpr size_t kCodewords = 3876;
+
+  // Built on first use, once per process.
+  static const SemiSortCodec& Get() {
+    static const SemiSortCodec codec;
+    return codec;
+  }
+
+  // Sorted low bits of a codeword, tag j's in bits [4 * j, 4 * j + 4).
+  uint16_t Decode(uint32_t codeword) const { return decode_[codeword]; }
+
+  // Codeword of sorted low bits packed like Decode() returns them.
+  uint16_t Encode(uint16_t low_bits) const { return encode_[low_bits]; }
+
+ private:
+  SemiSortCodec() {
+    uint16_t codeword = 0;
+    for (int a = 0; a < 16; a++)
+      for (int b = a; b < 16; b++)
+        for (int c = b; c < 16; c++)
+          for (int d = c; d < 16; d++) {
+            const uint16_t low_bits = a | (b << 4) | (c << 8) | (d << 12);
+            decode_[codeword] = low_bits;
+            encode_[low_bits] = codeword++;
+          }
+  }
+
+  uint16_t decode_[kCodewords];
+  uint16_t encode_[1 << 16];
+};
+
+template <size_t bits_per_tag>
+struct SemiSortedBucket {
+  static_assert(bits_per_tag >= 5 && bits_per_tag <= 17 && bits_per_tag % 2 == 1,
+                "buckets must be whole bytes of at most 64 bits");
+
+  static constexpr size_t kDirBitsPerTag = bits_per_tag - 4;
+  static constexpr size_t kBitsPerBucket = 12 + 4 * kDirBitsPerTag;
+  static constexpr size_t kBytesPerBucket = kBitsPerBucket / 8;
+  static constexpr uint64_t kDirMask = (uint64_t{1} << kDirBitsPerTag) - 1;
+
+  // Reads bucket i, which may be followed by tail padding only: the load is
+  // always a whole uint64.
+  static uint64_t Load(const char* buckets, size_t i) {
+    const uint64_t word = DecodeFixed64(buckets + i * kBytesPerBucket);
+    return kBitsPerBucket == 64 ? word : word & ((uint64_t{1} << kBitsPerBucket) - 1);
+  }
+
+  static void Store(char* buckets, size_t i, uint64_t bits) {
+    char* p = buckets + i * kBytesPerBucket;
+    if (kBitsPerBucket != 64) {
+      bits |= DecodeFixed64(p) & ~((uint64_t{1} << kBitsPerBucket) - 1);
+    }
+    EncodeFixed64(p, bits);
+  }
+
+  static void Decode(const SemiSortCodec& codec, uint64_t bits, uint32_t tags[4]) {
+    const uint16_t low_bits = codec.Decode(bits & 0xfff);
+    for (int j = 0; j < 4; j++) {
+      tags[j] = ((low_bits >> (4 * j)) & 0xf) |
+                static_cast<uint32_t>(((bits >> (12 + kDirBitsPerTag * j)) & kDirMask) << 4);
+    }
+  }
+
+  // Sorts tags by their low bits, with the comparators of PackedTable so that
+  // equal low bits keep the same order, and encodes them.
+  static uint64_t Encode(const SemiSortCodec& codec, uint32_t tags[4]) {
+    SortPair(&tags[0], &tags[2]);
+    SortPair(&tags[1], &tags[3]);
+    SortPair(&tags[0], &tags[1]);
+    SortPair(&tags[2], &tags[3]);
+    SortPair(&tags[1], &tags[2]);
+
+    uint16_t low_bits = 0;
+    uint64_t bits = 0;
+    for (int j = 0; j < 4; j++) {
+      low_bits |= (tags[j] & 0xf) << (4 * j);
+      bits |= static_cast<uint64_t>(tags[j] >> 4) << (12 + kDirBitsPerTag * j);
+    }
+    return bits | codec.Encode(low_bits);
+  }
+
+  static void SortPair(uint32_t* a, uint32_t* b) {
+    if ((*a & 0xf) > (*b & 0xf)) {
+      const uint32_t t = *a;
+      *a = *b;
+      *b = t;
+    }
+  }
+};
+
+// Semi-sorted table for building a modifiedcuckoofilter::VacuumFilter<...,
+// SemiSortedTable, ...>, in place of the library's PackedTable, which builds
+// its own encoding tables for every table and stores buckets in native byte
+// order.  Provides the members the filter's Add() and AppendCuckooTable()
+// use.
+template <size_t bits_per_tag>
+class SemiSortedTable {
+ public:
+  typedef SemiSortedBucket<bits_per_tag> Bucket;
+  static constexpr size_t kBytesPerBucket = Bucket::kBytesPerBucket;
+
+  explicit SemiSortedTable(size_t num_buckets)
+      : num_buckets_(num_buckets),
+        buckets_(new char[kBytesPerBucket * num_buckets +
+                          CuckooTableHeader::kTailPadding]()),
+        codec_(SemiSortCodec::Get()),
+        rnd_(0xdeadbeef) {}
+
+  SemiSortedTable(const SemiSortedTable&) = delete;
+  SemiSortedTable& operator=(const SemiSortedTable&) = delete;
+
+  ~SemiSortedTable() { delete[] buckets_; }
+
+  size_t NumBuckets() const { return num_buckets_; }
+  size_t SizeInTags() const { return 4 * num_buckets_; }
+  size_t SizeInBytes() const { return kBytesPerBucket * num_buckets_; }
+
+  void ReadBucket(size_t i, uint32_t tags[4]) const {
+    Bucket::Decode(codec_, Bucket::Load(buckets_, i), tags);
+  }
+
+  // The filter passes the slot it replaced; the bucket is re-sorted anyway.
+  void WriteBucket(size_t i, uint32_t tags[4], bool /*sort*/ = true, int /*pos*/ = 4) {
+    Bucket::Store(buckets_, i, Bucket::Encode(codec_, tags));
+  }
+
+  bool FindTagInBucket(size_t i, uint32_t tag) const {
+    uint32_t tags[4];
+    ReadBucket(i, tags);
+    return tags[0] == tag || tags[1] == tag || tags[2] == tag || tags[3] == tag;
+  }
+
+  bool DeleteTagFromBucket(size_t i, uint32_t tag) {
+    uint32_t tags[4];
+    ReadBucket(i, tags);
+    for (int j = 0; j < 4; j++) {
+      if (tags[j] == tag) {
+        tags[j] = 0;
+        WriteBucket(i, tags);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Same contract as PackedTable::InsertTagToBucket(): *tags receives the
+  // bucket's tags as they were before the insertion.
+  bool InsertTagToBucket(size_t i, uint32_t tag, bool kickout, uint32_t& oldtag,
+                         uint32_t* tags) {
+    ReadBucket(i, tags);
+    for (int j = 0; j < 4; j++) {
+      if (tags[j] == 0) {
+        tags[j] = tag;
+        WriteBucket(i, tags);
+        return true;
+      }
+    }
+    if (kickout) {
+      // Each table draws its victims from its own generator, so tables built
+      // concurrently do not share state and every build is reproducible.
+      const int r = rnd_.Uniform(4);
+      oldtag = tags[r];
+      tags[r] = tag;
+      WriteBucket(i, tags);
+    }
+    return false;
+  }
+
+  std::string Info() const { return "SemiSortedTable"; }
+
+  size_t num_buckets_;
+  char* buckets_;
+
+ private:
+  const SemiSortCodec& codec_;
+  Random rnd_;
+};
+
+// Probes the buckets written by SemiSortedTable, for VacuumTableView.  The
+// encoding tables are shared by the whole process, so opening a view costs
+// no more than for unpacked tables.
+template <size_t bits_per_tag>
+class SemiSortedTableView {
+ public:
+  typedef SemiSortedBucket<bits_per_tag> Bucket;
+  static constexpr size_t kBytesPerBucket = Bucket::kBytesPerBucket;
+
+  SemiSortedTableView() : buckets_(nullptr), codec_(nullptr) {}
+
+  // Points the view at the num_buckets buckets at the front of *input, and
+  // consumes them and the tail padding.  Returns false if *input is short.
+  bool Init(uint32_t num_buckets, Slice* input) {
+    const size_t needed = kBytesPerBucket * static_cast<size_t>(num_buckets) +
+                          CuckooTableHeader::kTailPadding;
+    if (input->size() < needed) return false;
+    buckets_ = input->data();
+    codec_ = &SemiSortCodec::Get();
+    input->remove_prefix(needed);
+    return true;
+  }
+
+  void PrefetchBucket(size_t i) const {
+    PrefetchFilterLine(buckets_ + i * kBytesPerBucket);
+  }
+
+  bool FindTagInBucket(size_t i, uint32_t tag) const {
+    uint32_t tags[4];
+    Bucket::Decode(*codec_, Bucket::Load(buckets_, i), tags);
+    return tags[0] == tag || tags[1] == tag || tags[2] == tag || tags[3] == tag;
+  }
+
+ private:
+  const char* buckets_;
+  const SemiSortCodec* codec_;
+};
+
+}  // namespace leveldb
+
+#endif  // LEVELDB_SEMISORTEDTABLE_H
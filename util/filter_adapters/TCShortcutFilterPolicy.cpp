@@ -0,0 +1,420 @@
+//
+// Two-choicer (TC) filter adapter over the PD layout of
+// fastfilter_cpp/src/tc-shortcut.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+
+#include "util/coding.h"
+#include "util/filter_adapters/FilterEncoding.h"
+#include "util/filter_adapters/FilterKeyHash.h"
+#include "util/filter_adapters/FilterProbeBatch.h"
+#include "util/filter_adapters/FilterSimd.h"
+
+#if LEVELDB_FILTER_SIMD_X86 || defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+namespace leveldb {
+
+namespace {
+
+// A pocket dictionary (PD) is a 64-byte bin holding a header of, for every
+// quotient, a 0 bit per remainder followed by a 1 bit, and then up to
+// kCapacity remainders ordered by quotient.
+
+// tc-sym.hpp's PD: 80 quotients and 48 8-bit remainders behind a 128-bit
+// header.
+struct TCPd8 {
+  typedef uint8_t Remainder;
+  static const FilterType kType = kTCShortcut8Filter;
+  static const uint64_t kQuotients = 80;
+  static const uint64_t kCapacity = 48;
+  static const size_t kHeaderBytes = 16;
+  static const uint64_t kShortcutThreshold = 36;
+};
+
+// The vector quotient filter's 16-bit block: 36 quotients and 28 16-bit
+// remainders behind a 64-bit header.
+struct TCPd16 {
+  typedef uint16_t Remainder;
+  static const FilterType kType = kTCShortcut16Filter;
+  static const uint64_t kQuotients = 36;
+  static const uint64_t kCapacity = 28;
+  static const size_t kHeaderBytes = 8;
+  static const uint64_t kShortcutThreshold = 21;
+};
+
+static const size_t kPdBytes = 64;
+
+// PDs are sized for this load, as in the fastfilter benchmarks.
+static const double kPdLoad = 0.935;
+
+// Position of the j-th (from 0) set bit of x, or 64 if x has no more than j.
+inline uint64_t Select64(uint64_t x, uint64_t j) {
+#ifdef __BMI2__
+  x = _pdep_u64(uint64_t{1} << j, x);
+#else
+  for (; j > 0 && x != 0; j--) x &= x - 1;
+#endif  // __BMI2__
+  return x == 0 ? 64 : __builtin_ctzll(x);
+}
+
+inline uint64_t Select128(uint64_t lo, uint64_t hi, uint64_t j) {
+  const uint64_t lo_ones = __builtin_popcountll(lo);
+  return j < lo_ones ? Select64(lo, j) : 64 + Select64(hi, j - lo_ones);
+}
+
+// Returns false only if no remainder slot of the PD holds rem, testing
+// eight bytes at a time.
+inline bool MayHoldRemainder(const char* pd, uint8_t rem, size_t header_bytes) {
+  const uint64_t pattern = 0x0101010101010101ull * rem;
+  for (size_t offset = header_bytes; offset < kPdBytes; offset += 8) {
+    const uint64_t x = DecodeFixed64(pd + offset) ^ pattern;
+    if (((x - 0x0101010101010101ull) & ~x & 0x8080808080808080ull) != 0) return true;
+  }
+  return false;
+}
+
+inline bool MayHoldRemainder(const char* pd, uint16_t rem, size_t header_bytes) {
+  const uint64_t pattern = 0x0001000100010001ull * rem;
+  for (size_t offset = header_bytes; offset < kPdBytes; offset += 8) {
+    const uint64_t x = DecodeFixed64(pd + offset) ^ pattern;
+    if (((x - 0x0001000100010001ull) & ~x & 0x8000800080008000ull) != 0) return true;
+  }
+  return false;
+}
+
+inline uint8_t LoadRemainder(const char* p, uint8_t) { return static_cast<uint8_t>(*p); }
+
+inline uint16_t LoadRemainder(const char* p, uint16_t) {
+  return static_cast<uint16_t>(static_cast<uint8_t>(p[0]) |
+                               (static_cast<uint8_t>(p[1]) << 8));
+}
+
+#if LEVELDB_FILTER_SIMD_X86
+// Bit i is set if remainder slot i of the PD holds rem.
+LEVELDB_TARGET_AVX2 inline uint64_t MatchMask(const char* pd, uint8_t rem,
+                                              size_t header_bytes) {
+  const __m256i target = _mm256_set1_epi8(static_cast<char>(rem));
+  const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pd));
+  const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pd + 32));
+  const uint64_t mask =
+      static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, target))) |
+      static_cast<uint64_t>(static_cast<uint32_t>(
+          _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, target)))) << 32;
+  return mask >> header_bytes;
+}
+
+LEVELDB_TARGET_AVX2 inline uint64_t MatchMask(const char* pd, uint16_t rem,
+                                              size_t header_bytes) {
+  const __m256i target = _mm256_set1_epi16(static_cast<int16_t>(rem));
+  const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pd));
+  const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pd + 32));
+  // Narrow the 16-bit compare results to bytes; packs interleaves the
+  // 128-bit lanes of its operands, which the permute undoes.
+  const __m256i packed = _mm256_permute4x64_epi64(
+      _mm256_packs_epi16(_mm256_cmpeq_epi16(lo, target), _mm256_cmpeq_epi16(hi, target)),
+      0xd8);
+  return static_cast<uint32_t>(_mm256_movemask_epi8(packed)) >> (header_bytes / 2);
+}
+#endif  // LEVELDB_FILTER_SIMD_X86
+
+inline void StoreRemainder(char* p, uint8_t rem) { *p = static_cast<char>(rem); }
+
+inline void StoreRemainder(char* p, uint16_t rem) {
+  p[0] = static_cast<char>(rem);
+  p[1] = static_cast<char>(rem >> 8);
+}
+
+}  // namespace
+
+// Filter layout, after the common adapter header (FilterEncoding.h):
+//    PD count       : fixed32, even
+//    padding length : 1 byte
+//    padding        : so that the PDs start kFilterBlockAlignment-aligned
+//    PDs            : PD count * 64 bytes
+//
+// A key's fingerprint is stored in one of two PDs: its primary one if that
+// holds fewer than kShortcutThreshold fingerprints (tc-shortcut.hpp's
+// shortcut), else the emptier of the two.  Lookups read both PDs in place,
+// two cache lines, without decoding or copying the filter.
+template <typename Pd>
+class TCShortcutFilterPolicy : public FilterPolicy {
+ public:
+  typedef typename Pd::Remainder Remainder;
+  static constexpr size_t kTCHeaderSize = sizeof(uint32_t) + 1;
+  static constexpr int kRemainderBits = 8 * sizeof(Remainder);
+
+  TCShortcutFilterPolicy() : simd_level_(FilterSimdLevelSupported()) {}
+
+  static uint64_t keyHash(const leveldb::Slice& key) {
+    return FilterKeyHash(key);
+  }
+
+  const char* Name() const override {
+    return kRemainderBits == 16 ? "TCShortcutFilterPolicy16" : "TCShortcutFilterPolicy8";
+  }
+
+  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
+    std::vector<uint64_t> hashes;
+    FilterKeyHashes(keys, n, &hashes);
+    CreateFilterFromHashes(hashes.data(), n, dst);
+  }
+
+  bool HashesKeys() const override { return true; }
+
+  uint64_t KeyHash(const leveldb::Slice& key) const override { return keyHash(key); }
+
+  void CreateFilterFromHashes(const uint64_t* hashes, int n, std::string* dst) const override {
+    if (n <= 0) return;
+
+    uint32_t num_pds = EvenPdCount(std::ceil(n / (Pd::kCapacity * kPdLoad)));
+    std::vector<uint64_t> placed;
+    while (!Place(hashes, n, num_pds, &placed)) {
+      num_pds = EvenPdCount(num_pds * 1.1);
+    }
+
+    PutFilterHeader(dst, Pd::kType);
+    const size_t padding =
+        AlignmentPadding(dst->size() + kTCHeaderSize, kFilterBlockAlignment);
+    PutFixed32(dst, num_pds);
+    dst->push_back(static_cast<char>(padding));
+    dst->append(padding, '\0');
+
+    size_t next = 0;
+    std::vector<uint32_t> qrs;
+    for (uint32_t pd_index = 0; pd_index < num_pds; pd_index++) {
+      qrs.clear();
+      for (; next < placed.size() && (placed[next] >> 32) == pd_index; next++) {
+        qrs.push_back(static_cast<uint32_t>(placed[next]));
+      }
+      AppendPd(qrs, dst);
+    }
+  }
+
+  bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override {
+    bool result;
+    KeysMayMatch(&key, 1, filter, &result);
+    return result;
+  }
+
+  void KeysMayMatch(const leveldb::Slice* keys, int n, const leveldb::Slice& filter,
+                    bool* results) const override {
+    if (filter.empty()) {
+      std::fill(results, results + n, false);
+      return;
+    }
+
+    Table table;
+    if (!Decode(filter, &table)) {
+      std::fill(results, results + n, true);  // Errors are treated as potential matches
+      return;
+    }
+#if LEVELDB_FILTER_SIMD_X86
+    if (simd_level_ >= kFilterSimdAvx2) {
+      KeysMayMatchAvx2(table, keys, n, results);
+      return;
+    }
+#endif  // LEVELDB_FILTER_SIMD_X86
+    BatchKeysMayMatch(
+        keys, n, results, [&](uint64_t key_hash) { Prefetch(table, key_hash); },
+        [&](uint64_t key_hash) { return Contains(table, key_hash); });
+  }
+
+ private:
+  struct Table {
+    const char* pds;
+    uint32_t num_pds;
+  };
+
+  static uint32_t EvenPdCount(double count) {
+    const uint32_t pds = std::max<uint32_t>(2, static_cast<uint32_t>(count));
+    return pds + (pds & 1);
+  }
+
+  static uint32_t PdIndex(uint64_t hash, uint32_t num_pds) {
+    return static_cast<uint32_t>((static_cast<uint64_t>(hash >> 32) * num_pds) >> 32);
+  }
+
+  // Maps the low 32 bits of hash onto [0, kQuotients << kRemainderBits).
+  static uint32_t Fingerprint(uint64_t hash) {
+    return static_cast<uint32_t>(
+        (static_cast<uint64_t>(static_cast<uint32_t>(hash)) *
+         (Pd::kQuotients << kRemainderBits)) >> 32);
+  }
+
+  // tc-shortcut.hpp's get_alt_index_cf_stable(): an odd offset from the end
+  // of an even number of PDs, so the alternate PD differs from pd_index and
+  // its own alternate is pd_index.
+  static uint32_t AltPdIndex(uint32_t pd_index, uint32_t qr, uint32_t num_pds) {
+    const uint64_t hash = qr * 0xc4ceb9fe1a85ec53ull;
+    const uint32_t offset = static_cast<uint32_t>(
+        ((hash & 0xffffffffull) * (num_pds >> 1)) >> 32) * 2 + 1;
+    int64_t alt = static_cast<int64_t>(num_pds) - pd_index - offset;
+    if (alt < 0) alt += num_pds;
+    return static_cast<uint32_t>(alt);
+  }
+
+  // Assigns every distinct (primary PD, fingerprint) pair of hashes to one
+  // of its PDs, in *placed as (PD << 32) | fingerprint, sorted.  Returns
+  // false if both PDs of a fingerprint are full.
+  static bool Place(const uint64_t* hashes, int n, uint32_t num_pds,
+                    std::vector<uint64_t>* placed) {
+    placed->resize(n);
+    for (int i = 0; i < n; i++) {
+      (*placed)[i] = (static_cast<uint64_t>(PdIndex(hashes[i], num_pds)) << 32) |
+                     Fingerprint(hashes[i]);
+    }
+    std::sort(placed->begin(), placed->end());
+    placed->erase(std::unique(placed->begin(), placed->end()), placed->end());
+
+    std::vector<uint8_t> counts(num_pds, 0);
+    for (uint64_t& entry : *placed) {
+      uint32_t pd_index = static_cast<uint32_t>(entry >> 32);
+      const uint32_t qr = static_cast<uint32_t>(entry);
+      if (counts[pd_index] >= Pd::kShortcutThreshold) {
+        const uint32_t alt = AltPdIndex(pd_index, qr, num_pds);
+        if (counts[alt] < counts[pd_index]) pd_index = alt;
+        if (counts[pd_index] == Pd::kCapacity) return false;
+      }
+      counts[pd_index]++;
+      entry = (static_cast<uint64_t>(pd_index) << 32) | qr;
+    }
+    std::sort(placed->begin(), placed->end());
+    return true;
+  }
+
+  // Appends the PD of fingerprints qrs, sorted and at most kCapacity.
+  static void AppendPd(const std::vector<uint32_t>& qrs, std::string* dst) {
+    char pd[kPdBytes] = {0};
+    uint64_t header[2] = {0, 0};
+    uint64_t position = 0;
+    size_t i = 0;
+    for (uint64_t quot = 0; quot < Pd::kQuotients; quot++) {
+      for (; i < qrs.size() && (qrs[i] >> kRemainderBits) == quot; i++, position++) {
+        StoreRemainder(pd + Pd::kHeaderBytes + i * sizeof(Remainder),
+                       static_cast<Remainder>(qrs[i]));
+      }
+      header[position / 64] |= uint64_t{1} << (position % 64);
+      position++;
+    }
+    EncodeFixed64(pd, header[0]);
+    if (Pd::kHeaderBytes > sizeof(uint64_t)) EncodeFixed64(pd + sizeof(uint64_t), header[1]);
+    dst->append(pd, kPdBytes);
+  }
+
+  static bool Decode(const leveldb::Slice& filter, Table* table) {
+    Slice input = filter;
+    if (!GetFilterHeader(&input, Pd::kType) || input.size() < kTCHeaderSize) {
+      return false;
+    }
+
+    table->num_pds = DecodeFixed32(input.data());
+    const size_t padding = static_cast<uint8_t>(input[kTCHeaderSize - 1]);
+    table->pds = input.data() + kTCHeaderSize + padding;
+    return table->num_pds >= 2 && table->num_pds % 2 == 0 &&
+           kTCHeaderSize + padding + uint64_t{kPdBytes} * table->num_pds <= input.size();
+  }
+
+  static void Prefetch(const Table& table, uint64_t key_hash) {
+    const uint32_t pd_index = PdIndex(key_hash, table.num_pds);
+    PrefetchFilterLine(table.pds + kPdBytes * pd_index);
+    PrefetchFilterLine(table.pds + kPdBytes * AltPdIndex(pd_index, Fingerprint(key_hash),
+                                                         table.num_pds));
+  }
+
+  static bool Contains(const Table& table, uint64_t key_hash) {
+    const uint32_t pd_index = PdIndex(key_hash, table.num_pds);
+    const uint32_t qr = Fingerprint(key_hash);
+    return PdContains(table.pds + kPdBytes * pd_index, qr) ||
+           PdContains(table.pds + kPdBytes * AltPdIndex(pd_index, qr, table.num_pds), qr);
+  }
+
+  // Sets [*begin, *end) to the slots of quotient quot and returns true if
+  // they are not empty.  Corrupt headers keep the slots inside the PD.
+  static bool PdSlots(const char* pd, uint64_t quot, uint64_t* begin, uint64_t* end) {
+    const uint64_t lo = DecodeFixed64(pd);
+    const uint64_t hi =
+        Pd::kHeaderBytes > sizeof(uint64_t) ? DecodeFixed64(pd + sizeof(uint64_t)) : 0;
+    *begin = quot == 0 ? 0 : Select128(lo, hi, quot - 1) + 1 - quot;
+    *end = Select128(lo, hi, quot) - quot;
+    if (*end > Pd::kCapacity) *end = Pd::kCapacity;
+    return *begin < *end;
+  }
+
+  // Returns true if the PD holds fingerprint qr.
+  static bool PdContains(const char* pd, uint32_t qr) {
+    const Remainder rem = static_cast<Remainder>(qr);
+    if (!MayHoldRemainder(pd, rem, Pd::kHeaderBytes)) return false;
+
+    uint64_t begin, end;
+    if (!PdSlots(pd, qr >> kRemainderBits, &begin, &end)) return false;
+    for (uint64_t i = begin; i < end; i++) {
+      if (LoadRemainder(pd + Pd::kHeaderBytes + i * sizeof(Remainder), rem) == rem) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+#if LEVELDB_FILTER_SIMD_X86
+  // PdContains() with the remainders of the whole PD compared at once.
+  LEVELDB_TARGET_AVX2 static bool PdContainsAvx2(const char* pd, uint32_t qr) {
+    const uint64_t matches = MatchMask(pd, static_cast<Remainder>(qr), Pd::kHeaderBytes);
+    if (matches == 0) return false;
+
+    uint64_t begin, end;
+    if (!PdSlots(pd, qr >> kRemainderBits, &begin, &end)) return false;
+    return ((matches >> begin) & ((uint64_t{1} << (end - begin)) - 1)) != 0;
+  }
+
+  LEVELDB_TARGET_AVX2 static bool ContainsAvx2(const Table& table, uint64_t key_hash) {
+    const uint32_t pd_index = PdIndex(key_hash, table.num_pds);
+    const uint32_t qr = Fingerprint(key_hash);
+    return PdContainsAvx2(table.pds + kPdBytes * pd_index, qr) ||
+           PdContainsAvx2(table.pds + kPdBytes * AltPdIndex(pd_index, qr, table.num_pds), qr);
+  }
+
+  // BatchKeysMayMatch() spelled out: its callbacks would not be compiled for
+  // AVX2, so ContainsAvx2() could not be inlined into them.
+  LEVELDB_TARGET_AVX2 static void KeysMayMatchAvx2(const Table& table,
+                                                   const leveldb::Slice* keys, int n,
+                                                   bool* results) {
+    uint64_t hashes[kFilterProbeBatch];
+    for (int start = 0; start < n; start += kFilterProbeBatch) {
+      const int count = std::min(kFilterProbeBatch, n - start);
+      for (int i = 0; i < count; i++) {
+        hashes[i] = FilterKeyHash(keys[start + i]);
+        Prefetch(table, hashes[i]);
+      }
+      for (int i = 0; i < count; i++) {
+        results[start + i] = ContainsAvx2(table, hashes[i]);
+      }
+    }
+  }
+#endif  // LEVELDB_FILTER_SIMD_X86
+
+  static size_t AlignmentPadding(size_t offset, size_t alignment) {
+    return (alignment - offset % alignment) % alignment;
+  }
+
+  const FilterSimdLevel simd_level_;
+};
+
+const FilterPolicy* NewTCShortcutFilterPolicy(size_t bits_per_key) {
+  switch (bits_per_key) {
+    case 12:  // 12-bit remainders do not fit SIMD lanes
+    case 16:
+      return new TCShortcutFilterPolicy<TCPd16>();
+    default:
+      return new TCShortcutFilterPolicy<TCPd8>();
+  }
+}
+
+}  // namespace leveldb
@@ -2,13 +2,17 @@
 // Created by Maciej Gajek on 30/03/2023.
 //
 
-#include <iostream>
+#include <algorithm>
 #include <memory>
+#include <vector>
 
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
 
-#include "util/MurmurHash3.h"
+#include "util/filter_adapters/CuckooTableView.h"
+#include "util/filter_adapters/FilterEncoding.h"
+#include "util/filter_adapters/FilterPolicyAdapter.h"
+#include "util/filter_adapters/SemiSortedTable.h"
 
 #include "Vacuum-Filter/ModifiedCuckooFilter/src/cuckoofilter.h"
 
@@ -17,529 +21,114 @@ constexpr size_t BITS12_PER_KEY = 12;
 constexpr size_t BITS16_PER_KEY = 16;
 
 namespace leveldb {
-class VacuumFilterPolicy8 : public FilterPolicy {
- public:
-  
-  static uint64_t keyHash(const leveldb::Slice& key) {
-
-    uint64_t hash_value = 0;
-
-    MurmurHash3_x86_32((void*) key.data(), key.size(), 1e9 + 9, &hash_value);
-
-    return hash_value;
-  }
-
-  const char* Name() const override { return "XorFilterPolicy"; }
-
-  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
-    size_t num_keys = n;
-    modifiedcuckoofilter::VacuumFilter<uint64_t, BITS8_PER_KEY> filter(num_keys);
-
-    for (int i = 0; i < n; ++i) {
-      filter.Add(keyHash(keys[i]));
+namespace {
+
+// Add() gives up once the victim slot is taken, silently dropping the key,
+// so rebuild with a larger table until every distinct key made it in.  The
+// build is deterministic (the filter reseeds rand()), so retrying at the same
+// size would fail the same way.
+template <size_t bits_per_tag, template <size_t> class TableType>
+void AppendVacuumFilter(const uint64_t* key_hashes, int n, FilterType type,
+                        std::string* dst) {
+  std::vector<uint64_t> hashes(key_hashes, key_hashes + n);
+  std::sort(hashes.begin(), hashes.end());
+  hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+  // VacuumFilter sizes itself as capacity / 0.96 / 4 buckets, rounded down,
+  // so fewer than 4 keys would get an empty table.
+  const size_t kMinCapacity = 4;
+  for (size_t capacity = std::max(hashes.size(), kMinCapacity);;
+       capacity += capacity / 2) {
+    modifiedcuckoofilter::VacuumFilter<uint64_t, bits_per_tag,
+        TableType, CuckooTableHash> filter(capacity);
+    size_t added = 0;
+    while (added < hashes.size() &&
+           filter.Add(hashes[added]) == modifiedcuckoofilter::Ok)
+      ++added;
+
+    if (added == hashes.size()) {
+      PutFilterHeader(dst, type);
+      AppendCuckooTable<bits_per_tag>(filter, filter.len, dst);
+      return;
     }
-
-    const size_t init_size = dst->size();
-
-    auto num_buckets = filter.table_->num_buckets_ +
-                       modifiedcuckoofilter::SingleTable<BITS8_PER_KEY>::kPaddingBuckets;
-
-    //TODO persist only values that are needed
-    const size_t additional_size = sizeof(modifiedcuckoofilter::VacuumFilter<uint64_t, BITS8_PER_KEY>) +
-                                   sizeof(size_t) +
-                                   sizeof(modifiedcuckoofilter::SingleTable<BITS8_PER_KEY>::Bucket) * num_buckets;
-
-    dst->resize(init_size + additional_size, 0);
-
-    auto filter_persist_ptr = (modifiedcuckoofilter::VacuumFilter<uint64_t, BITS8_PER_KEY>*) &(*dst)[init_size];
-    auto num_buckets_ptr = (size_t*) &filter_persist_ptr[1];
-    auto buckets_persist_ptr = (modifiedcuckoofilter::SingleTable<
-                                BITS8_PER_KEY>::Bucket*) &num_buckets_ptr[1];
-
-    *filter_persist_ptr = filter;
-    *num_buckets_ptr = filter.table_->num_buckets_;
-    std::memcpy(buckets_persist_ptr, filter.table_->buckets_,
-                sizeof(modifiedcuckoofilter::SingleTable<BITS8_PER_KEY>::Bucket) * num_buckets);
-
-    //    using F = modifiedcuckoofilter::VacuumFilter<size_t, BITS8_PER_KEY+1, modifiedcuckoofilter::PackedTable>;
-    //    F filter(num_keys);
-    //
-    //    for (int i = 0; i < n; ++i) {
-    //      filter.Add(keyHash(keys[i]));
-    //    }
-    //
-    //    const size_t init_size = dst->size();
-    //
-    //    //TODO persist only values that are needed
-    //    const size_t additional_size = sizeof(modifiedcuckoofilter::VacuumFilter<uint64_t, BITS8_PER_KEY>) +
-    //                                   sizeof(char) * filter.table_->len_;
-    //
-    //    dst->resize(init_size + additional_size, 0);
-    //
-    //    auto filter_persist_ptr = (F*) &(*dst)[init_size];
-    //    auto tables_persist_ptr = (char*) &filter_persist_ptr[1];
-    //
-    //    *filter_persist_ptr = filter;
-    //    std::memcpy(tables_persist_ptr, filter.table_->buckets_, sizeof(char) * filter.table_->len_);
-  }
-
-  bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override {
-    if (filter.size() <= 0)
-      return false;
-
-    auto vacuum_filter_ptr = (modifiedcuckoofilter::VacuumFilter<uint64_t, BITS8_PER_KEY>*) filter.data();
-    auto num_buckets_ptr = (size_t*) &vacuum_filter_ptr[1];
-    auto buckets_persist_ptr = (modifiedcuckoofilter::SingleTable<
-                                BITS8_PER_KEY>::Bucket*) &num_buckets_ptr[1];
-
-    auto vacuum_filter = *vacuum_filter_ptr;
-
-    vacuum_filter.table_ = new modifiedcuckoofilter::SingleTable<BITS8_PER_KEY>();
-    vacuum_filter.table_->num_buckets_ = *num_buckets_ptr;
-    vacuum_filter.table_->buckets_ = buckets_persist_ptr;
-
-    auto res = vacuum_filter.Contain(keyHash(key)) == modifiedcuckoofilter::Status::Ok;
-
-    vacuum_filter.table_->buckets_ = nullptr;
-    delete vacuum_filter.table_;
-    vacuum_filter.table_ = nullptr;
-
-    return res;
-    //    using F = modifiedcuckoofilter::VacuumFilter<size_t, BITS8_PER_KEY+1, modifiedcuckoofilter::PackedTable>;
-    //
-    //    auto filter_persist_ptr = (F*) filter.data();
-    //    auto tables_persist_ptr = (char*) &filter_persist_ptr[1];
-    //
-    //    filter_persist_ptr->table_->buckets_ = tables_persist_ptr;
-    //    filter_persist_ptr->table_->perm_ = modifiedcuckoofilter::PermEncoding();
-    //
-    //    return filter_persist_ptr->Contain(keyHash(key)) == modifiedcuckoofilter::Status::Ok;
-  }
-};
-
-class VacuumFilterPolicy12 : public FilterPolicy {
- public:
-  
-  static uint64_t keyHash(const leveldb::Slice& key) {
-
-    uint64_t hash_value = 0;
-
-    MurmurHash3_x86_32((void*) key.data(), key.size(), 1e9 + 9, &hash_value);
-
-    return hash_value;
   }
+}
 
-  const char* Name() const override { return "XorFilterPolicy"; }
+template <size_t bits_per_tag>
+struct VacuumFilterTraits {
+  typedef VacuumTableView<bits_per_tag> View;
 
-  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
-    size_t num_keys = n;
-    modifiedcuckoofilter::VacuumFilter<uint64_t, BITS12_PER_KEY> filter(num_keys);
-    
-    for (int i = 0; i < n; ++i) {
-      filter.Add(keyHash(keys[i]));
+  static const char* Name() {
+    switch (bits_per_tag) {
+      case BITS16_PER_KEY:
+        return "VacuumFilterPolicy16";
+      case BITS12_PER_KEY:
+        return "VacuumFilterPolicy12";
+      default:
+        return "VacuumFilterPolicy8";
     }
-
-    const size_t init_size = dst->size();
-
-    auto num_buckets = filter.table_->num_buckets_ +
-                       modifiedcuckoofilter::SingleTable<BITS12_PER_KEY>::kPaddingBuckets;
-
-    //TODO persist only values that are needed
-    const size_t additional_size = sizeof(modifiedcuckoofilter::VacuumFilter<uint64_t, BITS12_PER_KEY>) +
-                                   sizeof(size_t) +
-                                   sizeof(modifiedcuckoofilter::SingleTable<BITS12_PER_KEY>::Bucket) * num_buckets;
-
-    dst->resize(init_size + additional_size, 0);
-
-    auto filter_persist_ptr = (modifiedcuckoofilter::VacuumFilter<uint64_t, BITS12_PER_KEY>*) &(*dst)[init_size];
-    auto num_buckets_ptr = (size_t*) &filter_persist_ptr[1];
-    auto buckets_persist_ptr = (modifiedcuckoofilter::SingleTable<
-                                BITS12_PER_KEY>::Bucket*) &num_buckets_ptr[1];
-
-    *filter_persist_ptr = filter;
-    *num_buckets_ptr = filter.table_->num_buckets_;
-    std::memcpy(buckets_persist_ptr, filter.table_->buckets_,
-                sizeof(modifiedcuckoofilter::SingleTable<BITS12_PER_KEY>::Bucket) * num_buckets);
-
-    //    using F = modifiedcuckoofilter::VacuumFilter<size_t, BITS12_PER_KEY+1, modifiedcuckoofilter::PackedTable>;
-    //    F filter(num_keys);
-    //
-    //    for (int i = 0; i < n; ++i) {
-    //      filter.Add(keyHash(keys[i]));
-    //    }
-    //
-    //    const size_t init_size = dst->size();
-    //
-    //    //TODO persist only values that are needed
-    //    const size_t additional_size = sizeof(modifiedcuckoofilter::VacuumFilter<uint64_t, BITS12_PER_KEY>) +
-    //                                   sizeof(char) * filter.table_->len_;
-    //
-    //    dst->resize(init_size + additional_size, 0);
-    //
-    //    auto filter_persist_ptr = (F*) &(*dst)[init_size];
-    //    auto tables_persist_ptr = (char*) &filter_persist_ptr[1];
-    //
-    //    *filter_persist_ptr = filter;
-    //    std::memcpy(tables_persist_ptr, filter.table_->buckets_, sizeof(char) * filter.table_->len_);
-  }
-
-  bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override {
-    if (filter.size() <= 0)
-      return false;
-
-    auto vacuum_filter_ptr = (modifiedcuckoofilter::VacuumFilter<uint64_t, BITS12_PER_KEY>*) filter.data();
-    auto num_buckets_ptr = (size_t*) &vacuum_filter_ptr[1];
-    auto buckets_persist_ptr = (modifiedcuckoofilter::SingleTable<
-                                BITS12_PER_KEY>::Bucket*) &num_buckets_ptr[1];
-
-    auto vacuum_filter = *vacuum_filter_ptr;
-
-    vacuum_filter.table_ = new modifiedcuckoofilter::SingleTable<BITS12_PER_KEY>();
-    vacuum_filter.table_->num_buckets_ = *num_buckets_ptr;
-    vacuum_filter.table_->buckets_ = buckets_persist_ptr;
-
-    auto res = vacuum_filter.Contain(keyHash(key)) == modifiedcuckoofilter::Status::Ok;
-
-    vacuum_filter.table_->buckets_ = nullptr;
-    delete vacuum_filter.table_;
-    vacuum_filter.table_ = nullptr;
-
-    return res;
-    //    using F = modifiedcuckoofilter::VacuumFilter<size_t, BITS12_PER_KEY+1, modifiedcuckoofilter::PackedTable>;
-    //
-    //    auto filter_persist_ptr = (F*) filter.data();
-    //    auto tables_persist_ptr = (char*) &filter_persist_ptr[1];
-    //
-    //    filter_persist_ptr->table_->buckets_ = tables_persist_ptr;
-    //    filter_persist_ptr->table_->perm_ = modifiedcuckoofilter::PermEncoding();
-    //
-    //    return filter_persist_ptr->Contain(keyHash(key)) == modifiedcuckoofilter::Status::Ok;
-  }
-};
-
-class VacuumFilterPolicy16 : public FilterPolicy {
- public:
-
-  static uint64_t keyHash(const leveldb::Slice& key) {
-
-    uint64_t hash_value = 0;
-
-    MurmurHash3_x86_32((void*) key.data(), key.size(), 1e9 + 9, &hash_value);
-
-    return hash_value;
   }
 
-  const char* Name() const override { return "XorFilterPolicy"; }
-
-  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
-    size_t num_keys = n;
-    modifiedcuckoofilter::VacuumFilter<uint64_t, BITS16_PER_KEY> filter(num_keys);
-    
-    for (int i = 0; i < n; ++i) {
-      filter.Add(keyHash(keys[i]));
-    }
-
-    const size_t init_size = dst->size();
-
-    auto num_buckets = filter.table_->num_buckets_ +
-                       modifiedcuckoofilter::SingleTable<BITS16_PER_KEY>::kPaddingBuckets;
-
-    //TODO persist only values that are needed
-    const size_t additional_size = sizeof(modifiedcuckoofilter::VacuumFilter<uint64_t, BITS16_PER_KEY>) +
-                                   sizeof(size_t) +
-                                   sizeof(modifiedcuckoofilter::SingleTable<BITS16_PER_KEY>::Bucket) * num_buckets;
-
-    dst->resize(init_size + additional_size, 0);
-
-    auto filter_persist_ptr = (modifiedcuckoofilter::VacuumFilter<uint64_t, BITS16_PER_KEY>*) &(*dst)[init_size];
-    auto num_buckets_ptr = (size_t*) &filter_persist_ptr[1];
-    auto buckets_persist_ptr = (modifiedcuckoofilter::SingleTable<
-                                BITS16_PER_KEY>::Bucket*) &num_buckets_ptr[1];
-
-    *filter_persist_ptr = filter;
-    *num_buckets_ptr = filter.table_->num_buckets_;
-    std::memcpy(buckets_persist_ptr, filter.table_->buckets_,
-                sizeof(modifiedcuckoofilter::SingleTable<BITS16_PER_KEY>::Bucket) * num_buckets);
-
-    //    using F = modifiedcuckoofilter::VacuumFilter<size_t, BITS16_PER_KEY+1, modifiedcuckoofilter::PackedTable>;
-    //    F filter(num_keys);
-    //
-    //    for (int i = 0; i < n; ++i) {
-    //      filter.Add(keyHash(keys[i]));
-    //    }
-    //
-    //    const size_t init_size = dst->size();
-    //
-    //    //TODO persist only values that are needed
-    //    const size_t additional_size = sizeof(modifiedcuckoofilter::VacuumFilter<uint64_t, BITS16_PER_KEY>) +
-    //                                   sizeof(char) * filter.table_->len_;
-    //
-    //    dst->resize(init_size + additional_size, 0);
-    //
-    //    auto filter_persist_ptr = (F*) &(*dst)[init_size];
-    //    auto tables_persist_ptr = (char*) &filter_persist_ptr[1];
-    //
-    //    *filter_persist_ptr = filter;
-    //    std::memcpy(tables_persist_ptr, filter.table_->buckets_, sizeof(char) * filter.table_->len_);
+  static void Build(const uint64_t* hashes, int n, std::string* dst) {
+    AppendVacuumFilter<bits_per_tag, modifiedcuckoofilter::SingleTable>(
+        hashes, n, kVacuumFilter, dst);
   }
 
-  bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override {
-    if (filter.size() <= 0)
-      return false;
-
-    auto vacuum_filter_ptr = (modifiedcuckoofilter::VacuumFilter<uint64_t, BITS16_PER_KEY>*) filter.data();
-    auto num_buckets_ptr = (size_t*) &vacuum_filter_ptr[1];
-    auto buckets_persist_ptr = (modifiedcuckoofilter::SingleTable<
-                                BITS16_PER_KEY>::Bucket*) &num_buckets_ptr[1];
-
-    auto vacuum_filter = *vacuum_filter_ptr;
-
-    vacuum_filter.table_ = new modifiedcuckoofilter::SingleTable<BITS16_PER_KEY>();
-    vacuum_filter.table_->num_buckets_ = *num_buckets_ptr;
-    vacuum_filter.table_->buckets_ = buckets_persist_ptr;
-
-    auto res = vacuum_filter.Contain(keyHash(key)) == modifiedcuckoofilter::Status::Ok;
-
-    vacuum_filter.table_->buckets_ = nullptr;
-    delete vacuum_filter.table_;
-    vacuum_filter.table_ = nullptr;
-
-    return res;
-    //    using F = modifiedcuckoofilter::VacuumFilter<size_t, BITS16_PER_KEY+1, modifiedcuckoofilter::PackedTable>;
-    //
-    //    auto filter_persist_ptr = (F*) filter.data();
-    //    auto tables_persist_ptr = (char*) &filter_persist_ptr[1];
-    //
-    //    filter_persist_ptr->table_->buckets_ = tables_persist_ptr;
-    //    filter_persist_ptr->table_->perm_ = modifiedcuckoofilter::PermEncoding();
-    //
-    //    return filter_persist_ptr->Contain(keyHash(key)) == modifiedcuckoofilter::Status::Ok;
+  static bool Open(const Slice& filter, View* view) {
+    Slice input = filter;
+    return GetFilterHeader(&input, kVacuumFilter) && view->Open(input);
   }
 };
 
-class VacuumFilterPolicy8Packed : public FilterPolicy {
- public:
+// Semi-sorting saves a bit per tag, so packed tables store bits_per_tag + 1
+// bit tags in the space of the unpacked bits_per_tag ones (SemiSortedTable.h).
+template <size_t bits_per_tag>
+struct PackedVacuumFilterTraits {
+  typedef VacuumTableView<bits_per_tag + 1, SemiSortedTableView<bits_per_tag + 1>> View;
 
-  static uint64_t keyHash(const leveldb::Slice& key) {
-
-    uint64_t hash_value = 0;
-
-    MurmurHash3_x86_32((void*) key.data(), key.size(), 1e9 + 9, &hash_value);
-
-    return hash_value;
-  }
-
-  const char* Name() const override { return "XorFilterPolicy"; }
-
-  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
-    size_t num_keys = n;
-
-    using F = modifiedcuckoofilter::VacuumFilter<size_t, BITS8_PER_KEY+1, modifiedcuckoofilter::PackedTable>;
-    F filter(num_keys);
-
-    for (int i = 0; i < n; ++i) {
-      filter.Add(keyHash(keys[i]));
+  static const char* Name() {
+    switch (bits_per_tag) {
+      case BITS16_PER_KEY:
+        return "PackedVacuumFilterPolicy16";
+      case BITS12_PER_KEY:
+        return "PackedVacuumFilterPolicy12";
+      default:
+        return "PackedVacuumFilterPolicy8";
     }
-
-    const size_t init_size = dst->size();
-
-    const size_t additional_size = sizeof(F) +
-                                   sizeof(size_t) +
-                                   sizeof(char) * filter.table_->len_;
-
-    dst->resize(init_size + additional_size, 0);
-
-    auto filter_persist_ptr = (F*) &(*dst)[init_size];
-    auto num_buckets_ptr = (size_t*) (filter_persist_ptr + 1);
-    auto buckets_persist_ptr = (char*) &num_buckets_ptr[1];
-
-    *filter_persist_ptr = filter;
-    *num_buckets_ptr = filter.table_->num_buckets_;
-    std::memcpy(buckets_persist_ptr, filter.table_->buckets_, sizeof(char) * filter.table_->len_);
   }
 
-  bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override {
-    if (filter.size() <= 0)
-      return false;
-
-    using F = modifiedcuckoofilter::VacuumFilter<size_t, BITS8_PER_KEY+1, modifiedcuckoofilter::PackedTable>;
-
-    auto filter_persist_ptr = (F*) filter.data();
-    auto num_buckets_ptr = (size_t*) (filter_persist_ptr + 1);
-    auto buckets_persist_ptr = (char*) &num_buckets_ptr[1];
-
-    auto vacuum_filter = *filter_persist_ptr;
-    vacuum_filter.table_ = new modifiedcuckoofilter::PackedTable<BITS8_PER_KEY+1>();
-    vacuum_filter.table_->num_buckets_ = *num_buckets_ptr;
-    vacuum_filter.table_->len_ = vacuum_filter.table_->kBytesPerBucket * (*num_buckets_ptr) + 7;
-    vacuum_filter.table_->buckets_ = buckets_persist_ptr;
-    vacuum_filter.table_->perm_ = modifiedcuckoofilter::PermEncoding();
-
-    auto res = vacuum_filter.Contain(keyHash(key)) == modifiedcuckoofilter::Status::Ok;
-
-    vacuum_filter.table_->buckets_ = nullptr;
-    delete vacuum_filter.table_;
-    vacuum_filter.table_ = nullptr;
-
-    return res;
+  static void Build(const uint64_t* hashes, int n, std::string* dst) {
+    AppendVacuumFilter<bits_per_tag + 1, SemiSortedTable>(
+        hashes, n, kPackedVacuumFilter, dst);
   }
-};
-
-class VacuumFilterPolicy12Packed : public FilterPolicy {
- public:
-
-  static uint64_t keyHash(const leveldb::Slice& key) {
-
-    uint64_t hash_value = 0;
-
-    MurmurHash3_x86_32((void*) key.data(), key.size(), 1e9 + 9, &hash_value);
 
-    return hash_value;
-  }
-
-  const char* Name() const override { return "VacuumFilterPolicy"; }
-
-  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
-    size_t num_keys = n;
-    
-    using F = modifiedcuckoofilter::VacuumFilter<size_t, BITS12_PER_KEY+1, modifiedcuckoofilter::PackedTable>;
-    F filter(num_keys);
-
-    for (int i = 0; i < n; ++i) {
-      filter.Add(keyHash(keys[i]));
-    }
-
-    const size_t init_size = dst->size();
-
-    const size_t additional_size = sizeof(F) +
-                                   sizeof(size_t) +
-                                   sizeof(char) * filter.table_->len_;
-
-    dst->resize(init_size + additional_size, 0);
-
-    auto filter_persist_ptr = (F*) &(*dst)[init_size];
-    auto num_buckets_ptr = (size_t*) (filter_persist_ptr + 1);
-    auto buckets_persist_ptr = (char*) &num_buckets_ptr[1];
-
-    *filter_persist_ptr = filter;
-    *num_buckets_ptr = filter.table_->num_buckets_;
-    std::memcpy(buckets_persist_ptr, filter.table_->buckets_, sizeof(char) * filter.table_->len_);
-  }
-
-  bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override {
-    if (filter.size() <= 0)
-      return false;
-
-    using F = modifiedcuckoofilter::VacuumFilter<size_t, BITS12_PER_KEY+1, modifiedcuckoofilter::PackedTable>;
-
-    auto filter_persist_ptr = (F*) filter.data();
-    auto num_buckets_ptr = (size_t*) (filter_persist_ptr + 1);
-    auto buckets_persist_ptr = (char*) &num_buckets_ptr[1];
-
-    auto vacuum_filter = *filter_persist_ptr;
-    vacuum_filter.table_ = new modifiedcuckoofilter::PackedTable<BITS12_PER_KEY+1>();
-    vacuum_filter.table_->num_buckets_ = *num_buckets_ptr;
-    vacuum_filter.table_->len_ = vacuum_filter.table_->kBytesPerBucket * (*num_buckets_ptr) + 7;
-    vacuum_filter.table_->buckets_ = buckets_persist_ptr;
-    vacuum_filter.table_->perm_ = modifiedcuckoofilter::PermEncoding();
-
-    auto res = vacuum_filter.Contain(keyHash(key)) == modifiedcuckoofilter::Status::Ok;
-
-    vacuum_filter.table_->buckets_ = nullptr;
-    delete vacuum_filter.table_;
-    vacuum_filter.table_ = nullptr;
-
-    return res;
+  static bool Open(const Slice& filter, View* view) {
+    Slice input = filter;
+    return GetFilterHeader(&input, kPackedVacuumFilter) && view->Open(input);
   }
 };
 
-class VacuumFilterPolicy16Packed : public FilterPolicy {
- public:
-
-  static uint64_t keyHash(const leveldb::Slice& key) {
-
-    uint64_t hash_value = 0;
-
-    MurmurHash3_x86_32((void*) key.data(), key.size(), 1e9 + 9, &hash_value);
-
-    return hash_value;
-  }
-
-  const char* Name() const override { return "XorFilterPolicy"; }
-
-  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
-    size_t num_keys = n;
-    
-    using F = modifiedcuckoofilter::VacuumFilter<size_t, BITS16_PER_KEY+1, modifiedcuckoofilter::PackedTable>;
-    F filter(num_keys);
-
-    for (int i = 0; i < n; ++i) {
-      filter.Add(keyHash(keys[i]));
-    }
-
-    const size_t init_size = dst->size();
-
-    const size_t additional_size = sizeof(F) +
-                                   sizeof(size_t) +
-                                   sizeof(char) * filter.table_->len_;
-
-    dst->resize(init_size + additional_size, 0);
-
-    auto filter_persist_ptr = (F*) &(*dst)[init_size];
-    auto num_buckets_ptr = (size_t*) (filter_persist_ptr + 1);
-    auto buckets_persist_ptr = (char*) &num_buckets_ptr[1];
-
-    *filter_persist_ptr = filter;
-    *num_buckets_ptr = filter.table_->num_buckets_;
-    std::memcpy(buckets_persist_ptr, filter.table_->buckets_, sizeof(char) * filter.table_->len_);
-  }
-
-  bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override {
-    if (filter.size() <= 0)
-      return false;
-
-    using F = modifiedcuckoofilter::VacuumFilter<size_t, BITS16_PER_KEY+1, modifiedcuckoofilter::PackedTable>;
-
-    auto filter_persist_ptr = (F*) filter.data();
-    auto num_buckets_ptr = (size_t*) (filter_persist_ptr + 1);
-    auto buckets_persist_ptr = (char*) &num_buckets_ptr[1];
-
-    auto vacuum_filter = *filter_persist_ptr;
-    vacuum_filter.table_ = new modifiedcuckoofilter::PackedTable<BITS16_PER_KEY+1>();
-    vacuum_filter.table_->num_buckets_ = *num_buckets_ptr;
-    vacuum_filter.table_->len_ = vacuum_filter.table_->kBytesPerBucket * (*num_buckets_ptr) + 7;
-    vacuum_filter.table_->buckets_ = buckets_persist_ptr;
-    vacuum_filter.table_->perm_ = modifiedcuckoofilter::PermEncoding();
-
-    auto res = vacuum_filter.Contain(keyHash(key)) == modifiedcuckoofilter::Status::Ok;
-
-    vacuum_filter.table_->buckets_ = nullptr;
-    delete vacuum_filter.table_;
-    vacuum_filter.table_ = nullptr;
-
-    return res;
-  }
-};
+}  // namespace
 
 const FilterPolicy* NewVacuumFilterPolicy(size_t bits_per_key, bool packed) {
   if (packed) {
     switch (bits_per_key) {
       case BITS12_PER_KEY:
-        return new VacuumFilterPolicy12Packed();
+        return new FilterPolicyAdapter<PackedVacuumFilterTraits<BITS12_PER_KEY>>();
       case BITS16_PER_KEY:
-        return new VacuumFilterPolicy16Packed();
+        return new FilterPolicyAdapter<PackedVacuumFilterTraits<BITS16_PER_KEY>>();
       default:
-        return new VacuumFilterPolicy8Packed();
+        return new FilterPolicyAdapter<PackedVacuumFilterTraits<BITS8_PER_KEY>>();
     }
   }
 
   switch (bits_per_key) {
     case BITS12_PER_KEY:
-      return new VacuumFilterPolicy12();
+      return new FilterPolicyAdapter<VacuumFilterTraits<BITS12_PER_KEY>>();
     case BITS16_PER_KEY:
-      return new VacuumFilterPolicy16();
+      return new FilterPolicyAdapter<VacuumFilterTraits<BITS16_PER_KEY>>();
     default:
-      return new VacuumFilterPolicy8();
+      return new FilterPolicyAdapter<VacuumFilterTraits<BITS8_PER_KEY>>();
   }
 }
 
@@ -5,62 +5,134 @@
 #include "XorFilterPolicy.h"
 
 #include <algorithm>
+#include <vector>
+
+#include "util/coding.h"
+#include "util/filter_adapters/FilterEncoding.h"
+#include "util/filter_adapters/FilterProbeBatch.h"
 
 #include "fastfilter_cpp/src/xorfilter/xorfilter_singleheader.h"
 
 namespace leveldb {
 
+// Filter layout, after the common adapter header (FilterEncoding.h):
+//    seed          : fixed64
+//    fingerprints  : 3 * blockLength little-endian 8 or 16 bit values
+template <typename xorN_s>
+static FilterType XorType() {
+  return std::is_same<xorN_s, xor16_s>::value ? kXor16Filter : kXor8Filter;
+}
+
+template <typename xorN_s>
+const char* XorFilterPolicy<xorN_s>::Name() const {
+  return std::is_same<xorN_s, xor16_s>::value ? "XorFilterPolicy16" : "XorFilterPolicy8";
+}
+
 template <typename xorN_s>
 void XorFilterPolicy<xorN_s>::CreateFilter(const leveldb::Slice* keys, int n,
                                            std::string* dst) const {
-  auto* hashed_keys = new uint64_t[n];
-  std::transform(keys, &keys[n], hashed_keys, [](const Slice& x){return keyHash(x);});
+  std::vector<uint64_t> hashes;
+  FilterKeyHashes(keys, n, &hashes);
+  CreateFilterFromHashes(hashes.data(), n, dst);
+}
+
+template <typename xorN_s>
+void XorFilterPolicy<xorN_s>::CreateFilterFromHashes(const uint64_t* hashes, int n,
+                                                     std::string* dst) const {
+  // populate() gives up when a hash repeats, as it does for every version
+  // of a user key in the block, and leaves a filter that misses keys.
+  std::vector<uint64_t> unique_hashes(hashes, hashes + n);
+  std::sort(unique_hashes.begin(), unique_hashes.end());
+  unique_hashes.erase(std::unique(unique_hashes.begin(), unique_hashes.end()),
+                      unique_hashes.end());
+  const uint32_t size = static_cast<uint32_t>(unique_hashes.size());
 
   xorN_s xor_filter = xorN_s {};
-  allocate(n, &xor_filter);
-  populate(hashed_keys, n, &xor_filter);
+  allocate(size, &xor_filter);
+  populate(unique_hashes.data(), size, &xor_filter);
 
   size_t fingerprints_bytes = xor_filter.blockLength * 3;
   if (std::is_same<xorN_s, xor16_s>::value)
     fingerprints_bytes *= 2;
 
-  const size_t init_size = dst->size();
-  const size_t additional_size = sizeof(uint64_t) + fingerprints_bytes;
-  dst->resize(init_size + additional_size, 0);
-
-  uint64_t* seed_ptr = (uint64_t*) &(*dst)[init_size];
-  uint8_t* fingerprints_ptr = (uint8_t*) &(*dst)[init_size] + sizeof(uint64_t);
-
   // save the seed and then the fingerprints
-  *seed_ptr = xor_filter.seed;
-  std::memcpy(fingerprints_ptr, xor_filter.fingerprints, fingerprints_bytes);
+  PutFilterHeader(dst, XorType<xorN_s>());
+  PutFixed64(dst, xor_filter.seed);
+  dst->append(reinterpret_cast<const char*>(xor_filter.fingerprints), fingerprints_bytes);
 
   free(&xor_filter);
-  delete[] hashed_keys;
 }
 
 template <typename xorN_s>
-bool XorFilterPolicy<xorN_s>::KeyMayMatch(const Slice& key, const Slice& filter) const {
-  if (filter.size() <= 0)
+bool XorFilterPolicy<xorN_s>::decode(const Slice& filter, xorN_s* xor_filter,
+                                     uint8_t** fingerprints) {
+  Slice input = filter;
+  if (!GetFilterHeader(&input, XorType<xorN_s>()) || input.size() < sizeof(uint64_t))
     return false;
 
-  auto fingerprints_ptr = (uint8_t*) (filter.data() + sizeof(uint64_t)) ;
-  uint64_t seed = ((uint64_t *) filter.data())[0];
+  *fingerprints = (uint8_t*) (input.data() + sizeof(uint64_t));
+  uint64_t seed = DecodeFixed64(input.data());
 
-  uint64_t blocklength = (filter.size() - sizeof(uint64_t)) / 3;
+  uint64_t blocklength = (input.size() - sizeof(uint64_t)) / 3;
 
   if (std::is_same<xorN_s, xor16_s>::value)
     blocklength /= 2;
 
-  auto xor_filter = xorN_s {
+  *xor_filter = xorN_s {
       seed,
       blocklength,
       nullptr
   };
+  return true;
+}
+
+template <typename xorN_s>
+bool XorFilterPolicy<xorN_s>::KeyMayMatch(const Slice& key, const Slice& filter) const {
+  if (filter.size() <= 0)
+    return false;
+
+  xorN_s xor_filter;
+  uint8_t* fingerprints_ptr;
+  if (!decode(filter, &xor_filter, &fingerprints_ptr))
+    return true;  // Errors are treated as potential matches
 
   return contains(keyHash(key), &xor_filter, fingerprints_ptr);
 }
 
+template <typename xorN_s>
+void XorFilterPolicy<xorN_s>::KeysMayMatch(const Slice* keys, int n, const Slice& filter,
+                                           bool* results) const {
+  if (filter.size() <= 0) {
+    std::fill(results, results + n, false);
+    return;
+  }
+
+  xorN_s xor_filter;
+  uint8_t* fingerprints_ptr;
+  if (!decode(filter, &xor_filter, &fingerprints_ptr)) {
+    std::fill(results, results + n, true);  // Errors are treated as potential matches
+    return;
+  }
+
+  const size_t fingerprint_size = std::is_same<xorN_s, xor16_s>::value ? 2 : 1;
+  const uint32_t block_length = xor_filter.blockLength;
+  BatchKeysMayMatch(
+      keys, n, results,
+      [&](uint64_t key) {
+        // The three slots xor8_contain() and xor16_contain() read
+        const uint64_t hash = xor_mix_split(key, xor_filter.seed);
+        const uint32_t h0 = xor_reduce((uint32_t) hash, block_length);
+        const uint32_t h1 =
+            xor_reduce((uint32_t) xor_rotl64(hash, 21), block_length) + block_length;
+        const uint32_t h2 =
+            xor_reduce((uint32_t) xor_rotl64(hash, 42), block_length) + 2 * block_length;
+        PrefetchFilterLine(fingerprints_ptr + h0 * fingerprint_size);
+        PrefetchFilterLine(fingerprints_ptr + h1 * fingerprint_size);
+        PrefetchFilterLine(fingerprints_ptr + h2 * fingerprint_size);
+      },
+      [&](uint64_t key) { return contains(key, &xor_filter, fingerprints_ptr); });
+}
+
 template<>
 bool XorFilterPolicy<xor8_s>::contains(
     uint64_t key,
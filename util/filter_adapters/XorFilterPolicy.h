@@ -8,7 +8,7 @@
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
 
-#include "util/MurmurHash3.h"
+#include "util/filter_adapters/FilterKeyHash.h"
 
 namespace leveldb {
 
@@ -17,21 +17,30 @@ class XorFilterPolicy : public FilterPolicy {
  public:
 
   static uint64_t keyHash(const leveldb::Slice& key) {
-
-    uint64_t hash_value = 0;
-
-    MurmurHash3_x86_32((void*) key.data(), key.size(), 1e9 + 9, &hash_value);
-
-    return hash_value;
+    return FilterKeyHash(key);
   }
 
-  const char* Name() const override { return "XorFilterPolicy"; }
+  const char* Name() const override;
 
   void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override;
 
   bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override;
 
+  void KeysMayMatch(const leveldb::Slice* keys, int n, const leveldb::Slice& filter,
+                    bool* results) const override;
+
+  bool HashesKeys() const override { return true; }
+
+  uint64_t KeyHash(const leveldb::Slice& key) const override { return keyHash(key); }
+
+  void CreateFilterFromHashes(const uint64_t* hashes, int n, std::string* dst) const override;
+
  private:
+  // Points *xor_filter and *fingerprints at a non-empty filter.  Returns false
+  // if it is corrupt.
+  static bool decode(const leveldb::Slice& filter, xorN_s* xor_filter,
+                     uint8_t** fingerprints);
+
   bool contains(uint64_t key, xorN_s* filter, uint8_t* fingerprints) const;
 
   void allocate(uint32_t size, xorN_s *filter) const;
@@ -2,132 +2,205 @@
 // Created by Maciej Gajek on 30/03/2023.
 //
 
+#include <algorithm>
+#include <vector>
+
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
 
 #include "fastfilter_cpp/src/xorfilter/xorfilter_plus.h"
-#include "util/MurmurHash3.h"
-
-namespace {
- void serialize_rank9(xorfilter_plus::Rank9* rank, std::string* dst) {
-    auto initial_size = dst->size();
-
-    auto additional_size = rank->bitsArraySize * sizeof(uint64_t) +
-    rank->countsArraySize * sizeof(uint64_t);
-
-    dst->resize(initial_size + additional_size, 0);
-
-    auto bits_array_size_ptr = (uint64_t*) &dst->data()[initial_size];
-    auto counts_array_size_ptr = bits_array_size_ptr + 1;
-    auto bits_array_ptr = counts_array_size_ptr + 1;
-    auto counts_array_ptr = bits_array_ptr + rank->bitsArraySize;
-
-    *bits_array_size_ptr = rank->bitsArraySize;
-    *counts_array_size_ptr = rank->countsArraySize;
-
-    std::memcpy(bits_array_ptr, rank->bits, rank->bitsArraySize * sizeof(uint64_t));
-    std::memcpy(counts_array_ptr, rank->counts, rank->countsArraySize * sizeof(uint64_t));
- }
-
- xorfilter_plus::Rank9 deserialize_rank9(void* data) {
-    auto bits_array_size_ptr = ((uint64_t*) data);
-    auto counts_array_size_ptr = bits_array_size_ptr + 1;
-    auto bits_array_ptr = counts_array_size_ptr + 1;
-    auto counts_array_ptr = bits_array_ptr + *bits_array_size_ptr;
-
-    auto rank = xorfilter_plus::Rank9 {
-        bits_array_ptr,
-        *bits_array_size_ptr,
-        counts_array_ptr,
-        *counts_array_size_ptr,
-    };
-
-    return std::move(rank);
- }
-}
+#include "util/coding.h"
+#include "util/filter_adapters/FilterEncoding.h"
+#include "util/filter_adapters/FilterPolicyAdapter.h"
+#include "util/filter_adapters/FilterProbeBatch.h"
 
 namespace leveldb {
+namespace {
 
+// Filter layout, after the common adapter header (FilterEncoding.h):
+//    blockLength          : fixed32
+//    hasher seed          : fixed64
+//    fingerprint count    : fixed32
+//    rank bits words      : fixed32
+//    rank counts words    : fixed32
+//    fingerprints         : fingerprint count little-endian 8 or 16 bit values
+//    rank bits            : rank bits words little-endian uint64 values
+//    rank counts          : rank counts words little-endian uint64 values
+//
+// The rank bits and counts are xorfilter_plus::Rank9's arrays.  The view
+// below answers Rank9's queries straight from the filter bytes, so a probe
+// neither allocates nor copies the rank structure.
 template <typename fingerprint_t>
-class XorPlusFilterPolicy : public FilterPolicy {
+class XorPlusView {
  public:
-
-  static uint64_t keyHash(const leveldb::Slice& key) {
-
-    uint64_t hash_value = 0;
-
-    MurmurHash3_x86_32((void*) key.data(), key.size(), 1e9 + 9, &hash_value);
-
-    return hash_value;
+  static constexpr size_t kHeaderSize = 4 * sizeof(uint32_t) + sizeof(uint64_t);
+
+  // input starts after the common adapter header.
+  bool Open(const Slice& input) {
+    if (input.size() < kHeaderSize) return false;
+
+    const char* p = input.data();
+    block_length_ = DecodeFixed32(p);
+    seed_ = DecodeFixed64(p + 4);
+    fingerprint_count_ = DecodeFixed32(p + 12);
+    const uint32_t bits_words = DecodeFixed32(p + 16);
+    const uint32_t counts_words = DecodeFixed32(p + 20);
+
+    const uint64_t fingerprint_bytes = uint64_t{fingerprint_count_} * sizeof(fingerprint_t);
+    if (kHeaderSize + fingerprint_bytes +
+            (uint64_t{bits_words} + counts_words) * sizeof(uint64_t) > input.size() ||
+        fingerprint_count_ < 2 * uint64_t{block_length_} ||
+        bits_words < (block_length_ + 63) / 64 + 1 ||
+        counts_words < 2 * ((uint64_t{bits_words} + 7) / 8) + 1)
+      return false;
+
+    fingerprints_ = p + kHeaderSize;
+    rank_bits_ = fingerprints_ + fingerprint_bytes;
+    rank_counts_ = rank_bits_ + sizeof(uint64_t) * bits_words;
+    return true;
   }
 
-  const char* Name() const override { return "XorPlusFilterPolicy"; }
-
-  void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override {
-    auto* hashed_keys = new uint64_t[n];
-    std::transform(keys, &keys[n], hashed_keys, [](const Slice& x){return keyHash(x);});
-
-    auto xor_filter = xorfilter_plus::XorFilterPlus<uint64_t, fingerprint_t>(n);
-
-    xor_filter.AddAll(hashed_keys, 0, n);
-
-    const size_t fingerprint_size = xor_filter.totalSizeInBytes * sizeof(fingerprint_t) -
-                                     xor_filter.rank->getBitCount() / 8;
-
-    const size_t init_size = dst->size();
-    const size_t additional_size = sizeof(xorfilter_plus::XorFilterPlus<uint64_t, fingerprint_t>) +
-       sizeof(hashing::SimpleMixSplit) +
-       sizeof(size_t) +
-       fingerprint_size;
-    dst->resize(init_size + additional_size, 0);
-
-    auto filter_ptr = (xorfilter_plus::XorFilterPlus<uint64_t, fingerprint_t>*) &dst->data()[init_size];
-    auto hash_ptr = (hashing::SimpleMixSplit*) (filter_ptr + 1);
-    auto fingerprints_size_ptr = (size_t*) hash_ptr + 1;
-    auto fingerprints_ptr = (fingerprint_t*) (fingerprints_size_ptr + 1);
+  // Same probe as XorFilterPlus::Contain().
+  bool MayContain(uint64_t key_hash) const {
+    const Slots slots = GetSlots(key_hash);
+    fingerprint_t f = static_cast<fingerprint_t>(slots.hash ^ (slots.hash >> 32));
+    f ^= Fingerprint(slots.h0) ^ Fingerprint(slots.h1);
+
+    const uint64_t bit_and_partial_rank = GetAndPartialRank(slots.h2a);
+    if ((bit_and_partial_rank & 1) == 0) {
+      return f == 0;
+    }
+    const uint64_t h2x = (bit_and_partial_rank >> 1) + RemainingRank(slots.h2a);
+    return h2x + 2 * block_length_ >= fingerprint_count_ ||  // Corrupt rank
+           f == Fingerprint(h2x + 2 * block_length_);
+  }
 
-    *filter_ptr = xor_filter;
-    *hash_ptr = *xor_filter.hasher;
-    *fingerprints_size_ptr = fingerprint_size;
-    std::memcpy(fingerprints_ptr, xor_filter.fingerprints, fingerprint_size);
+  // The third fingerprint's position depends on the rank, so only the rank
+  // words that lead to it are requested.
+  void Prefetch(uint64_t key_hash) const {
+    const Slots slots = GetSlots(key_hash);
+    PrefetchFilterLine(fingerprints_ + sizeof(fingerprint_t) * slots.h0);
+    PrefetchFilterLine(fingerprints_ + sizeof(fingerprint_t) * slots.h1);
+    const uint64_t word = slots.h2a >> 6;
+    PrefetchFilterLine(rank_bits_ + sizeof(uint64_t) * word);
+    PrefetchFilterLine(rank_counts_ + sizeof(uint64_t) * ((word >> 2) & ~uint64_t{1}));
+  }
 
-    serialize_rank9(xor_filter.rank, dst);
+ private:
+  struct Slots {
+    uint64_t hash;
+    uint32_t h0, h1, h2a;
+  };
+
+  Slots GetSlots(uint64_t key_hash) const {
+    Slots slots;
+    slots.hash = hashing::SimpleMixSplit::murmur64(key_hash + seed_);
+    const uint32_t r0 = static_cast<uint32_t>(slots.hash);
+    const uint32_t r1 = static_cast<uint32_t>(xorfilter_plus::rotl64(slots.hash, 21));
+    const uint32_t r2 = static_cast<uint32_t>(xorfilter_plus::rotl64(slots.hash, 42));
+    slots.h0 = xorfilter_plus::reduce(r0, block_length_);
+    slots.h1 = xorfilter_plus::reduce(r1, block_length_) + block_length_;
+    slots.h2a = xorfilter_plus::reduce(r2, block_length_);
+    return slots;
+  }
 
-    delete[] hashed_keys;
+  fingerprint_t Fingerprint(uint64_t i) const {
+    const char* p = fingerprints_ + sizeof(fingerprint_t) * i;
+    if (sizeof(fingerprint_t) == 1) return static_cast<uint8_t>(p[0]);
+    return static_cast<fingerprint_t>(static_cast<uint8_t>(p[0]) |
+                                      (static_cast<uint8_t>(p[1]) << 8));
   }
 
-  bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override {
-    if (filter.empty()) return false;
+  // Rank9::getAndPartialRank(): the rank of pos within its word, shifted
+  // left by one, plus the bit at pos.
+  uint64_t GetAndPartialRank(uint64_t pos) const {
+    const uint64_t word = DecodeFixed64(rank_bits_ + sizeof(uint64_t) * (pos >> 6));
+    const int shift = pos & 63;
+    const uint64_t below = word & ((uint64_t{1} << shift) - 1);
+    return (static_cast<uint64_t>(__builtin_popcountll(below)) << 1) + ((word >> shift) & 1);
+  }
 
-    auto filter_ptr =
-        (xorfilter_plus::XorFilterPlus<uint64_t, fingerprint_t>*) filter.data();
-    auto hash_ptr = (hashing::SimpleMixSplit*)(filter_ptr + 1);
-    auto fingerprints_size_ptr = (size_t*)(hash_ptr + 1);
-    auto fingerprints_ptr = (fingerprint_t*)(fingerprints_size_ptr + 1);
+  // Rank9::remainingRank(): the rank of the first bit of pos's word, from
+  // the block count and the 9-bit sub-block counts that follow it.
+  uint64_t RemainingRank(uint64_t pos) const {
+    const uint64_t word = pos >> 6;
+    const uint64_t block = (word >> 2) & ~uint64_t{1};
+    const int offset = static_cast<int>(word & 7) - 1;
+    const uint64_t base = DecodeFixed64(rank_counts_ + sizeof(uint64_t) * block);
+    const uint64_t sub = DecodeFixed64(rank_counts_ + sizeof(uint64_t) * (block + 1));
+    return base + ((sub >> ((offset + ((offset >> 28) & 8)) * 9)) & 0x1ff);
+  }
 
-    filter_ptr->hasher = hash_ptr;
-    filter_ptr->fingerprints = fingerprints_ptr;
+  const char* fingerprints_;
+  const char* rank_bits_;
+  const char* rank_counts_;
+  uint32_t block_length_;
+  uint32_t fingerprint_count_;
+  uint64_t seed_;
+};
 
-    auto rank =
-        deserialize_rank9((void*)(fingerprints_ptr + *fingerprints_size_ptr / sizeof(fingerprint_t)));
-    filter_ptr->rank = &rank;
+template <typename fingerprint_t>
+struct XorPlusFilterTraits {
+  typedef XorPlusView<fingerprint_t> View;
+  static constexpr FilterType kType =
+      sizeof(fingerprint_t) == 2 ? kXorPlus16Filter : kXorPlus8Filter;
 
-    auto res = filter_ptr->Contain(keyHash(key)) == xorfilter_plus::Status::Ok;
+  static const char* Name() {
+    return sizeof(fingerprint_t) == 2 ? "XorPlusFilterPolicy16" : "XorPlusFilterPolicy8";
+  }
 
-    rank.bits = nullptr;
-    rank.counts = nullptr;
+  static void Build(const uint64_t* hashes, int n, std::string* dst) {
+    if (n <= 0) return;
+
+    // AddAll() retries forever when a hash repeats, as it does for every
+    // version of a user key in the block.
+    std::vector<uint64_t> unique_hashes(hashes, hashes + n);
+    std::sort(unique_hashes.begin(), unique_hashes.end());
+    unique_hashes.erase(std::unique(unique_hashes.begin(), unique_hashes.end()),
+                        unique_hashes.end());
+    const size_t size = unique_hashes.size();
+
+    auto xor_filter = xorfilter_plus::XorFilterPlus<uint64_t, fingerprint_t>(size);
+    xor_filter.AddAll(unique_hashes.data(), 0, size);
+
+    xorfilter_plus::Rank9* rank = xor_filter.rank;
+    const size_t fingerprint_count =
+        (xor_filter.totalSizeInBytes - rank->getBitCount() / 8) / sizeof(fingerprint_t);
+
+    PutFilterHeader(dst, kType);
+    PutFixed32(dst, xor_filter.blockLength);
+    PutFixed64(dst, xor_filter.hasher->seed);
+    PutFixed32(dst, fingerprint_count);
+    PutFixed32(dst, rank->bitsArraySize);
+    PutFixed32(dst, rank->countsArraySize);
+    for (size_t i = 0; i < fingerprint_count; i++) {
+      const fingerprint_t f = xor_filter.fingerprints[i];
+      dst->push_back(static_cast<char>(f));
+      if (sizeof(fingerprint_t) == 2) dst->push_back(static_cast<char>(f >> 8));
+    }
+    for (size_t i = 0; i < rank->bitsArraySize; i++) {
+      PutFixed64(dst, rank->bits[i]);
+    }
+    for (size_t i = 0; i < rank->countsArraySize; i++) {
+      PutFixed64(dst, rank->counts[i]);
+    }
+  }
 
-    return res;
+  static bool Open(const Slice& filter, View* view) {
+    Slice input = filter;
+    return GetFilterHeader(&input, kType) && view->Open(input);
   }
 };
 
+}  // namespace
+
 const FilterPolicy* NewXorPlusFilterPolicy(size_t bits_per_key) {
   switch (bits_per_key) {
     case 16:
-      return new XorPlusFilterPolicy<uint16_t>();
+      return new FilterPolicyAdapter<XorPlusFilterTraits<uint16_t>>();
     default:
-      return new XorPlusFilterPolicy<uint8_t>();
+      return new FilterPolicyAdapter<XorPlusFilterTraits<uint8_t>>();
   }
 }
 
-}  // namespace leveldb
\ No newline at end of file
+}  // namespace leveldb
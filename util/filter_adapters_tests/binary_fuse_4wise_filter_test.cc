@@ -0,0 +1,50 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "gtest/gtest.h"
+#include "leveldb/filter_policy.h"
+#include "util/filter_adapters_tests/filter_adapter_test.h"
+
+namespace leveldb {
+
+// Parameterized by bits per key.
+class BinaryFuse4WiseFilterTest : public testing::TestWithParam<int>,
+                                  public FilterAdapterHarness {
+ public:
+  BinaryFuse4WiseFilterTest()
+      : FilterAdapterHarness(NewBinaryFuse4WiseFilterPolicy(GetParam())) {}
+};
+
+TEST_P(BinaryFuse4WiseFilterTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_P(BinaryFuse4WiseFilterTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_P(BinaryFuse4WiseFilterTest, SingleKey) {
+  Add("hello");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_P(BinaryFuse4WiseFilterTest, DuplicateKeys) { CheckDuplicateKeys(100, 20); }
+
+TEST_P(BinaryFuse4WiseFilterTest, KeysMayMatch) { CheckKeysMayMatch(); }
+
+TEST_P(BinaryFuse4WiseFilterTest, VaryingLengths) {
+  CheckVaryingLengths(0.02, 0.0125);
+}
+
+INSTANTIATE_TEST_SUITE_P(BitsPerKey, BinaryFuse4WiseFilterTest,
+                         testing::Values(8, 16));
+
+}  // namespace leveldb
@@ -0,0 +1,55 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "gtest/gtest.h"
+#include "leveldb/filter_policy.h"
+#include "util/filter_adapters_tests/filter_adapter_test.h"
+
+namespace leveldb {
+
+// Parameterized by bits per key.
+class BlockedBloomFilter512Test : public testing::TestWithParam<int>,
+                                  public FilterAdapterHarness {
+ public:
+  BlockedBloomFilter512Test()
+      : FilterAdapterHarness(NewBlockedBloomFilterPolicy512(GetParam())) {}
+};
+
+TEST_P(BlockedBloomFilter512Test, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_P(BlockedBloomFilter512Test, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_P(BlockedBloomFilter512Test, DuplicateKeys) { CheckDuplicateKeys(100, 20); }
+
+TEST_P(BlockedBloomFilter512Test, KeysMayMatch) { CheckKeysMayMatch(); }
+
+// bits_per_key bits per key, plus at most one bucket of rounding, the
+// alignment padding and the header.
+TEST_P(BlockedBloomFilter512Test, Size) {
+  char buffer[sizeof(int)];
+  for (int i = 0; i < 10000; i++) {
+    Add(Key(i, buffer));
+  }
+  Build();
+  ASSERT_LE(FilterSize(), 10000 * GetParam() / 8 + 64 + 64 + 16);
+}
+
+TEST_P(BlockedBloomFilter512Test, VaryingLengths) {
+  CheckVaryingLengths(0.02, 0.0125);
+}
+
+INSTANTIATE_TEST_SUITE_P(BitsPerKey, BlockedBloomFilter512Test,
+                         testing::Values(16, 24));
+
+}  // namespace leveldb
@@ -0,0 +1,187 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Test harness shared by the filter adapter tests: builds a filter over the
+// keys passed to Add() with the policy under test and probes it.
+
+#ifndef STORAGE_LEVELDB_UTIL_FILTER_ADAPTERS_TESTS_FILTER_ADAPTER_TEST_H_
+#define STORAGE_LEVELDB_UTIL_FILTER_ADAPTERS_TESTS_FILTER_ADAPTER_TEST_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/filter_policy.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+class FilterAdapterHarness {
+ public:
+  static const int kVerbose = 1;
+
+  // Takes ownership of policy.
+  explicit FilterAdapterHarness(const FilterPolicy* policy) : policy_(policy) {}
+
+  ~FilterAdapterHarness() { delete policy_; }
+
+  static Slice Key(int i, char* buffer) {
+    EncodeFixed32(buffer, i);
+    return Slice(buffer, sizeof(uint32_t));
+  }
+
+  void Reset() {
+    keys_.clear();
+    filter_.clear();
+  }
+
+  void Add(const Slice& s) { keys_.push_back(s.ToString()); }
+
+  void Build() {
+    std::vector<Slice> key_slices;
+    for (size_t i = 0; i < keys_.size(); i++) {
+      key_slices.push_back(Slice(keys_[i]));
+    }
+    filter_.clear();
+    policy_->CreateFilter(key_slices.data(), static_cast<int>(key_slices.size()),
+                          &filter_);
+    keys_.clear();
+  }
+
+  size_t FilterSize() const { return filter_.size(); }
+
+  // The last filter built, for tests of the adapter's layout.
+  const std::string& filter() const { return filter_; }
+
+  bool Matches(const Slice& s) {
+    if (!keys_.empty()) {
+      Build();
+    }
+    return policy_->KeyMayMatch(s, filter_);
+  }
+
+  // Probes keys [first,first+n-1] with KeysMayMatch(), checks every result
+  // against KeyMayMatch() and returns the number of matches.
+  int BatchMatches(int first, int n) {
+    if (!keys_.empty()) {
+      Build();
+    }
+    char buffer[sizeof(int)];
+    std::vector<std::string> key_strings(n);
+    std::vector<Slice> key_slices(n);
+    for (int i = 0; i < n; i++) {
+      key_strings[i] = Key(first + i, buffer).ToString();
+      key_slices[i] = key_strings[i];
+    }
+    std::unique_ptr<bool[]> results(new bool[n]);
+    policy_->KeysMayMatch(key_slices.data(), n, filter_, results.get());
+    int matches = 0;
+    for (int i = 0; i < n; i++) {
+      EXPECT_EQ(policy_->KeyMayMatch(key_slices[i], filter_), results[i])
+          << "key " << first + i;
+      if (results[i]) matches++;
+    }
+    return matches;
+  }
+
+  // Checks KeysMayMatch() against KeyMayMatch() on an empty filter and on
+  // one over 10000 keys, which all have to match.  At most
+  // max_false_positives of 10000 other keys may (2% by default).
+  void CheckKeysMayMatch(int max_false_positives = 200) {
+    ASSERT_EQ(0, BatchMatches(0, 100));
+
+    char buffer[sizeof(int)];
+    for (int i = 0; i < 10000; i++) {
+      Add(Key(i, buffer));
+    }
+    ASSERT_EQ(10000, BatchMatches(0, 10000));
+    ASSERT_EQ(37, BatchMatches(5000, 37));  // Not a whole number of batches
+    ASSERT_LE(BatchMatches(1000000000, 10000), max_false_positives);
+  }
+
+  // Adds each of keys [0,distinct-1] copies times: the filter must match
+  // every one of them.
+  void CheckDuplicateKeys(int distinct, int copies) {
+    char buffer[sizeof(int)];
+    for (int i = 0; i < distinct * copies; i++) {
+      Add(Key(i % distinct, buffer));
+    }
+    ASSERT_EQ(distinct, BatchMatches(0, distinct));
+  }
+
+  double FalsePositiveRate() {
+    char buffer[sizeof(int)];
+    int result = 0;
+    for (int i = 0; i < 10000; i++) {
+      if (Matches(Key(i + 1000000000, buffer))) {
+        result++;
+      }
+    }
+    return result / 10000.0;
+  }
+
+  // Builds filters over min_length to max_length keys.  Every filter must
+  // match all of its keys and stay under max_rate false positives, and at
+  // most one in six may exceed mediocre_rate.
+  void CheckVaryingLengths(double max_rate, double mediocre_rate,
+                           int min_length = 1, int max_length = 100000) {
+    char buffer[sizeof(int)];
+    int mediocre_filters = 0;
+    int good_filters = 0;
+
+    for (int length = min_length; length <= max_length;
+         length = NextLength(length)) {
+      Reset();
+      for (int i = 0; i < length; i++) {
+        Add(Key(i, buffer));
+      }
+      Build();
+
+      for (int i = 0; i < length; i++) {
+        ASSERT_TRUE(Matches(Key(i, buffer)))
+            << "Length " << length << "; key " << i;
+      }
+
+      double rate = FalsePositiveRate();
+      if (kVerbose >= 1) {
+        std::fprintf(stderr,
+                     "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+                     rate * 100.0, length, static_cast<int>(FilterSize()));
+      }
+      ASSERT_LE(rate, max_rate);
+      if (rate > mediocre_rate)
+        mediocre_filters++;  // Allowed, but not too often
+      else
+        good_filters++;
+    }
+    if (kVerbose >= 1) {
+      std::fprintf(stderr, "Filters: %d good, %d mediocre\n", good_filters,
+                   mediocre_filters);
+    }
+    ASSERT_LE(mediocre_filters, good_filters / 5);
+  }
+
+ private:
+  static int NextLength(int length) {
+    if (length < 10) {
+      length += 1;
+    } else if (length < 100) {
+      length += 10;
+    } else if (length < 1000) {
+      length += 100;
+    } else {
+      length += 1000;
+    }
+    return length;
+  }
+
+  const FilterPolicy* policy_;
+  std::string filter_;
+  std::vector<std::string> keys_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_FILTER_ADAPTERS_TESTS_FILTER_ADAPTER_TEST_H_
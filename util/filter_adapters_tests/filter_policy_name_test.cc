@@ -0,0 +1,90 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/filter_policy.h"
+
+namespace leveldb {
+
+// Tables store their filters under "filter." + Name(), so two adapters with
+// the same name would read each other's filters.  Fingerprint widths change
+// the filter layout, so every width a factory accepts counts as an adapter.
+TEST(FilterPolicyNameTest, AdaptersHaveDistinctNames) {
+  std::vector<std::unique_ptr<const FilterPolicy>> policies;
+  policies.emplace_back(NewBloomFilterPolicy(10));
+  policies.emplace_back(NewXorFilterPolicy(8));
+  policies.emplace_back(NewXorFilterPolicy(16));
+  policies.emplace_back(NewXorPlusFilterPolicy(8));
+  policies.emplace_back(NewXorPlusFilterPolicy(16));
+  policies.emplace_back(NewBinaryFuseFilterPolicy(8));
+  policies.emplace_back(NewBinaryFuseFilterPolicy(16));
+  policies.emplace_back(NewBinaryFuse4WiseFilterPolicy(8));
+  policies.emplace_back(NewBinaryFuse4WiseFilterPolicy(16));
+  policies.emplace_back(NewRibbonFilterPolicy(10));
+  policies.emplace_back(NewBlockedBloomFilterPolicy(45));
+  policies.emplace_back(NewBlockedBloomFilterPolicyFixed(45));
+  policies.emplace_back(NewBlockedBloomFilterPolicy512(16));
+  for (size_t bits : {8, 12, 16}) {
+    policies.emplace_back(NewVacuumFilterPolicy(bits));
+    policies.emplace_back(NewVacuumFilterPolicy(bits, true));
+    policies.emplace_back(NewCuckooFilterPolicy(bits));
+    policies.emplace_back(NewMortonFilterPolicy(bits));
+  }
+  policies.emplace_back(NewPrefixFilterPolicy());
+  policies.emplace_back(NewTCShortcutFilterPolicy(8));
+  policies.emplace_back(NewTCShortcutFilterPolicy(16));
+
+  std::set<std::string> names;
+  for (const auto& policy : policies) {
+    ASSERT_TRUE(names.insert(policy->Name()).second) << policy->Name();
+  }
+}
+
+static std::string PolicyName(const FilterPolicy* policy) {
+  std::unique_ptr<const FilterPolicy> owner(policy);
+  return policy->Name();
+}
+
+// Widths that map to the same layout, and filters that record their own
+// size, keep one name: any instance of the family reads them.
+TEST(FilterPolicyNameTest, SizesShareNames) {
+  ASSERT_EQ(PolicyName(NewXorFilterPolicy(8)),
+            PolicyName(NewXorFilterPolicy(10)));
+  ASSERT_EQ(PolicyName(NewXorPlusFilterPolicy(8)),
+            PolicyName(NewXorPlusFilterPolicy(10)));
+  ASSERT_EQ(PolicyName(NewBinaryFuseFilterPolicy(8)),
+            PolicyName(NewBinaryFuseFilterPolicy(10)));
+  ASSERT_EQ(PolicyName(NewBinaryFuse4WiseFilterPolicy(8)),
+            PolicyName(NewBinaryFuse4WiseFilterPolicy(10)));
+  ASSERT_EQ(PolicyName(NewCuckooFilterPolicy(8)),
+            PolicyName(NewCuckooFilterPolicy(10)));
+  ASSERT_EQ(PolicyName(NewVacuumFilterPolicy(8)),
+            PolicyName(NewVacuumFilterPolicy(10)));
+  ASSERT_EQ(PolicyName(NewMortonFilterPolicy(8)),
+            PolicyName(NewMortonFilterPolicy(10)));
+  // 12-bit remainders are stored as 16-bit ones.
+  ASSERT_EQ(PolicyName(NewTCShortcutFilterPolicy(16)),
+            PolicyName(NewTCShortcutFilterPolicy(12)));
+
+  ASSERT_EQ(PolicyName(NewBloomFilterPolicy(10)),
+            PolicyName(NewBloomFilterPolicy(20)));
+  ASSERT_EQ(PolicyName(NewRibbonFilterPolicy(10)),
+            PolicyName(NewRibbonFilterPolicy(7.5)));
+  ASSERT_EQ(PolicyName(NewBlockedBloomFilterPolicy(10)),
+            PolicyName(NewBlockedBloomFilterPolicy(20)));
+  ASSERT_EQ(PolicyName(NewBlockedBloomFilterPolicy512(16)),
+            PolicyName(NewBlockedBloomFilterPolicy512(24)));
+  for (size_t bits = 40; bits <= 50; bits++) {
+    ASSERT_EQ(PolicyName(NewBlockedBloomFilterPolicyFixed(45)),
+              PolicyName(NewBlockedBloomFilterPolicyFixed(bits)))
+        << bits;
+  }
+}
+
+}  // namespace leveldb
@@ -0,0 +1,97 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/filter_policy.h"
+#include "util/coding.h"
+#include "util/filter_adapters/FilterSimd.h"
+
+namespace leveldb {
+
+typedef const FilterPolicy* (*PolicyFactory)(size_t bits_per_key);
+
+struct SimdAdapter {
+  PolicyFactory factory;
+  size_t bits_per_key;
+};
+
+void PrintTo(const SimdAdapter& adapter, std::ostream* os) {
+  *os << adapter.bits_per_key << " bits per key";
+}
+
+// Policies constructed while the limit is lowered keep the portable kernels.
+class ScalarKernels {
+ public:
+  ScalarKernels() { SetFilterSimdLevelLimitForTesting(kFilterSimdScalar); }
+  ~ScalarKernels() { SetFilterSimdLevelLimitForTesting(kFilterSimdAvx512); }
+};
+
+// Parameterized by the adapters that have SIMD kernels.
+class FilterSimdTest : public testing::TestWithParam<SimdAdapter> {};
+
+TEST_P(FilterSimdTest, ScalarLimit) {
+  ScalarKernels scalar;
+  ASSERT_EQ(kFilterSimdScalar, FilterSimdLevelSupported());
+}
+
+// Both kernels must read the filters either of them builds the same way,
+// one key at a time and in batches.
+TEST_P(FilterSimdTest, KernelsAgree) {
+  const SimdAdapter& adapter = GetParam();
+  std::unique_ptr<const FilterPolicy> simd(adapter.factory(adapter.bits_per_key));
+  std::unique_ptr<const FilterPolicy> portable;
+  {
+    ScalarKernels scalar;
+    portable.reset(adapter.factory(adapter.bits_per_key));
+  }
+
+  const int kKeys = 10000;
+  const int kProbes = 2 * kKeys;
+  std::vector<std::string> key_strings(kProbes);
+  std::vector<Slice> keys(kProbes);
+  for (int i = 0; i < kProbes; i++) {
+    char buffer[sizeof(uint32_t)];
+    EncodeFixed32(buffer, i < kKeys ? i : i - kKeys + 1000000000);
+    key_strings[i].assign(buffer, sizeof(buffer));
+    keys[i] = key_strings[i];
+  }
+
+  const FilterPolicy* builders[] = {simd.get(), portable.get()};
+  for (const FilterPolicy* builder : builders) {
+    std::string filter;
+    builder->CreateFilter(keys.data(), kKeys, &filter);
+
+    std::unique_ptr<bool[]> simd_results(new bool[kProbes]);
+    std::unique_ptr<bool[]> portable_results(new bool[kProbes]);
+    simd->KeysMayMatch(keys.data(), kProbes, filter, simd_results.get());
+    portable->KeysMayMatch(keys.data(), kProbes, filter, portable_results.get());
+    for (int i = 0; i < kProbes; i++) {
+      if (i < kKeys) {
+        ASSERT_TRUE(portable_results[i]) << "key " << i;
+      }
+      ASSERT_EQ(simd_results[i], portable_results[i]) << "key " << i;
+      ASSERT_EQ(simd_results[i], simd->KeyMayMatch(keys[i], filter)) << "key " << i;
+      ASSERT_EQ(portable_results[i], portable->KeyMayMatch(keys[i], filter))
+          << "key " << i;
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    BlockedBloom, FilterSimdTest,
+    testing::Values(SimdAdapter{&NewBlockedBloomFilterPolicy, 45},
+                    SimdAdapter{&NewBlockedBloomFilterPolicyFixed, 45},
+                    SimdAdapter{&NewBlockedBloomFilterPolicy512, 12}));
+
+INSTANTIATE_TEST_SUITE_P(
+    TCShortcut, FilterSimdTest,
+    testing::Values(SimdAdapter{&NewTCShortcutFilterPolicy, 8},
+                    SimdAdapter{&NewTCShortcutFilterPolicy, 16}));
+
+}  // namespace leveldb
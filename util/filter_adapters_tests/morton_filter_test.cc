@@ -0,0 +1,126 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <memory>
+
+#include "gtest/gtest.h"
+#include "leveldb/filter_policy.h"
+#include "util/filter_adapters/FilterEncoding.h"
+#include "util/filter_adapters_tests/filter_adapter_test.h"
+
+namespace leveldb {
+
+// Parameterized by bits per key.
+class MortonFilterTest : public testing::TestWithParam<int>,
+                         public FilterAdapterHarness {
+ public:
+  // Kinds of MortonFilterPolicy filters, following the common header.
+  enum Kind { kMorton = 0, kCuckooFallback = 1 };
+
+  MortonFilterTest()
+      : FilterAdapterHarness(NewMortonFilterPolicy(GetParam())) {}
+
+  void AddKeys(int n) {
+    char buffer[sizeof(int)];
+    for (int i = 0; i < n; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+  }
+
+  int FilterKind() const { return filter()[kFilterHeaderSize]; }
+
+  // The cuckoo filter a small Morton filter falls back to.
+  Slice FallbackFilter() const {
+    Slice input = filter();
+    input.remove_prefix(kFilterHeaderSize + 1);
+    return input;
+  }
+
+  // Fallback filters get four more fingerprint bits, up to 16.
+  int FallbackBits() const { return GetParam() == 8 ? 12 : 16; }
+};
+
+TEST_P(MortonFilterTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_P(MortonFilterTest, Small) {
+  Add("hello");
+  Add("world");
+  Add("hello2");
+  Add("world2");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(Matches("hello2"));
+  ASSERT_TRUE(Matches("world2"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_P(MortonFilterTest, DuplicateKeys) {
+  CheckDuplicateKeys(10000, 2);
+  ASSERT_EQ(kMorton, FilterKind());
+}
+
+TEST_P(MortonFilterTest, KeysMayMatch) { CheckKeysMayMatch(); }
+
+// Tables need MortonTableView::kMinBuckets buckets, about 8k, so filters
+// over fewer than about 6k keys are cuckoo filters with wider fingerprints.
+TEST_P(MortonFilterTest, SmallTablesFallBackToCuckoo) {
+  std::unique_ptr<const FilterPolicy> fallback(
+      NewCuckooFilterPolicy(FallbackBits()));
+  for (int length : {1, 100, 1000, 5000}) {
+    Reset();
+    AddKeys(length);
+    ASSERT_EQ(kCuckooFallback, FilterKind()) << length;
+
+    // The embedded filter is the cuckoo filter of the wider fingerprints:
+    // other widths would not open it and match every key.
+    char buffer[sizeof(int)];
+    int false_positives = 0;
+    for (int i = 0; i < 10000; i++) {
+      const Slice key = Key(i + 1000000000, buffer);
+      const bool matches = fallback->KeyMayMatch(key, FallbackFilter());
+      ASSERT_EQ(Matches(key), matches) << length;
+      if (matches) false_positives++;
+    }
+    // 8 / 2^12 at most for a full table, less with more bits.
+    ASSERT_LE(false_positives, 20) << length;
+  }
+
+  for (int length : {10000, 100000}) {
+    Reset();
+    AddKeys(length);
+    ASSERT_EQ(kMorton, FilterKind()) << length;
+  }
+}
+
+TEST_P(MortonFilterTest, VaryingLengths) {
+  CheckVaryingLengths(0.05, 0.0125);
+}
+
+INSTANTIATE_TEST_SUITE_P(BitsPerKey, MortonFilterTest,
+                         testing::Values(8, 12, 16));
+
+// Large filters are Morton tables proper; wider fingerprints trade space
+// for fewer false positives.
+TEST(MortonFilterWidthTest, WiderFingerprintsFewerFalsePositives) {
+  double previous_rate = 1;
+  for (int bits : {8, 12, 16}) {
+    FilterAdapterHarness harness(NewMortonFilterPolicy(bits));
+    char buffer[sizeof(int)];
+    for (int i = 0; i < 100000; i++) {
+      harness.Add(FilterAdapterHarness::Key(i, buffer));
+    }
+    const double rate = harness.FalsePositiveRate();
+    std::fprintf(stderr, "%d bits: %5.3f%% false positives, %d bytes\n", bits,
+                 rate * 100.0, static_cast<int>(harness.FilterSize()));
+    ASSERT_LT(rate, previous_rate) << bits;
+    previous_rate = rate;
+  }
+}
+
+}  // namespace leveldb
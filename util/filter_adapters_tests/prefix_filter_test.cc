@@ -0,0 +1,144 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/filter_policy.h"
+#include "util/coding.h"
+#include "util/filter_adapters/FilterEncoding.h"
+#include "util/filter_adapters/FilterSimd.h"
+#include "util/filter_adapters_tests/filter_adapter_test.h"
+
+namespace leveldb {
+
+class PrefixFilterTest : public testing::Test, public FilterAdapterHarness {
+ public:
+  // Following the common header: the PD count, the padding length and the
+  // padding, then the 32-byte PDs and the spare filter.
+  static const size_t kPdCountOffset = kFilterHeaderSize;
+  static const size_t kPaddingOffset = kPdCountOffset + sizeof(uint32_t);
+  static const size_t kPdBytes = 32;
+  static const uint64_t kNotOverflowedBit = 32;
+
+  PrefixFilterTest() : FilterAdapterHarness(NewPrefixFilterPolicy()) {}
+
+  void AddKeys(int n) {
+    char buffer[sizeof(int)];
+    for (int i = 0; i < n; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+  }
+
+  uint32_t NumPds() const { return DecodeFixed32(filter().data() + kPdCountOffset); }
+
+  size_t PdsOffset() const {
+    return kPaddingOffset + 1 + static_cast<uint8_t>(filter()[kPaddingOffset]);
+  }
+
+  size_t SpareOffset() const { return PdsOffset() + kPdBytes * NumPds(); }
+
+  int OverflowedPds() const {
+    int overflowed = 0;
+    for (uint32_t i = 0; i < NumPds(); i++) {
+      const uint64_t word = DecodeFixed64(filter().data() + PdsOffset() + kPdBytes * i);
+      if ((word & kNotOverflowedBit) == 0) overflowed++;
+    }
+    return overflowed;
+  }
+};
+
+TEST_F(PrefixFilterTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(PrefixFilterTest, Small) {
+  Add("hello");
+  Add("world");
+  Add("hello2");
+  Add("world2");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(Matches("hello2"));
+  ASSERT_TRUE(Matches("world2"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_F(PrefixFilterTest, DuplicateKeys) { CheckDuplicateKeys(10000, 2); }
+
+TEST_F(PrefixFilterTest, KeysMayMatch) { CheckKeysMayMatch(); }
+
+TEST_F(PrefixFilterTest, VaryingLengths) { CheckVaryingLengths(0.05, 0.0125); }
+
+// The fingerprints of a full PD beyond its kMaxCapacity smallest are only in
+// the spare filter: without it, their keys stop matching.
+TEST_F(PrefixFilterTest, OverflowGoesToSpare) {
+  const int kKeys = 100000;
+  AddKeys(kKeys);
+  ASSERT_GT(OverflowedPds(), 0);
+  ASSERT_LT(SpareOffset(), FilterSize());
+
+  const std::string full = filter();
+  std::unique_ptr<const FilterPolicy> policy(NewPrefixFilterPolicy());
+  const Slice without_spare(full.data(), SpareOffset());
+  int spare_keys = 0;
+  char buffer[sizeof(int)];
+  for (int i = 0; i < kKeys; i++) {
+    const Slice key = Key(i, buffer);
+    ASSERT_TRUE(policy->KeyMayMatch(key, full)) << "key " << i;
+    if (!policy->KeyMayMatch(key, without_spare)) spare_keys++;
+  }
+  // About 6% of the keys at the adapter's PD load.
+  ASSERT_GT(spare_keys, 0);
+  ASSERT_LT(spare_keys, kKeys / 8);
+}
+
+// The AVX2 and SWAR PD probes must read the filters either of them builds
+// the same way, including the keys of overflowed PDs.
+TEST_F(PrefixFilterTest, Avx2MatchesSwar) {
+  if (FilterSimdLevelSupported() < kFilterSimdAvx2) {
+    GTEST_SKIP() << "AVX2 not available";
+  }
+  std::unique_ptr<const FilterPolicy> simd(NewPrefixFilterPolicy());
+  std::unique_ptr<const FilterPolicy> swar;
+  SetFilterSimdLevelLimitForTesting(kFilterSimdScalar);
+  swar.reset(NewPrefixFilterPolicy());
+  SetFilterSimdLevelLimitForTesting(kFilterSimdAvx512);
+
+  const int kKeys = 100000;
+  const int kProbes = 2 * kKeys;
+  std::vector<std::string> key_strings(kProbes);
+  std::vector<Slice> keys(kProbes);
+  char buffer[sizeof(int)];
+  for (int i = 0; i < kProbes; i++) {
+    key_strings[i] = Key(i < kKeys ? i : i - kKeys + 1000000000, buffer).ToString();
+    keys[i] = key_strings[i];
+  }
+
+  const FilterPolicy* builders[] = {simd.get(), swar.get()};
+  for (const FilterPolicy* builder : builders) {
+    std::string filter;
+    builder->CreateFilter(keys.data(), kKeys, &filter);
+
+    std::unique_ptr<bool[]> simd_results(new bool[kProbes]);
+    std::unique_ptr<bool[]> swar_results(new bool[kProbes]);
+    simd->KeysMayMatch(keys.data(), kProbes, filter, simd_results.get());
+    swar->KeysMayMatch(keys.data(), kProbes, filter, swar_results.get());
+    for (int i = 0; i < kProbes; i++) {
+      if (i < kKeys) {
+        ASSERT_TRUE(swar_results[i]) << "key " << i;
+      }
+      ASSERT_EQ(simd_results[i], swar_results[i]) << "key " << i;
+      ASSERT_EQ(simd_results[i], simd->KeyMayMatch(keys[i], filter)) << "key " << i;
+      ASSERT_EQ(swar_results[i], swar->KeyMayMatch(keys[i], filter)) << "key " << i;
+    }
+  }
+}
+
+}  // namespace leveldb
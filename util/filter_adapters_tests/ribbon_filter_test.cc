@@ -2,89 +2,36 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
+#include <cmath>
+
 #include "gtest/gtest.h"
 #include "leveldb/filter_policy.h"
-#include "util/coding.h"
-#include "util/logging.h"
-#include "util/testutil.h"
+#include "util/filter_adapters/FilterEncoding.h"
+#include "util/filter_adapters_tests/filter_adapter_test.h"
 
 namespace leveldb {
 
-static const int kVerbose = 1;
-
-static Slice Key(int i, char* buffer) {
-  EncodeFixed32(buffer, i);
-  return Slice(buffer, sizeof(uint32_t));
-}
-
-class RibbonFilterTest : public testing::Test {
+// Parameterized by bits per key.
+class RibbonFilterTest : public testing::TestWithParam<double>,
+                         public FilterAdapterHarness {
  public:
-  RibbonFilterTest(): policy_(NewRibbonFilterPolicy()) {}
-
-  ~RibbonFilterTest() { delete policy_; }
-
-  void Reset() {
-    keys_.clear();
-    filter_.clear();
-  }
-
-  void Add(const Slice& s) { keys_.push_back(s.ToString()); }
-
-  void Build() {
-    std::vector<Slice> key_slices;
-    for (size_t i = 0; i < keys_.size(); i++) {
-      key_slices.push_back(Slice(keys_[i]));
-    }
-    filter_.clear();
-    policy_->CreateFilter(&key_slices[0], static_cast<int>(key_slices.size()),
-                          &filter_);
-    keys_.clear();
-    if (kVerbose >= 2) DumpFilter();
-  }
-
-  size_t FilterSize() const { return filter_.size(); }
-
-  void DumpFilter() {
-    std::fprintf(stderr, "F(");
-    for (size_t i = 0; i + 1 < filter_.size(); i++) {
-      const unsigned int c = static_cast<unsigned int>(filter_[i]);
-      for (int j = 0; j < 8; j++) {
-        std::fprintf(stderr, "%c", (c & (1 << j)) ? '1' : '.');
-      }
-    }
-    std::fprintf(stderr, ")\n");
-  }
-
-  bool Matches(const Slice& s) {
-    if (!keys_.empty()) {
-      Build();
-    }
-    return policy_->KeyMayMatch(s, filter_);
-  }
+  RibbonFilterTest() : FilterAdapterHarness(NewRibbonFilterPolicy(GetParam())) {}
 
-  double FalsePositiveRate() {
+  void AddKeys(int n) {
     char buffer[sizeof(int)];
-    int result = 0;
-    for (int i = 0; i < 10000; i++) {
-      if (Matches(Key(i + 1000000000, buffer))) {
-        result++;
-      }
+    for (int i = 0; i < n; i++) {
+      Add(Key(i, buffer));
     }
-    return result / 10000.0;
+    Build();
   }
-
- private:
-  const FilterPolicy* policy_;
-  std::string filter_;
-  std::vector<std::string> keys_;
 };
 
-TEST_F(RibbonFilterTest, EmptyFilter) {
+TEST_P(RibbonFilterTest, EmptyFilter) {
   ASSERT_TRUE(!Matches("hello"));
   ASSERT_TRUE(!Matches("world"));
 }
 
-TEST_F(RibbonFilterTest, Small) {
+TEST_P(RibbonFilterTest, Small) {
   Add("hello");
   Add("world");
   ASSERT_TRUE(Matches("hello"));
@@ -93,63 +40,48 @@ TEST_F(RibbonFilterTest, Small) {
   ASSERT_TRUE(!Matches("foo"));
 }
 
-static int NextLength(int length) {
-  if (length < 10) {
-    length += 1;
-  } else if (length < 100) {
-    length += 10;
-  } else if (length < 1000) {
-    length += 100;
-  } else {
-    length += 1000;
-  }
-  return length;
-}
+TEST_P(RibbonFilterTest, DuplicateKeys) { CheckDuplicateKeys(100, 20); }
 
-TEST_F(RibbonFilterTest, VaryingLengths) {
-  char buffer[sizeof(int)];
+TEST_P(RibbonFilterTest, KeysMayMatch) { CheckKeysMayMatch(); }
 
-  // Count number of filters that significantly exceed the false positive rate
-  int mediocre_filters = 0;
-  int good_filters = 0;
-
-  for (int length = 1; length <= 100000; length = NextLength(length)) {
+// Small filters are Bloom filters, large ones Ribbon filters; both take
+// bits per key of space, give or take a few bytes.
+TEST_P(RibbonFilterTest, SpacePerKey) {
+  for (int length : {10, 100, 1000, 100000}) {
     Reset();
-    for (int i = 0; i < length; i++) {
-      Add(Key(i, buffer));
+    AddKeys(length);
+    ASSERT_LE(FilterSize(), static_cast<size_t>(length * GetParam() / 8) + 8 + 1 +
+                                16 + kFilterHeaderSize + 5)
+        << length;
+    if (length >= 1000) {
+      ASSERT_GE(FilterSize(), static_cast<size_t>(length * GetParam() / 8) - 16)
+          << length;
     }
-    Build();
+  }
+}
 
-    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 40 + 1))
-        << length;
+TEST_P(RibbonFilterTest, VaryingLengths) {
+  CheckVaryingLengths(0.02, 0.0125);
+}
 
-    // All added keys must match
-    for (int i = 0; i < length; i++) {
-      ASSERT_TRUE(Matches(Key(i, buffer)))
-          << "Length " << length << "; key " << i;
-    }
+INSTANTIATE_TEST_SUITE_P(BitsPerKey, RibbonFilterTest,
+                         testing::Values(9.3, 10.0, 16.0));
 
-    // Check false positive rate
-    double rate = FalsePositiveRate();
-    if (kVerbose >= 1) {
-      std::fprintf(stderr,
-                   "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
-                   rate * 100.0, length, static_cast<int>(FilterSize()));
+// Fractional bits per key trade space for false positives in between the
+// whole numbers.
+TEST(RibbonFilterFractionalTest, FalsePositiveRate) {
+  double previous_rate = 1;
+  for (double bits : {6.5, 7.0, 7.5}) {
+    FilterAdapterHarness harness(NewRibbonFilterPolicy(bits));
+    char buffer[sizeof(int)];
+    for (int i = 0; i < 100000; i++) {
+      harness.Add(FilterAdapterHarness::Key(i, buffer));
     }
-    ASSERT_LE(rate, 0.02);  // Must not be over 2%
-    if (rate > 0.0125)
-      mediocre_filters++;  // Allowed, but not too often
-    else
-      good_filters++;
-  }
-  if (kVerbose >= 1) {
-    std::fprintf(stderr, "Filters: %d good, %d mediocre\n", good_filters,
-                 mediocre_filters);
+    const double rate = harness.FalsePositiveRate();
+    ASSERT_LE(rate, 1.25 * std::pow(2.0, -bits / 1.05)) << bits;
+    ASSERT_LT(rate, previous_rate) << bits;
+    previous_rate = rate;
   }
-  ASSERT_LE(mediocre_filters, good_filters / 5);
 }
 
-
-// Different bits-per-byte
-
 }  // namespace leveldb
@@ -0,0 +1,48 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "gtest/gtest.h"
+#include "leveldb/filter_policy.h"
+#include "util/filter_adapters_tests/filter_adapter_test.h"
+
+namespace leveldb {
+
+// Parameterized by bits per key.
+class TCShortcutFilterTest : public testing::TestWithParam<int>,
+                             public FilterAdapterHarness {
+ public:
+  TCShortcutFilterTest()
+      : FilterAdapterHarness(NewTCShortcutFilterPolicy(GetParam())) {}
+};
+
+TEST_P(TCShortcutFilterTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_P(TCShortcutFilterTest, Small) {
+  Add("hello");
+  Add("world");
+  Add("hello2");
+  Add("world2");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(Matches("hello2"));
+  ASSERT_TRUE(Matches("world2"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_P(TCShortcutFilterTest, DuplicateKeys) { CheckDuplicateKeys(100, 20); }
+
+TEST_P(TCShortcutFilterTest, KeysMayMatch) { CheckKeysMayMatch(); }
+
+TEST_P(TCShortcutFilterTest, VaryingLengths) {
+  CheckVaryingLengths(0.02, 0.0125);
+}
+
+INSTANTIATE_TEST_SUITE_P(BitsPerKey, TCShortcutFilterTest,
+                         testing::Values(8, 12, 16));
+
+}  // namespace leveldb
@@ -4,8 +4,36 @@
 
 #include "leveldb/filter_policy.h"
 
+#include <cassert>
+
+#include "leveldb/slice.h"
+
 namespace leveldb {
 
 FilterPolicy::~FilterPolicy() {}
 
+void FilterPolicy::KeysMayMatch(const Slice* keys, int n, const Slice& filter,
+                                bool* results) const {
+  for (int i = 0; i < n; i++) {
+    results[i] = KeyMayMatch(keys[i], filter);
+  }
+}
+
+bool FilterPolicy::HashesKeys() const { return false; }
+
+uint64_t FilterPolicy::KeyHash(const Slice& key) const {
+  assert(false);
+  return 0;
+}
+
+void FilterPolicy::CreateFilterFromHashes(const uint64_t* hashes, int n,
+                                          std::string* dst) const {
+  assert(false);
+}
+
+bool FilterPolicy::RangeMayMatch(const Slice& start, const Slice& limit,
+                                 const Slice& filter) const {
+  return true;
+}
+
 }  // namespace leveldb
@@ -0,0 +1,102 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <string>
+#include <vector>
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+namespace {
+
+// Sets *end to the smallest key greater than every key that starts with
+// prefix.  Returns false if there is none, i.e. prefix is all 0xff bytes.
+static bool PrefixEnd(const Slice& prefix, std::string* end) {
+  end->assign(prefix.data(), prefix.size());
+  while (!end->empty()) {
+    const uint8_t byte = static_cast<uint8_t>(end->back());
+    if (byte != 0xff) {
+      end->back() = static_cast<char>(byte + 1);
+      return true;
+    }
+    end->pop_back();
+  }
+  return false;
+}
+
+class KeyPrefixFilterPolicy : public FilterPolicy {
+ public:
+  KeyPrefixFilterPolicy(const FilterPolicy* policy, size_t prefix_length)
+      : policy_(policy),
+        prefix_length_(prefix_length),
+        name_(std::string(policy->Name()) + ".prefix" +
+              std::to_string(prefix_length)) {}
+
+  ~KeyPrefixFilterPolicy() override { delete policy_; }
+
+  const char* Name() const override { return name_.c_str(); }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    std::vector<Slice> filter_keys;
+    filter_keys.reserve(2 * n);
+    // Keys are sorted, so keys with the same prefix are adjacent.
+    Slice last_prefix;
+    bool have_prefix = false;
+    for (int i = 0; i < n; i++) {
+      filter_keys.push_back(keys[i]);
+      if (keys[i].size() < prefix_length_) {
+        continue;
+      }
+      const Slice prefix(keys[i].data(), prefix_length_);
+      if ((!have_prefix || prefix != last_prefix) &&
+          prefix.size() != keys[i].size()) {
+        filter_keys.push_back(prefix);
+      }
+      last_prefix = prefix;
+      have_prefix = true;
+    }
+    policy_->CreateFilter(filter_keys.data(),
+                          static_cast<int>(filter_keys.size()), dst);
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    return policy_->KeyMayMatch(key, filter);
+  }
+
+  void KeysMayMatch(const Slice* keys, int n, const Slice& filter,
+                    bool* results) const override {
+    policy_->KeysMayMatch(keys, n, filter, results);
+  }
+
+  bool RangeMayMatch(const Slice& start, const Slice& limit,
+                     const Slice& filter) const override {
+    if (start.size() < prefix_length_) {
+      return true;
+    }
+    // Every key in [start,limit) has the prefix of start iff limit does not
+    // go past the keys with that prefix.
+    const Slice prefix(start.data(), prefix_length_);
+    std::string end;
+    if (PrefixEnd(prefix, &end) && limit.compare(end) > 0) {
+      return true;
+    }
+    return policy_->KeyMayMatch(prefix, filter);
+  }
+
+ private:
+  const FilterPolicy* const policy_;
+  const size_t prefix_length_;
+  const std::string name_;
+};
+
+}  // namespace
+
+const FilterPolicy* NewKeyPrefixFilterPolicy(const FilterPolicy* policy,
+                                             size_t prefix_length) {
+  return new KeyPrefixFilterPolicy(policy, prefix_length);
+}
+
+}  // namespace leveldb
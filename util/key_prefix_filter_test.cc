@@ -0,0 +1,112 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/filter_policy.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+// Key with a 4-byte big-endian prefix, so that keys sort by prefix first.
+static std::string Key(uint32_t prefix, const std::string& suffix) {
+  std::string key;
+  PutFixed32(&key, prefix);
+  std::reverse(key.begin(), key.end());
+  return key + suffix;
+}
+
+class KeyPrefixFilterTest : public testing::Test {
+ public:
+  KeyPrefixFilterTest()
+      : policy_(NewKeyPrefixFilterPolicy(NewBloomFilterPolicy(10), 4)) {}
+
+  ~KeyPrefixFilterTest() { delete policy_; }
+
+  void Build(std::vector<std::string> keys) {
+    std::sort(keys.begin(), keys.end());
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    filter_.clear();
+    policy_->CreateFilter(key_slices.data(),
+                          static_cast<int>(key_slices.size()), &filter_);
+  }
+
+  bool Matches(const Slice& key) { return policy_->KeyMayMatch(key, filter_); }
+
+  bool RangeMatches(const Slice& start, const Slice& limit) {
+    return policy_->RangeMayMatch(start, limit, filter_);
+  }
+
+ protected:
+  const FilterPolicy* policy_;
+  std::string filter_;
+};
+
+TEST_F(KeyPrefixFilterTest, Name) {
+  const FilterPolicy* bloom = NewBloomFilterPolicy(10);
+  ASSERT_EQ(std::string(bloom->Name()) + ".prefix4", policy_->Name());
+  delete bloom;
+}
+
+TEST_F(KeyPrefixFilterTest, KeysAndPrefixes) {
+  std::vector<std::string> keys;
+  for (uint32_t p = 0; p < 1000; p += 2) {
+    keys.push_back(Key(p, "a"));
+    keys.push_back(Key(p, "b"));
+  }
+  keys.push_back("xy");  // Shorter than the prefix
+  Build(keys);
+
+  for (const std::string& key : keys) {
+    ASSERT_TRUE(Matches(key)) << key;
+  }
+  ASSERT_TRUE(Matches("xy"));
+
+  int false_positives = 0;
+  for (uint32_t p = 0; p < 1000; p++) {
+    const std::string start = Key(p, "");
+    const std::string limit = Key(p + 1, "");
+    const bool matches = RangeMatches(start, limit);
+    if (p % 2 == 0) {
+      ASSERT_TRUE(matches) << p;
+      ASSERT_TRUE(RangeMatches(Key(p, "a"), Key(p, "c"))) << p;
+    } else if (matches) {
+      false_positives++;
+    }
+  }
+  ASSERT_LE(false_positives, 25);  // 5% of the absent prefixes
+}
+
+TEST_F(KeyPrefixFilterTest, RangesPastThePrefix) {
+  Build({Key(1, "a")});
+
+  // A range that leaves the prefix of its start may hold any prefix.
+  ASSERT_TRUE(RangeMatches(Key(7, "a"), Key(8, "a")));
+  ASSERT_TRUE(RangeMatches(Key(7, "a"), Key(9, "")));
+  // So does one whose start is shorter than the prefix.
+  ASSERT_TRUE(RangeMatches("\x01", Key(1, "")));
+}
+
+TEST_F(KeyPrefixFilterTest, LastPrefix) {
+  Build({Key(1, "a")});
+  // No key is greater than every key with an all 0xff prefix, so any limit
+  // stays within it.
+  ASSERT_FALSE(RangeMatches(Key(0xffffffff, "a"), Key(0xffffffff, "b")));
+  Build({Key(0xffffffff, "a")});
+  ASSERT_TRUE(RangeMatches(Key(0xffffffff, ""), std::string(8, '\xff')));
+}
+
+TEST(FilterPolicyTest, RangeMayMatchDefaultsToTrue) {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  std::string filter;
+  const Slice key("a");
+  policy->CreateFilter(&key, 1, &filter);
+  ASSERT_TRUE(policy->RangeMayMatch("x", "y", filter));
+  delete policy;
+}
+
+}  // namespace leveldb